@@ -77,6 +77,11 @@ typedef struct _BenchmarkData
 
   grn_obj top_left_point;
   grn_obj bottom_right_point;
+
+  grn_obj *location_column;
+  grn_obj base_point;
+  grn_table_sort_key sort_keys[2];
+  int sort_limit;
 } BenchmarkData;
 
 static void
@@ -160,6 +165,52 @@ bench_geo_select_in_rectangle(gpointer user_data)
                               GRN_OP_OR);
 }
 
+static void
+bench_setup_sort_by_distance(gpointer user_data, int limit)
+{
+  BenchmarkData *data = user_data;
+  const gchar *tokyo_station = "35.68136,139.76609";
+
+  data->result = grn_table_create(data->context, NULL, 0, NULL,
+                                  GRN_OBJ_TABLE_NO_KEY,
+                                  NULL, data->table);
+  set_geo_point(data->context, &(data->base_point), tokyo_station);
+
+  data->sort_keys[0].key = data->location_column;
+  data->sort_keys[0].flags = GRN_TABLE_SORT_GEO;
+  data->sort_keys[0].offset = 0;
+  data->sort_keys[1].key = &(data->base_point);
+  data->sort_keys[1].flags = GRN_TABLE_SORT_GEO;
+  data->sort_keys[1].offset = 0;
+  data->sort_limit = limit;
+}
+
+static void
+bench_setup_sort_by_distance_nearest(gpointer user_data)
+{
+  bench_setup_sort_by_distance(user_data, 10);
+}
+
+static void
+bench_setup_sort_by_distance_many(gpointer user_data)
+{
+  bench_setup_sort_by_distance(user_data, 1000);
+}
+
+static void
+bench_geo_select_sort_by_distance(gpointer user_data)
+{
+  BenchmarkData *data = user_data;
+
+  grn_table_sort(data->context,
+                 data->table,
+                 0,
+                 data->sort_limit,
+                 data->result,
+                 data->sort_keys,
+                 2);
+}
+
 static void
 bench_teardown(gpointer user_data)
 {
@@ -197,6 +248,7 @@ setup_database(BenchmarkData *data)
 
   data->table = GET(data->context, "Addresses");
   data->index_column = GET(data->context, "Locations.address");
+  data->location_column = GET(data->context, "Addresses.location");
 
   g_free(database_path);
 }
@@ -204,6 +256,7 @@ setup_database(BenchmarkData *data)
 static void
 teardown_database(BenchmarkData *data)
 {
+  grn_obj_unlink(data->context, data->location_column);
   grn_obj_unlink(data->context, data->index_column);
   grn_obj_unlink(data->context, data->table);
   grn_obj_unlink(data->context, data->database);
@@ -227,6 +280,7 @@ main(int argc, gchar **argv)
   setup_database(&data);
   GRN_WGS84_GEO_POINT_INIT(&(data.top_left_point), 0);
   GRN_WGS84_GEO_POINT_INIT(&(data.bottom_right_point), 0);
+  GRN_WGS84_GEO_POINT_INIT(&(data.base_point), 0);
 
   {
     const gchar *groonga_bench_n;
@@ -250,6 +304,10 @@ main(int argc, gchar **argv)
   REGISTER("2nd: select_in_rectangle (partial)", in_rectangle, partial);
   REGISTER("1st: select_in_rectangle     (all)", in_rectangle, all);
   REGISTER("2nd: select_in_rectangle     (all)", in_rectangle, all);
+  REGISTER("1st: sort_by_distance    (nearest)", sort_by_distance, nearest);
+  REGISTER("2nd: sort_by_distance    (nearest)", sort_by_distance, nearest);
+  REGISTER("1st: sort_by_distance       (many)", sort_by_distance, many);
+  REGISTER("2nd: sort_by_distance       (many)", sort_by_distance, many);
 #undef REGISTER
 
   bench_reporter_run(reporter);
@@ -257,6 +315,7 @@ main(int argc, gchar **argv)
 
   grn_obj_unlink(data.context, &(data.top_left_point));
   grn_obj_unlink(data.context, &(data.bottom_right_point));
+  grn_obj_unlink(data.context, &(data.base_point));
   teardown_database(&data);
 
   grn_ctx_fin(data.context);
@@ -0,0 +1,159 @@
+/* -*- c-basic-offset: 2; coding: utf-8 -*- */
+/*
+  Copyright (C) 2015  Brazil
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License version 2.1 as published by the Free Software Foundation.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/*
+  % make --quiet -C benchmark run-bench-normalizer
+
+  Each case normalizes 1MiB text by NormalizerAuto. "ASCII" cases
+  exercise the ASCII fast path in utf8_normalize().
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <groonga.h>
+
+#include "lib/benchmark.h"
+
+#define TEXT_SIZE (1024 * 1024)
+
+typedef struct _BenchmarkData {
+  grn_ctx context;
+  grn_obj *database;
+  grn_obj *normalizer;
+  GString *text;
+  int flags;
+} BenchmarkData;
+
+static void
+bench_normalize(gpointer user_data)
+{
+  BenchmarkData *data = user_data;
+  grn_obj *string;
+
+  string = grn_string_open(&(data->context),
+                           data->text->str,
+                           data->text->len,
+                           data->normalizer,
+                           data->flags);
+  grn_obj_close(&(data->context), string);
+}
+
+static void
+bench_setup_text(BenchmarkData *data, const gchar *unit)
+{
+  g_string_truncate(data->text, 0);
+  while (data->text->len < TEXT_SIZE) {
+    g_string_append(data->text, unit);
+  }
+}
+
+static void
+bench_setup_ascii(gpointer user_data)
+{
+  BenchmarkData *data = user_data;
+
+  bench_setup_text(data, "The Quick Brown Fox jumps over the 2 lazy dogs. ");
+  data->flags = 0;
+}
+
+static void
+bench_setup_ascii_with_checks(gpointer user_data)
+{
+  BenchmarkData *data = user_data;
+
+  bench_setup_ascii(user_data);
+  data->flags = GRN_STRING_WITH_CHECKS | GRN_STRING_WITH_TYPES;
+}
+
+static void
+bench_setup_mixed(gpointer user_data)
+{
+  BenchmarkData *data = user_data;
+
+  bench_setup_text(data, "Groonga is a full text search engine. "
+                   "Groongaは全文検索エンジンです。");
+  data->flags = GRN_STRING_WITH_CHECKS | GRN_STRING_WITH_TYPES;
+}
+
+static void
+bench_setup_japanese(gpointer user_data)
+{
+  BenchmarkData *data = user_data;
+
+  bench_setup_text(data, "日本語の文書をＮＦＫＣで正規化します。");
+  data->flags = GRN_STRING_WITH_CHECKS | GRN_STRING_WITH_TYPES;
+}
+
+static void
+bench_teardown(gpointer user_data)
+{
+}
+
+int
+main(int argc, gchar **argv)
+{
+  BenchmarkData data;
+  BenchReporter *reporter;
+  gint n = 100;
+
+  grn_init();
+  bench_init(&argc, &argv);
+
+  {
+    const gchar *groonga_bench_n;
+    groonga_bench_n = g_getenv("GROONGA_BENCH_N");
+    if (groonga_bench_n) {
+      n = atoi(groonga_bench_n);
+    }
+  }
+
+  grn_ctx_init(&(data.context), 0);
+  grn_ctx_set_encoding(&(data.context), GRN_ENC_UTF8);
+  data.database = grn_db_create(&(data.context), NULL, NULL);
+  data.normalizer = grn_ctx_get(&(data.context), "NormalizerAuto", -1);
+  data.text = g_string_new(NULL);
+
+  reporter = bench_reporter_new();
+
+#define REGISTER(label, setup)                          \
+  bench_reporter_register(reporter, label, n,           \
+                          bench_setup_ ## setup,        \
+                          bench_normalize,              \
+                          bench_teardown,               \
+                          &data)
+  REGISTER("ASCII  (1MiB)        ", ascii);
+  REGISTER("ASCII  (1MiB, checks)", ascii_with_checks);
+  REGISTER("mixed  (1MiB)        ", mixed);
+  REGISTER("Japanese (1MiB)      ", japanese);
+#undef REGISTER
+
+  bench_reporter_run(reporter);
+  g_object_unref(reporter);
+
+  g_string_free(data.text, TRUE);
+  grn_obj_close(&(data.context), data.database);
+  grn_ctx_fin(&(data.context));
+
+  bench_quit();
+  grn_fin();
+
+  return 0;
+}
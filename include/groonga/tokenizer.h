@@ -238,6 +238,33 @@ GRN_PLUGIN_EXPORT const char *grn_tokenizer_tokenized_delimiter_next(grn_ctx *ct
                                                                      unsigned int str_length,
                                                                      grn_encoding encoding);
 
+/*
+  grn_tokenizer_batch_token is a token returned by
+  grn_tokenizer_next_batch_func. `str_ptr' and `str_length' specify
+  the token and `status' is the same as the status passed to
+  grn_tokenizer_token_push(). Note that the string isn't copied. It
+  must be maintained until the next call of the function or
+  finalization.
+ */
+typedef struct _grn_tokenizer_batch_token grn_tokenizer_batch_token;
+
+struct _grn_tokenizer_batch_token {
+  const char *str_ptr;
+  unsigned int str_length;
+  grn_token_status status;
+};
+
+/*
+  grn_tokenizer_next_batch_func extracts at most `max_n_tokens' tokens
+  into `tokens' and returns the number of extracted tokens. It stops
+  after a token with GRN_TOKEN_LAST is extracted. `user_data' is the
+  same object as the one passed to `init' of the tokenizer.
+ */
+typedef unsigned int grn_tokenizer_next_batch_func(grn_ctx *ctx,
+                                                   grn_user_data *user_data,
+                                                   grn_tokenizer_batch_token *tokens,
+                                                   unsigned int max_n_tokens);
+
 /*
   grn_tokenizer_register() registers a plugin to the database which is
   associated with `ctx'. `plugin_name_ptr' and `plugin_name_length' specify the
@@ -255,6 +282,17 @@ GRN_PLUGIN_EXPORT grn_rc grn_tokenizer_register(grn_ctx *ctx, const char *plugin
                                                 grn_proc_func *init, grn_proc_func *next,
                                                 grn_proc_func *fin);
 
+/*
+  grn_tokenizer_set_next_batch_func() sets `next_batch' to `tokenizer'
+  registered by grn_tokenizer_register(). If `next_batch' is set, it
+  is used instead of `next' to extract many tokens at once without
+  passing each token through the grn_ctx stack. `next' is still
+  required for backward compatibility.
+ */
+GRN_PLUGIN_EXPORT grn_rc grn_tokenizer_set_next_batch_func(grn_ctx *ctx,
+                                                           grn_obj *tokenizer,
+                                                           grn_tokenizer_next_batch_func *next_batch);
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif  /* __cplusplus */
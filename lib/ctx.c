@@ -22,6 +22,8 @@
 #include "grn_tokenizers.h"
 #include "grn_ctx_impl.h"
 #include "grn_ii.h"
+#include "grn_store.h"
+#include "grn_expr.h"
 #include "grn_pat.h"
 #include "grn_proc.h"
 #include "grn_plugin.h"
@@ -31,6 +33,10 @@
 #include "grn_mrb.h"
 #include "grn_ctx_impl_mrb.h"
 #include "grn_logger.h"
+#include "grn_lexicon_cache.h"
+#include "grn_expr_cache.h"
+#include "grn_expr_program.h"
+#include "grn_parallel.h"
 #include <stdio.h>
 #include <stdarg.h>
 #include <time.h>
@@ -95,9 +101,15 @@ grn_init_from_env(void)
   grn_ctx_impl_mrb_init_from_env();
   grn_io_init_from_env();
   grn_ii_init_from_env();
+  grn_ra_init_from_env();
+  grn_expr_init_from_env();
   grn_db_init_from_env();
   grn_proc_init_from_env();
   grn_plugin_init_from_env();
+  grn_lexicon_cache_init_from_env();
+  grn_expr_cache_init_from_env();
+  grn_expr_program_init_from_env();
+  grn_parallel_init_from_env();
 }
 
 void
@@ -589,6 +601,9 @@ grn_ctx_impl_init(grn_ctx *ctx)
   ctx->impl->previous_errbuf[0] = '\0';
   ctx->impl->n_same_error_messages = 0;
 
+  ctx->impl->lexicon_cache = NULL;
+  ctx->impl->expr_cache = NULL;
+
 #ifdef GRN_WITH_MESSAGE_PACK
   msgpack_packer_init(&ctx->impl->msgpacker, ctx, grn_msgpack_buffer_write);
 #endif
@@ -723,6 +738,7 @@ grn_ctx_fin(grn_ctx *ctx)
     if (ctx->impl->parser) {
       grn_expr_parser_close(ctx);
     }
+    grn_expr_cache_close(ctx);
     if (ctx->impl->values) {
 #ifndef USE_MEMORY_DEBUG
       grn_db_obj *o;
@@ -763,6 +779,7 @@ grn_ctx_fin(grn_ctx *ctx)
       });
     }
     grn_hash_close(ctx, ctx->impl->expr_vars);
+    grn_lexicon_cache_close(ctx);
     if (ctx->impl->db && ctx->flags & GRN_CTX_PER_DB) {
       grn_obj *db = ctx->impl->db;
       ctx->impl->db = NULL;
@@ -938,8 +955,14 @@ grn_init(void)
   }
   */
   grn_cache_init();
+  grn_lexicon_cache_init();
+  grn_expr_cache_init();
+  grn_parallel_init();
   if (!grn_request_canceler_init()) {
     rc = ctx->rc;
+    grn_parallel_fin();
+    grn_expr_cache_fin();
+    grn_lexicon_cache_fin();
     grn_cache_fin();
     GRN_LOG(ctx, GRN_LOG_ALERT,
             "failed to initialize request canceler (%d)", rc);
@@ -1020,6 +1043,8 @@ grn_fin(void)
 {
   grn_ctx *ctx, *ctx_;
   if (grn_gctx.stat == GRN_CTX_FIN) { return GRN_INVALID_ARGUMENT; }
+  /* worker contexts must be finalized by their threads */
+  grn_parallel_fin();
   for (ctx = grn_gctx.next; ctx != &grn_gctx; ctx = ctx_) {
     ctx_ = ctx->next;
     if (ctx->stat != GRN_CTX_FIN) { grn_ctx_fin(ctx); }
@@ -1036,6 +1061,8 @@ grn_fin(void)
   grn_normalizer_fin();
   grn_plugins_fin();
   grn_ctx_fin(ctx);
+  grn_expr_cache_fin();
+  grn_lexicon_cache_fin();
   grn_com_fin();
   GRN_LOG(ctx, GRN_LOG_NOTICE, "grn_fin (%d)", alloc_count);
   grn_logger_fin(ctx);
@@ -22,6 +22,8 @@
 #include "grn_ii.h"
 #include "grn_ctx_impl.h"
 #include "grn_token_cursor.h"
+#include "grn_lexicon_cache.h"
+#include "grn_expr_cache.h"
 #include "grn_tokenizers.h"
 #include "grn_proc.h"
 #include "grn_plugin.h"
@@ -348,6 +350,7 @@ grn_db_close(grn_ctx *ctx, grn_obj *db)
     if (ctx->impl->parser) {
       grn_expr_parser_close(ctx);
     }
+    grn_expr_cache_close(ctx);
   }
 
   GRN_TINY_ARRAY_EACH(&s->values, 1, grn_db_curr_id(ctx, db), id, vp, {
@@ -1822,6 +1825,7 @@ grn_table_delete(grn_ctx *ctx, grn_obj *table, const void *key, unsigned int key
         break;
       }
       if (rc == GRN_SUCCESS) {
+        grn_lexicon_cache_expire(ctx, table);
         grn_obj_touch(ctx, table, NULL);
       }
     }
@@ -1862,6 +1866,9 @@ _grn_table_delete_by_id(grn_ctx *ctx, grn_obj *table, grn_id id,
         rc = grn_array_delete_by_id(ctx, (grn_array *)table, id, optarg);
         break;
       }
+      if (rc == GRN_SUCCESS) {
+        grn_lexicon_cache_expire(ctx, table);
+      }
     }
   }
 exit :
@@ -1996,6 +2003,7 @@ grn_table_truncate(grn_ctx *ctx, grn_obj *table)
       GRN_OBJ_FIN(ctx, &token_filters);
     }
     if (rc == GRN_SUCCESS) {
+      grn_lexicon_cache_expire(ctx, table);
       grn_obj_touch(ctx, table, NULL);
     }
   }
@@ -4263,7 +4271,8 @@ grn_column_create(grn_ctx *ctx, grn_obj *table,
     if ((flags & GRN_OBJ_KEY_VAR_SIZE) || value_size > sizeof(int64_t)) {
       res = (grn_obj *)grn_ja_create(ctx, path, value_size, flags);
     } else {
-      res = (grn_obj *)grn_ra_create(ctx, path, value_size);
+      res = (grn_obj *)grn_ra_create_with_zone_map(ctx, path, value_size,
+                                                   range);
     }
     break;
   case GRN_OBJ_COLUMN_VECTOR :
@@ -4387,6 +4396,7 @@ default_column_set_value(grn_ctx *ctx, grn_proc_ctx *pctx, grn_obj *in, grn_obj
           return GRN_NO_MEMORY_AVAILABLE;
         }
         grn_memcpy(v, in->u.p.ptr, value_size);
+        grn_ra_zone_map_update(ctx, (grn_ra *)pctx->obj, arg->id, v);
         grn_ra_unref(ctx, (grn_ra *)pctx->obj, arg->id);
       }
       break;
@@ -6801,6 +6811,9 @@ grn_obj_set_value_column_fix_size(grn_ctx *ctx, grn_obj *obj, grn_id id,
       rc = GRN_OPERATION_NOT_SUPPORTED;
       break;
     }
+    if (rc == GRN_SUCCESS) {
+      grn_ra_zone_map_update(ctx, (grn_ra *)obj, id, p);
+    }
     grn_ra_unref(ctx, (grn_ra *)obj, id);
   }
   GRN_OBJ_FIN(ctx, &buf);
@@ -7582,17 +7595,74 @@ grn_token_filters_pack(grn_ctx *ctx,
   }
 }
 
-void
-grn_obj_spec_save(grn_ctx *ctx, grn_db_obj *obj)
+#define SERIALIZED_SPEC_INDEX_SPEC   0
+#define SERIALIZED_SPEC_INDEX_PATH   1
+#define SERIALIZED_SPEC_INDEX_SOURCE 2
+#define SERIALIZED_SPEC_INDEX_HOOK   3
+#define SERIALIZED_SPEC_INDEX_TOKEN_FILTERS 4
+#define SERIALIZED_SPEC_INDEX_EXPR   4
+#define SERIALIZED_SPEC_INDEX_STATISTICS 5
+
+static grn_bool
+grn_obj_spec_get_statistics(grn_ctx *ctx, grn_db *s, grn_id id,
+                            grn_obj *statistics)
+{
+  grn_io_win jw;
+  uint32_t value_len;
+  char *value;
+  grn_bool found = GRN_FALSE;
+
+  value = grn_ja_ref(ctx, s->specs, id, &jw, &value_len);
+  if (!value) {
+    return GRN_FALSE;
+  }
+  {
+    grn_obj v;
+    GRN_OBJ_INIT(&v, GRN_VECTOR, 0, GRN_DB_TEXT);
+    if (!grn_vector_decode(ctx, &v, value, value_len) &&
+        grn_vector_size(ctx, &v) > SERIALIZED_SPEC_INDEX_STATISTICS) {
+      const char *element;
+      unsigned int element_size;
+      element_size = grn_vector_get_element(ctx,
+                                            &v,
+                                            SERIALIZED_SPEC_INDEX_STATISTICS,
+                                            &element,
+                                            NULL,
+                                            NULL);
+      if (element_size > 0) {
+        grn_bulk_write(ctx, statistics, element, element_size);
+        found = GRN_TRUE;
+      }
+    }
+    GRN_OBJ_FIN(ctx, &v);
+  }
+  grn_ja_unref(ctx, &jw);
+  return found;
+}
+
+static void
+grn_obj_spec_save_internal(grn_ctx *ctx, grn_db_obj *obj,
+                           grn_obj *statistics)
 {
   grn_db *s;
   grn_obj v, *b;
   grn_obj_spec spec;
+  grn_obj current_statistics;
   if (obj->id & GRN_OBJ_TMP_OBJECT) { return; }
   if (!ctx->impl || !GRN_DB_OBJP(obj)) { return; }
   if (!(s = (grn_db *)ctx->impl->db) || !s->specs) { return; }
+  GRN_TEXT_INIT(&current_statistics, 0);
+  if (!statistics) {
+    /* Statistics aren't kept in memory. They are kept until they are
+       replaced or the object is removed. */
+    grn_obj_spec_get_statistics(ctx, s, obj->id, &current_statistics);
+    statistics = &current_statistics;
+  }
   GRN_OBJ_INIT(&v, GRN_VECTOR, 0, GRN_DB_TEXT);
-  if (!(b = grn_vector_body(ctx, &v))) { return; }
+  if (!(b = grn_vector_body(ctx, &v))) {
+    GRN_OBJ_FIN(ctx, &current_statistics);
+    return;
+  }
   spec.header = obj->header;
   spec.range = obj->range;
   grn_bulk_write(ctx, b, (void *)&spec, sizeof(grn_obj_spec));
@@ -7622,9 +7692,52 @@ grn_obj_spec_save(grn_ctx *ctx, grn_db_obj *obj)
     grn_expr_pack(ctx, b, (grn_obj *)obj);
     grn_vector_delimit(ctx, &v, 0, 0);
     break;
+  default :
+    /* Keeps the position of SERIALIZED_SPEC_INDEX_STATISTICS. */
+    grn_vector_delimit(ctx, &v, 0, 0);
+    break;
+  }
+  if (GRN_BULK_VSIZE(statistics) > 0) {
+    grn_bulk_write(ctx, b,
+                   GRN_BULK_HEAD(statistics), GRN_BULK_VSIZE(statistics));
+    grn_vector_delimit(ctx, &v, 0, 0);
   }
   grn_ja_putv(ctx, s->specs, obj->id, &v, 0);
   grn_obj_close(ctx, &v);
+  GRN_OBJ_FIN(ctx, &current_statistics);
+}
+
+void
+grn_obj_spec_save(grn_ctx *ctx, grn_db_obj *obj)
+{
+  grn_obj_spec_save_internal(ctx, obj, NULL);
+}
+
+grn_rc
+grn_obj_get_statistics(grn_ctx *ctx, grn_obj *obj, grn_obj *statistics)
+{
+  grn_db *s;
+
+  if (!GRN_DB_OBJP(obj) || (DB_OBJ(obj)->id & GRN_OBJ_TMP_OBJECT)) {
+    return GRN_INVALID_ARGUMENT;
+  }
+  s = (grn_db *)(DB_OBJ(obj)->db);
+  if (!s || !s->specs) {
+    return GRN_INVALID_ARGUMENT;
+  }
+  /* statistics is left empty when obj has no statistics. */
+  grn_obj_spec_get_statistics(ctx, s, DB_OBJ(obj)->id, statistics);
+  return GRN_SUCCESS;
+}
+
+grn_rc
+grn_obj_set_statistics(grn_ctx *ctx, grn_obj *obj, grn_obj *statistics)
+{
+  if (!GRN_DB_OBJP(obj) || (DB_OBJ(obj)->id & GRN_OBJ_TMP_OBJECT)) {
+    return GRN_INVALID_ARGUMENT;
+  }
+  grn_obj_spec_save_internal(ctx, DB_OBJ(obj), statistics);
+  return ctx->rc;
 }
 
 inline static grn_rc
@@ -8785,6 +8898,9 @@ grn_obj_rename(grn_ctx *ctx, grn_obj *obj, const char *name, unsigned int name_s
     grn_db *s = (grn_db *)ctx->impl->db;
     grn_obj *keys = (grn_obj *)s->keys;
     rc = grn_table_update_by_id(ctx, keys, DB_OBJ(obj)->id, name, name_size);
+    if (rc == GRN_SUCCESS) {
+      grn_expr_cache_expire(ctx);
+    }
   }
   GRN_API_RETURN(rc);
 }
@@ -8895,6 +9011,8 @@ grn_obj_register(grn_ctx *ctx, grn_obj *db, const char *name, unsigned int name_
       ERR(GRN_INVALID_ARGUMENT,
           "already used name was assigned: <%.*s>", name_size, name);
       id = GRN_ID_NIL;
+    } else {
+      grn_expr_cache_expire(ctx);
     }
   } else if (ctx->impl && ctx->impl->values) {
     id = grn_array_add(ctx, ctx->impl->values, NULL) | GRN_OBJ_TMP_OBJECT;
@@ -8916,6 +9034,8 @@ grn_obj_delete_by_id(grn_ctx *ctx, grn_obj *db, grn_id id, grn_bool removep)
     } else {
       db_value *vp;
       grn_db *s = (grn_db *)db;
+      /* Cached expressions may refer to the object. */
+      grn_expr_cache_expire(ctx);
       if ((vp = grn_tiny_array_at(&s->values, id))) {
         GRN_ASSERT(!vp->lock);
         vp->lock = 0;
@@ -8990,13 +9110,6 @@ grn_db_obj_init(grn_ctx *ctx, grn_obj *db, grn_id id, grn_db_obj *obj)
   return rc;
 }
 
-#define SERIALIZED_SPEC_INDEX_SPEC   0
-#define SERIALIZED_SPEC_INDEX_PATH   1
-#define SERIALIZED_SPEC_INDEX_SOURCE 2
-#define SERIALIZED_SPEC_INDEX_HOOK   3
-#define SERIALIZED_SPEC_INDEX_TOKEN_FILTERS 4
-#define SERIALIZED_SPEC_INDEX_EXPR   4
-
 #define GET_PATH(spec,buffer,s,id) do {\
   if (spec->header.flags & GRN_OBJ_CUSTOM_NAME) {\
     const char *path;\
@@ -10349,26 +10462,33 @@ typedef struct {
   grn_obj value;
 } sort_value_entry;
 
+/*
+  `a_keys' and `b_keys' are the same keys resolved for the tables of `a'
+  and `b'. They differ only when records of different tables are
+  compared.
+*/
 inline static int
-compare_value(grn_ctx *ctx,
-              sort_value_entry *a, sort_value_entry *b,
-              grn_table_sort_key *keys, int n_keys,
-              grn_obj *a_buffer, grn_obj *b_buffer)
+compare_value_with_keys(grn_ctx *ctx,
+                        sort_value_entry *a, grn_table_sort_key *a_keys,
+                        sort_value_entry *b, grn_table_sort_key *b_keys,
+                        int n_keys,
+                        grn_obj *a_buffer, grn_obj *b_buffer)
 {
   int i;
   uint8_t type;
   uint32_t as, bs;
   const unsigned char *ap, *bp;
-  for (i = 0; i < n_keys; i++, keys++) {
+  grn_table_sort_key *keys = a_keys;
+  for (i = 0; i < n_keys; i++, keys++, b_keys++) {
     if (i) {
       GRN_BULK_REWIND(a_buffer);
       GRN_BULK_REWIND(b_buffer);
       if (keys->flags & GRN_TABLE_SORT_DESC) {
-        grn_obj_get_value(ctx, keys->key, b->id, a_buffer);
+        grn_obj_get_value(ctx, b_keys->key, b->id, a_buffer);
         grn_obj_get_value(ctx, keys->key, a->id, b_buffer);
       } else {
         grn_obj_get_value(ctx, keys->key, a->id, a_buffer);
-        grn_obj_get_value(ctx, keys->key, b->id, b_buffer);
+        grn_obj_get_value(ctx, b_keys->key, b->id, b_buffer);
       }
       ap = (const unsigned char *)GRN_BULK_HEAD(a_buffer);
       as = GRN_BULK_VSIZE(a_buffer);
@@ -10455,6 +10575,16 @@ compare_value(grn_ctx *ctx,
   return 0;
 }
 
+inline static int
+compare_value(grn_ctx *ctx,
+              sort_value_entry *a, sort_value_entry *b,
+              grn_table_sort_key *keys, int n_keys,
+              grn_obj *a_buffer, grn_obj *b_buffer)
+{
+  return compare_value_with_keys(ctx, a, keys, b, keys, n_keys,
+                                 a_buffer, b_buffer);
+}
+
 inline static void
 swap_value(sort_value_entry *a, sort_value_entry *b)
 {
@@ -10651,6 +10781,80 @@ range_is_idp(grn_obj *obj)
   return 0;
 }
 
+static grn_rc
+grn_table_sort_key_set_type(grn_ctx *ctx, grn_table_sort_key *kp)
+{
+  if (range_is_idp(kp->key)) {
+    kp->offset = KEY_ID;
+  } else {
+    grn_obj *range = grn_ctx_at(ctx, grn_obj_get_range(ctx, kp->key));
+    if (range->header.type == GRN_TYPE) {
+      if (range->header.flags & GRN_OBJ_KEY_VAR_SIZE) {
+        kp->offset = KEY_BULK;
+      } else {
+        uint8_t key_type = range->header.flags & GRN_OBJ_KEY_MASK;
+        switch (key_type) {
+        case GRN_OBJ_KEY_UINT :
+        case GRN_OBJ_KEY_GEO_POINT :
+          switch (GRN_TYPE_SIZE(DB_OBJ(range))) {
+          case 1 :
+            kp->offset = KEY_UINT8;
+            break;
+          case 2 :
+            kp->offset = KEY_UINT16;
+            break;
+          case 4 :
+            kp->offset = KEY_UINT32;
+            break;
+          case 8 :
+            kp->offset = KEY_UINT64;
+            break;
+          default :
+            ERR(GRN_INVALID_ARGUMENT, "unsupported uint value");
+            return ctx->rc;
+          }
+          break;
+        case GRN_OBJ_KEY_INT :
+          switch (GRN_TYPE_SIZE(DB_OBJ(range))) {
+          case 1 :
+            kp->offset = KEY_INT8;
+            break;
+          case 2 :
+            kp->offset = KEY_INT16;
+            break;
+          case 4 :
+            kp->offset = KEY_INT32;
+            break;
+          case 8 :
+            kp->offset = KEY_INT64;
+            break;
+          default :
+            ERR(GRN_INVALID_ARGUMENT, "unsupported int value");
+            return ctx->rc;
+          }
+          break;
+        case GRN_OBJ_KEY_FLOAT :
+          switch (GRN_TYPE_SIZE(DB_OBJ(range))) {
+          case 4 :
+            kp->offset = KEY_FLOAT32;
+            break;
+          case 8 :
+            kp->offset = KEY_FLOAT64;
+            break;
+          default :
+            ERR(GRN_INVALID_ARGUMENT, "unsupported float value");
+            return ctx->rc;
+          }
+          break;
+        }
+      }
+    } else {
+      kp->offset = KEY_UINT32;
+    }
+  }
+  return GRN_SUCCESS;
+}
+
 int
 grn_table_sort(grn_ctx *ctx, grn_obj *table, int offset, int limit,
                grn_obj *result, grn_table_sort_key *keys, int n_keys)
@@ -10723,76 +10927,11 @@ grn_table_sort(grn_ctx *ctx, grn_obj *table, int offset, int limit,
       if (is_sub_record_accessor(ctx, kp->key)) {
         have_sub_record_accessor = GRN_TRUE;
       }
-      if (range_is_idp(kp->key)) {
-        kp->offset = KEY_ID;
-      } else {
-        grn_obj *range = grn_ctx_at(ctx, grn_obj_get_range(ctx, kp->key));
-        if (range->header.type == GRN_TYPE) {
-          if (range->header.flags & GRN_OBJ_KEY_VAR_SIZE) {
-            kp->offset = KEY_BULK;
-          } else {
-            uint8_t key_type = range->header.flags & GRN_OBJ_KEY_MASK;
-            switch (key_type) {
-            case GRN_OBJ_KEY_UINT :
-            case GRN_OBJ_KEY_GEO_POINT :
-              switch (GRN_TYPE_SIZE(DB_OBJ(range))) {
-              case 1 :
-                kp->offset = KEY_UINT8;
-                break;
-              case 2 :
-                kp->offset = KEY_UINT16;
-                break;
-              case 4 :
-                kp->offset = KEY_UINT32;
-                break;
-              case 8 :
-                kp->offset = KEY_UINT64;
-                break;
-              default :
-                ERR(GRN_INVALID_ARGUMENT, "unsupported uint value");
-                goto exit;
-              }
-              break;
-            case GRN_OBJ_KEY_INT :
-              switch (GRN_TYPE_SIZE(DB_OBJ(range))) {
-              case 1 :
-                kp->offset = KEY_INT8;
-                break;
-              case 2 :
-                kp->offset = KEY_INT16;
-                break;
-              case 4 :
-                kp->offset = KEY_INT32;
-                break;
-              case 8 :
-                kp->offset = KEY_INT64;
-                break;
-              default :
-                ERR(GRN_INVALID_ARGUMENT, "unsupported int value");
-                goto exit;
-              }
-              break;
-            case GRN_OBJ_KEY_FLOAT :
-              switch (GRN_TYPE_SIZE(DB_OBJ(range))) {
-              case 4 :
-                kp->offset = KEY_FLOAT32;
-                break;
-              case 8 :
-                kp->offset = KEY_FLOAT64;
-                break;
-              default :
-                ERR(GRN_INVALID_ARGUMENT, "unsupported float value");
-                goto exit;
-              }
-              break;
-            }
-          }
-        } else {
-          if (kp->key->header.type == GRN_COLUMN_INDEX) {
-            have_index_value_get = GRN_TRUE;
-          }
-          kp->offset = KEY_UINT32;
-        }
+      if (kp->key->header.type == GRN_COLUMN_INDEX) {
+        have_index_value_get = GRN_TRUE;
+      }
+      if (grn_table_sort_key_set_type(ctx, kp) != GRN_SUCCESS) {
+        goto exit;
       }
     }
     if (have_compressed_column ||
@@ -10809,6 +10948,231 @@ exit :
   GRN_API_RETURN(i);
 }
 
+typedef struct {
+  int index;
+  grn_obj *sorted_table;
+  grn_table_sort_key *keys;
+  grn_id position;
+  grn_id n_records;
+  sort_value_entry entry;
+} sort_merge_cursor;
+
+static grn_bool
+sort_merge_cursor_next(grn_ctx *ctx, sort_merge_cursor *cursor)
+{
+  grn_id *id;
+
+  if (cursor->position == cursor->n_records) {
+    return GRN_FALSE;
+  }
+  cursor->position++;
+  id = _grn_array_get_value(ctx, (grn_array *)(cursor->sorted_table),
+                            cursor->position);
+  if (!id) {
+    return GRN_FALSE;
+  }
+  cursor->entry.id = *id;
+  GRN_BULK_REWIND(&(cursor->entry.value));
+  grn_obj_get_value(ctx, cursor->keys[0].key, cursor->entry.id,
+                    &(cursor->entry.value));
+  return GRN_TRUE;
+}
+
+/* Records of earlier tables win ties so that merging keeps the order of
+   the tables like concatenating them. */
+inline static grn_bool
+sort_merge_cursor_less(grn_ctx *ctx,
+                       sort_merge_cursor *a, sort_merge_cursor *b,
+                       int n_keys, grn_obj *a_buffer, grn_obj *b_buffer)
+{
+  if (compare_value_with_keys(ctx,
+                              &(a->entry), a->keys,
+                              &(b->entry), b->keys,
+                              n_keys, a_buffer, b_buffer)) {
+    return GRN_FALSE;
+  }
+  if (compare_value_with_keys(ctx,
+                              &(b->entry), b->keys,
+                              &(a->entry), a->keys,
+                              n_keys, a_buffer, b_buffer)) {
+    return GRN_TRUE;
+  }
+  return a->index < b->index;
+}
+
+static void
+sort_merge_heap_down(grn_ctx *ctx, sort_merge_cursor **heap, int n, int i,
+                     int n_keys, grn_obj *a_buffer, grn_obj *b_buffer)
+{
+  for (;;) {
+    int smallest = i;
+    int left = i * 2 + 1;
+    int right = left + 1;
+    sort_merge_cursor *cursor;
+    if (left < n &&
+        sort_merge_cursor_less(ctx, heap[left], heap[smallest],
+                               n_keys, a_buffer, b_buffer)) {
+      smallest = left;
+    }
+    if (right < n &&
+        sort_merge_cursor_less(ctx, heap[right], heap[smallest],
+                               n_keys, a_buffer, b_buffer)) {
+      smallest = right;
+    }
+    if (smallest == i) {
+      break;
+    }
+    cursor = heap[i];
+    heap[i] = heap[smallest];
+    heap[smallest] = cursor;
+    i = smallest;
+  }
+}
+
+/*
+  Merges arrays sorted by grn_table_sort() with the same keys.
+  `keys_list[i]' is the keys resolved for the table that is sorted into
+  `sorted_tables[i]'. It only reads the records in [offset, offset +
+  limit) of the merged order, so each sorted table needs to have only
+  its first `offset + limit' records.
+
+  The merged order is stored into `runs' (a UInt32 vector) as
+  (index of sorted table, offset in the sorted table, the number of
+  records) triples. Consecutive records from the same sorted table are
+  stored as one triple.
+*/
+grn_rc
+grn_table_sort_merge(grn_ctx *ctx,
+                     grn_obj **sorted_tables,
+                     grn_table_sort_key **keys_list,
+                     int n_tables, int n_keys,
+                     int offset, int limit,
+                     grn_obj *runs)
+{
+  sort_merge_cursor *cursors = NULL;
+  sort_merge_cursor **heap = NULL;
+  grn_obj a_buffer;
+  grn_obj b_buffer;
+  int i, j, n_heap = 0;
+  int n_read = 0;
+  int last_index = -1;
+  uint32_t last_position = 0;
+  uint32_t run_offset = 0;
+  uint32_t run_size = 0;
+
+  GRN_API_ENTER;
+
+  GRN_TEXT_INIT(&a_buffer, 0);
+  GRN_TEXT_INIT(&b_buffer, 0);
+
+  if (n_tables <= 0 || n_keys <= 0 || offset < 0 || limit < 0) {
+    ERR(GRN_INVALID_ARGUMENT,
+        "[table][sort][merge] invalid argument: "
+        "n_tables:<%d> n_keys:<%d> offset:<%d> limit:<%d>",
+        n_tables, n_keys, offset, limit);
+    goto exit;
+  }
+
+  for (i = 0; i < n_tables; i++) {
+    if (!(sorted_tables[i] &&
+          sorted_tables[i]->header.type == GRN_TABLE_NO_KEY)) {
+      ERR(GRN_INVALID_ARGUMENT,
+          "[table][sort][merge] sorted table must be an array: <%d>", i);
+      goto exit;
+    }
+    for (j = 0; j < n_keys; j++) {
+      grn_table_sort_key *key = &(keys_list[i][j]);
+      if (key->flags & GRN_TABLE_SORT_GEO) {
+        ERR(GRN_INVALID_ARGUMENT,
+            "[table][sort][merge] geo sort key isn't supported");
+        goto exit;
+      }
+      if (grn_table_sort_key_set_type(ctx, key) != GRN_SUCCESS) {
+        goto exit;
+      }
+      /* IDs are compared as values because records of different tables
+         are compared. */
+      if (key->offset == KEY_ID) {
+        key->offset = KEY_UINT32;
+      }
+      if (i > 0 && key->offset != keys_list[0][j].offset) {
+        ERR(GRN_INVALID_ARGUMENT,
+            "[table][sort][merge] sort key types are different: <%d>", j);
+        goto exit;
+      }
+    }
+  }
+
+  heap = GRN_MALLOCN(sort_merge_cursor *, n_tables);
+  if (heap) {
+    cursors = GRN_MALLOCN(sort_merge_cursor, n_tables);
+  }
+  if (!cursors) {
+    ERR(GRN_NO_MEMORY_AVAILABLE,
+        "[table][sort][merge] failed to allocate cursors");
+    goto exit;
+  }
+  for (i = 0; i < n_tables; i++) {
+    sort_merge_cursor *cursor = cursors + i;
+    cursor->index = i;
+    cursor->sorted_table = sorted_tables[i];
+    cursor->keys = keys_list[i];
+    cursor->position = GRN_ID_NIL;
+    cursor->n_records = grn_table_size(ctx, sorted_tables[i]);
+    GRN_TEXT_INIT(&(cursor->entry.value), 0);
+    if (sort_merge_cursor_next(ctx, cursor)) {
+      heap[n_heap++] = cursor;
+    }
+  }
+  for (i = n_heap / 2 - 1; i >= 0; i--) {
+    sort_merge_heap_down(ctx, heap, n_heap, i, n_keys, &a_buffer, &b_buffer);
+  }
+
+  while (n_heap > 0 && n_read < offset + limit) {
+    sort_merge_cursor *cursor = heap[0];
+    if (n_read >= offset) {
+      if (cursor->index == last_index &&
+          cursor->position == last_position + 1) {
+        run_size++;
+      } else {
+        if (run_size > 0) {
+          GRN_UINT32_PUT(ctx, runs, last_index);
+          GRN_UINT32_PUT(ctx, runs, run_offset);
+          GRN_UINT32_PUT(ctx, runs, run_size);
+        }
+        last_index = cursor->index;
+        run_offset = cursor->position - 1;
+        run_size = 1;
+      }
+      last_position = cursor->position;
+    }
+    n_read++;
+    if (!sort_merge_cursor_next(ctx, cursor)) {
+      heap[0] = heap[--n_heap];
+    }
+    sort_merge_heap_down(ctx, heap, n_heap, 0, n_keys, &a_buffer, &b_buffer);
+  }
+  if (run_size > 0) {
+    GRN_UINT32_PUT(ctx, runs, last_index);
+    GRN_UINT32_PUT(ctx, runs, run_offset);
+    GRN_UINT32_PUT(ctx, runs, run_size);
+  }
+
+exit :
+  if (cursors) {
+    for (i = 0; i < n_tables; i++) {
+      GRN_OBJ_FIN(ctx, &(cursors[i].entry.value));
+    }
+    GRN_FREE(cursors);
+  }
+  if (heap) {
+    GRN_FREE(heap);
+  }
+  GRN_OBJ_FIN(ctx, &a_buffer);
+  GRN_OBJ_FIN(ctx, &b_buffer);
+  GRN_API_RETURN(ctx->rc);
+}
+
 static grn_obj *
 deftype(grn_ctx *ctx, const char *name,
         grn_obj_flags flags,  unsigned int size)
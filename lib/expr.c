@@ -23,10 +23,45 @@
 #include "grn_geo.h"
 #include "grn_expr.h"
 #include "grn_expr_code.h"
+#include "grn_expr_program.h"
+#include "grn_statistics.h"
 #include "grn_util.h"
 #include "grn_mrb.h"
 #include "mrb/mrb_expr.h"
 
+#include <stdlib.h>
+
+static grn_bool grn_table_select_reorder_enabled = GRN_TRUE;
+static double grn_table_select_too_many_index_match_ratio = 0.01;
+
+void
+grn_expr_init_from_env(void)
+{
+  {
+    char grn_table_select_reorder_enabled_env[GRN_ENV_BUFFER_SIZE];
+    grn_getenv("GRN_TABLE_SELECT_REORDER_ENABLED",
+               grn_table_select_reorder_enabled_env,
+               GRN_ENV_BUFFER_SIZE);
+    if (grn_table_select_reorder_enabled_env[0] &&
+        strcmp(grn_table_select_reorder_enabled_env, "no") == 0) {
+      grn_table_select_reorder_enabled = GRN_FALSE;
+    } else {
+      grn_table_select_reorder_enabled = GRN_TRUE;
+    }
+  }
+
+  {
+    char grn_table_select_too_many_index_match_ratio_env[GRN_ENV_BUFFER_SIZE];
+    grn_getenv("GRN_TABLE_SELECT_TOO_MANY_INDEX_MATCH_RATIO",
+               grn_table_select_too_many_index_match_ratio_env,
+               GRN_ENV_BUFFER_SIZE);
+    if (grn_table_select_too_many_index_match_ratio_env[0]) {
+      grn_table_select_too_many_index_match_ratio =
+        atof(grn_table_select_too_many_index_match_ratio_env);
+    }
+  }
+}
+
 grn_obj *
 grn_expr_alloc(grn_ctx *ctx, grn_obj *expr, grn_id domain, grn_obj_flags flags)
 {
@@ -401,6 +436,34 @@ grn_expr_take_obj(grn_ctx *ctx, grn_obj *expr, grn_obj *obj)
   GRN_PTR_PUT(ctx, &(e->objs), obj);
 }
 
+/*
+  Unlinks persistent objects owned by `expr' now. They are alive while
+  the database is opened, so `expr' doesn't need to refer them on
+  close. It's for expressions that may be closed after the objects are
+  removed.
+*/
+void
+grn_expr_unlink_persistent_objs(grn_ctx *ctx, grn_obj *expr)
+{
+  grn_expr *e = (grn_expr *)expr;
+  grn_obj **objs = (grn_obj **)GRN_BULK_HEAD(&(e->objs));
+  unsigned int i, n_objs, n_rest_objs = 0;
+
+  n_objs = GRN_BULK_VSIZE(&(e->objs)) / sizeof(grn_obj *);
+  for (i = 0; i < n_objs; i++) {
+    grn_obj *obj = objs[i];
+    if (obj && GRN_DB_OBJP(obj) &&
+        !(DB_OBJ(obj)->id & GRN_OBJ_TMP_OBJECT) &&
+        DB_OBJ(obj)->id != GRN_ID_NIL) {
+      grn_obj_unlink(ctx, obj);
+    } else {
+      objs[n_rest_objs++] = obj;
+    }
+  }
+  GRN_BULK_REWIND(&(e->objs));
+  GRN_BULK_INCR_LEN(&(e->objs), n_rest_objs * sizeof(grn_obj *));
+}
+
 /* data flow info */
 typedef struct {
   grn_expr_code *code;
@@ -3606,6 +3669,8 @@ struct _grn_scan_info {
   grn_obj scorers;
   grn_obj scorer_args_exprs;
   grn_obj scorer_args_expr_offsets;
+  /* the estimated number of matched records or -1 if it's unknown */
+  int64_t estimated_size;
 };
 
 #define SI_FREE(si) do {\
@@ -3632,6 +3697,7 @@ struct _grn_scan_info {
   (si)->max_interval = DEFAULT_MAX_INTERVAL;\
   (si)->similarity_threshold = DEFAULT_SIMILARITY_THRESHOLD;\
   (si)->start = (st);\
+  (si)->estimated_size = -1;\
   GRN_PTR_INIT(&(si)->scorers, GRN_OBJ_VECTOR, GRN_ID_NIL);\
   GRN_PTR_INIT(&(si)->scorer_args_exprs, GRN_OBJ_VECTOR, GRN_ID_NIL);\
   GRN_UINT32_INIT(&(si)->scorer_args_expr_offsets, GRN_OBJ_VECTOR);\
@@ -3937,6 +4003,7 @@ grn_scan_info_open(grn_ctx *ctx, int start)
   si->max_interval = DEFAULT_MAX_INTERVAL;
   si->similarity_threshold = DEFAULT_SIMILARITY_THRESHOLD;
   si->start = start;
+  si->estimated_size = -1;
   GRN_PTR_INIT(&si->scorers, GRN_OBJ_VECTOR, GRN_ID_NIL);
   GRN_PTR_INIT(&si->scorer_args_exprs, GRN_OBJ_VECTOR, GRN_ID_NIL);
   GRN_UINT32_INIT(&si->scorer_args_expr_offsets, GRN_OBJ_VECTOR);
@@ -4663,6 +4730,12 @@ grn_inspect_scan_info_list(grn_ctx *ctx, grn_obj *buffer, scan_info **sis, int n
 
     grn_text_printf(ctx, buffer,
                     "  expr:       <%d..%d>\n", si->start, si->end);
+
+    if (si->estimated_size >= 0) {
+      grn_text_printf(ctx, buffer,
+                      "  estimated:  <%" GRN_FMT_INT64D ">\n",
+                      si->estimated_size);
+    }
   }
 }
 
@@ -4702,6 +4775,355 @@ exec_result_to_score(grn_ctx *ctx, grn_obj *result, grn_obj *score_buffer)
   }
 }
 
+/*
+  Zone filter: conditions such as `column < constant' that are ANDed at
+  the top level of the expression. When the zone map of the column says
+  that no record in a block satisfies one of them, the expression is
+  false for all records in the block and they aren't evaluated.
+*/
+#define GRN_ZONE_FILTER_MAX_N_CONDITIONS 32
+#define GRN_ZONE_FILTER_MAX_STACK_DEPTH  32
+
+typedef struct {
+  grn_ra *column;
+  grn_operator op;
+  grn_ra_zone_value value;
+} grn_zone_filter_condition;
+
+typedef struct {
+  grn_zone_filter_condition conditions[GRN_ZONE_FILTER_MAX_N_CONDITIONS];
+  int n_conditions;
+  grn_bool have_last_block;
+  uint32_t last_block;
+  grn_bool last_block_may_match;
+} grn_zone_filter;
+
+typedef enum {
+  GRN_ZONE_FILTER_ITEM_COLUMN,
+  GRN_ZONE_FILTER_ITEM_CONSTANT,
+  GRN_ZONE_FILTER_ITEM_OTHER
+} grn_zone_filter_item_type;
+
+typedef struct {
+  grn_zone_filter_item_type type;
+  grn_obj *value;
+  /* conditions that are ANDed in this item */
+  uint32_t conditions;
+} grn_zone_filter_item;
+
+static grn_operator
+grn_zone_filter_flip_operator(grn_operator op)
+{
+  switch (op) {
+  case GRN_OP_LESS :
+    return GRN_OP_GREATER;
+  case GRN_OP_LESS_EQUAL :
+    return GRN_OP_GREATER_EQUAL;
+  case GRN_OP_GREATER :
+    return GRN_OP_LESS;
+  case GRN_OP_GREATER_EQUAL :
+    return GRN_OP_LESS_EQUAL;
+  default :
+    return op;
+  }
+}
+
+static uint32_t
+grn_zone_filter_add_condition(grn_ctx *ctx, grn_zone_filter *filter,
+                              grn_operator op,
+                              grn_zone_filter_item *x,
+                              grn_zone_filter_item *y)
+{
+  grn_zone_filter_condition *condition;
+  grn_obj *constant;
+
+  switch (op) {
+  case GRN_OP_EQUAL :
+  case GRN_OP_LESS :
+  case GRN_OP_LESS_EQUAL :
+  case GRN_OP_GREATER :
+  case GRN_OP_GREATER_EQUAL :
+    break;
+  default :
+    return 0;
+  }
+
+  if (filter->n_conditions == GRN_ZONE_FILTER_MAX_N_CONDITIONS) {
+    return 0;
+  }
+  condition = filter->conditions + filter->n_conditions;
+
+  if (x->type == GRN_ZONE_FILTER_ITEM_COLUMN &&
+      y->type == GRN_ZONE_FILTER_ITEM_CONSTANT) {
+    condition->column = (grn_ra *)(x->value);
+    condition->op = op;
+    constant = y->value;
+  } else if (x->type == GRN_ZONE_FILTER_ITEM_CONSTANT &&
+             y->type == GRN_ZONE_FILTER_ITEM_COLUMN) {
+    /* Texts on the left hand side aren't compared as Time. */
+    if (GRN_DB_SHORT_TEXT <= x->value->header.domain &&
+        x->value->header.domain <= GRN_DB_LONG_TEXT) {
+      return 0;
+    }
+    condition->column = (grn_ra *)(y->value);
+    condition->op = grn_zone_filter_flip_operator(op);
+    constant = x->value;
+  } else {
+    return 0;
+  }
+
+  if (!grn_ra_zone_map_value_from_bulk(ctx, condition->column, constant,
+                                       &(condition->value))) {
+    return 0;
+  }
+
+  return 1 << (filter->n_conditions++);
+}
+
+static void
+grn_zone_filter_init(grn_ctx *ctx, grn_zone_filter *filter,
+                     grn_obj *table, grn_obj *expr)
+{
+  grn_expr *e = (grn_expr *)expr;
+  grn_expr_code *code, *codes_end;
+  grn_zone_filter_item stack[GRN_ZONE_FILTER_MAX_STACK_DEPTH];
+  int depth = 0;
+  grn_id table_id = DB_OBJ(table)->id;
+  int i, n_conditions;
+
+  filter->n_conditions = 0;
+  filter->have_last_block = GRN_FALSE;
+
+  codes_end = e->codes + e->codes_curr;
+  for (code = e->codes; code < codes_end; code++) {
+    grn_zone_filter_item *item;
+
+    switch (code->op) {
+    case GRN_OP_GET_VALUE :
+    case GRN_OP_PUSH :
+      if (depth == GRN_ZONE_FILTER_MAX_STACK_DEPTH) {
+        goto exit;
+      }
+      item = stack + depth++;
+      item->type = GRN_ZONE_FILTER_ITEM_OTHER;
+      item->value = code->value;
+      item->conditions = 0;
+      if (!code->value) {
+        break;
+      }
+      if (code->op == GRN_OP_GET_VALUE) {
+        if (code->value->header.type == GRN_COLUMN_FIX_SIZE &&
+            code->value->header.domain == table_id &&
+            grn_ra_have_zone_map(ctx, (grn_ra *)(code->value))) {
+          item->type = GRN_ZONE_FILTER_ITEM_COLUMN;
+        }
+      } else {
+        if (code->value->header.type == GRN_BULK) {
+          item->type = GRN_ZONE_FILTER_ITEM_CONSTANT;
+        }
+      }
+      break;
+    case GRN_OP_JUMP :
+    case GRN_OP_CJUMP :
+      goto exit;
+    default :
+      if (code->nargs < 1 || depth < code->nargs) {
+        goto exit;
+      }
+      depth -= code->nargs;
+      item = stack + depth;
+      if (code->nargs != 2) {
+        item->conditions = 0;
+      } else if (code->op == GRN_OP_AND) {
+        item->conditions |= item[1].conditions;
+      } else {
+        item->conditions =
+          grn_zone_filter_add_condition(ctx, filter, code->op,
+                                        item, item + 1);
+      }
+      item->type = GRN_ZONE_FILTER_ITEM_OTHER;
+      item->value = NULL;
+      depth++;
+      break;
+    }
+  }
+
+  if (depth != 1) {
+    goto exit;
+  }
+
+  n_conditions = 0;
+  for (i = 0; i < filter->n_conditions; i++) {
+    if (stack[0].conditions & (1 << i)) {
+      filter->conditions[n_conditions++] = filter->conditions[i];
+    }
+  }
+  filter->n_conditions = n_conditions;
+  return;
+
+exit :
+  filter->n_conditions = 0;
+}
+
+static grn_bool
+grn_zone_filter_may_match(grn_ctx *ctx, grn_zone_filter *filter, grn_id id)
+{
+  uint32_t block = id >> GRN_RA_ZONE_MAP_W_BLOCK;
+  int i;
+
+  if (filter->have_last_block && filter->last_block == block) {
+    return filter->last_block_may_match;
+  }
+
+  filter->have_last_block = GRN_TRUE;
+  filter->last_block = block;
+  filter->last_block_may_match = GRN_TRUE;
+  for (i = 0; i < filter->n_conditions; i++) {
+    grn_zone_filter_condition *condition = filter->conditions + i;
+    if (!grn_ra_zone_map_may_match(ctx, condition->column, id,
+                                   condition->op, &(condition->value))) {
+      filter->last_block_may_match = GRN_FALSE;
+      break;
+    }
+  }
+  return filter->last_block_may_match;
+}
+
+/*
+  Evaluates a compiled condition for GRN_EXPR_PROGRAM_BATCH_SIZE records
+  at a time and applies the results to res in bulk.
+*/
+static void
+grn_table_select_sequential_batch_apply(grn_ctx *ctx, grn_obj *res,
+                                        grn_operator op,
+                                        grn_expr_program *program,
+                                        const grn_id *ids,
+                                        const grn_id *result_ids,
+                                        int n_ids,
+                                        grn_bool *matched)
+{
+  grn_hash *s = (grn_hash *)res;
+  int i, n_matched;
+
+  n_matched = grn_expr_program_exec_batch(ctx, program, ids, n_ids, matched);
+  switch (op) {
+  case GRN_OP_OR :
+    if (n_matched == 0) {
+      break;
+    }
+    for (i = 0; i < n_ids; i++) {
+      grn_rset_recinfo *ri;
+      if (!matched[i]) {
+        continue;
+      }
+      if (grn_hash_add(ctx, s, &(ids[i]), s->key_size, (void **)&ri, NULL)) {
+        grn_table_add_subrec(res, ri, 1, (grn_rset_posinfo *)&(ids[i]), 1);
+      }
+    }
+    break;
+  case GRN_OP_AND :
+  case GRN_OP_ADJUST :
+    for (i = 0; i < n_ids; i++) {
+      if (matched[i]) {
+        grn_rset_recinfo *ri;
+        uint32_t value_size;
+        ri = (grn_rset_recinfo *)grn_hash_get_value_(ctx, s, result_ids[i],
+                                                     &value_size);
+        if (ri) {
+          grn_table_add_subrec(res, ri, 1, (grn_rset_posinfo *)&(ids[i]), 1);
+        }
+      } else if (op == GRN_OP_AND) {
+        grn_hash_delete_by_id(ctx, s, result_ids[i], NULL);
+      }
+    }
+    break;
+  case GRN_OP_AND_NOT :
+    if (n_matched == 0) {
+      break;
+    }
+    for (i = 0; i < n_ids; i++) {
+      if (matched[i]) {
+        grn_hash_delete_by_id(ctx, s, result_ids[i], NULL);
+      }
+    }
+    break;
+  default :
+    break;
+  }
+}
+
+static void
+grn_table_select_sequential_batch(grn_ctx *ctx, grn_obj *table,
+                                  grn_expr_program *program,
+                                  grn_zone_filter *zone_filter,
+                                  grn_obj *res, grn_operator op)
+{
+  grn_id ids[GRN_EXPR_PROGRAM_BATCH_SIZE];
+  grn_id result_ids[GRN_EXPR_PROGRAM_BATCH_SIZE];
+  grn_bool matched[GRN_EXPR_PROGRAM_BATCH_SIZE];
+  int n_ids = 0;
+  grn_id id, result_id, *idp;
+  grn_table_cursor *tc;
+  grn_hash_cursor *hc;
+  grn_hash *s = (grn_hash *)res;
+
+  switch (op) {
+  case GRN_OP_OR :
+    if ((tc = grn_table_cursor_open(ctx, table, NULL, 0, NULL, 0, 0, -1, 0))) {
+      while ((id = grn_table_cursor_next(ctx, tc))) {
+        if (zone_filter->n_conditions > 0 &&
+            !grn_zone_filter_may_match(ctx, zone_filter, id)) {
+          continue;
+        }
+        ids[n_ids++] = id;
+        if (n_ids == GRN_EXPR_PROGRAM_BATCH_SIZE) {
+          grn_table_select_sequential_batch_apply(ctx, res, op, program,
+                                                  ids, NULL, n_ids, matched);
+          n_ids = 0;
+        }
+      }
+      grn_table_cursor_close(ctx, tc);
+    }
+    break;
+  case GRN_OP_AND :
+  case GRN_OP_AND_NOT :
+  case GRN_OP_ADJUST :
+    /* Records are deleted after the cursor passes them. It's safe
+       because the cursor skips deleted entries by their IDs. */
+    if ((hc = grn_hash_cursor_open(ctx, s, NULL, 0, NULL, 0, 0, -1, 0))) {
+      while ((result_id = grn_hash_cursor_next(ctx, hc))) {
+        grn_hash_cursor_get_key(ctx, hc, (void **)&idp);
+        if (op != GRN_OP_ADJUST &&
+            zone_filter->n_conditions > 0 &&
+            !grn_zone_filter_may_match(ctx, zone_filter, *idp)) {
+          if (op == GRN_OP_AND) {
+            grn_hash_cursor_delete(ctx, hc, NULL);
+          }
+          continue;
+        }
+        ids[n_ids] = *idp;
+        result_ids[n_ids] = result_id;
+        n_ids++;
+        if (n_ids == GRN_EXPR_PROGRAM_BATCH_SIZE) {
+          grn_table_select_sequential_batch_apply(ctx, res, op, program,
+                                                  ids, result_ids, n_ids,
+                                                  matched);
+          n_ids = 0;
+        }
+      }
+      grn_hash_cursor_close(ctx, hc);
+    }
+    break;
+  default :
+    return;
+  }
+
+  if (n_ids > 0) {
+    grn_table_select_sequential_batch_apply(ctx, res, op, program,
+                                            ids, result_ids, n_ids, matched);
+  }
+}
+
 static void
 grn_table_select_sequential(grn_ctx *ctx, grn_obj *table, grn_obj *expr,
                             grn_obj *v, grn_obj *res, grn_operator op)
@@ -4713,12 +5135,26 @@ grn_table_select_sequential(grn_ctx *ctx, grn_obj *table, grn_obj *expr,
   grn_hash *s = (grn_hash *)res;
   grn_obj *r;
   grn_obj score_buffer;
+  grn_zone_filter zone_filter;
+  grn_expr_program *program;
+  grn_zone_filter_init(ctx, &zone_filter, table, expr);
+  program = grn_expr_program_open(ctx, table, expr);
+  if (program) {
+    grn_table_select_sequential_batch(ctx, table, program, &zone_filter,
+                                      res, op);
+    grn_expr_program_close(ctx, program);
+    return;
+  }
   GRN_RECORD_INIT(v, 0, grn_obj_id(ctx, table));
   GRN_INT32_INIT(&score_buffer, 0);
   switch (op) {
   case GRN_OP_OR :
     if ((tc = grn_table_cursor_open(ctx, table, NULL, 0, NULL, 0, 0, -1, 0))) {
       while ((id = grn_table_cursor_next(ctx, tc))) {
+        if (zone_filter.n_conditions > 0 &&
+            !grn_zone_filter_may_match(ctx, &zone_filter, id)) {
+          continue;
+        }
         GRN_RECORD_SET(ctx, v, id);
         r = grn_expr_exec(ctx, expr, 0);
         if (ctx->rc) {
@@ -4739,6 +5175,11 @@ grn_table_select_sequential(grn_ctx *ctx, grn_obj *table, grn_obj *expr,
     if ((hc = grn_hash_cursor_open(ctx, s, NULL, 0, NULL, 0, 0, -1, 0))) {
       while (grn_hash_cursor_next(ctx, hc)) {
         grn_hash_cursor_get_key(ctx, hc, (void **) &idp);
+        if (zone_filter.n_conditions > 0 &&
+            !grn_zone_filter_may_match(ctx, &zone_filter, *idp)) {
+          grn_hash_cursor_delete(ctx, hc, NULL);
+          continue;
+        }
         GRN_RECORD_SET(ctx, v, *idp);
         r = grn_expr_exec(ctx, expr, 0);
         if (ctx->rc) {
@@ -4760,6 +5201,10 @@ grn_table_select_sequential(grn_ctx *ctx, grn_obj *table, grn_obj *expr,
     if ((hc = grn_hash_cursor_open(ctx, s, NULL, 0, NULL, 0, 0, -1, 0))) {
       while (grn_hash_cursor_next(ctx, hc)) {
         grn_hash_cursor_get_key(ctx, hc, (void **) &idp);
+        if (zone_filter.n_conditions > 0 &&
+            !grn_zone_filter_may_match(ctx, &zone_filter, *idp)) {
+          continue;
+        }
         GRN_RECORD_SET(ctx, v, *idp);
         r = grn_expr_exec(ctx, expr, 0);
         if (ctx->rc) {
@@ -5449,6 +5894,581 @@ grn_table_select_index(grn_ctx *ctx, grn_obj *table, scan_info *si,
   return processed;
 }
 
+static grn_bool
+scan_info_estimate_range_by_statistics(grn_ctx *ctx, grn_obj *column,
+                                       grn_operator op, grn_obj *value,
+                                       int64_t *size)
+{
+  switch (op) {
+  case GRN_OP_LESS :
+    return grn_statistics_estimate_range(ctx, column,
+                                         NULL, GRN_FALSE,
+                                         value, GRN_FALSE,
+                                         size);
+  case GRN_OP_LESS_EQUAL :
+    return grn_statistics_estimate_range(ctx, column,
+                                         NULL, GRN_FALSE,
+                                         value, GRN_TRUE,
+                                         size);
+  case GRN_OP_GREATER :
+    return grn_statistics_estimate_range(ctx, column,
+                                         value, GRN_FALSE,
+                                         NULL, GRN_FALSE,
+                                         size);
+  case GRN_OP_GREATER_EQUAL :
+    return grn_statistics_estimate_range(ctx, column,
+                                         value, GRN_TRUE,
+                                         NULL, GRN_FALSE,
+                                         size);
+  default :
+    return GRN_FALSE;
+  }
+}
+
+static grn_bool
+scan_info_is_between_border_include(grn_ctx *ctx, grn_obj *border)
+{
+  return (border->header.domain == GRN_DB_TEXT &&
+          GRN_TEXT_LEN(border) == strlen("include") &&
+          memcmp(GRN_TEXT_VALUE(border), "include", strlen("include")) == 0);
+}
+
+/* Estimates the size of a condition on a column by its statistics. */
+static int64_t
+scan_info_estimate_size_by_statistics(grn_ctx *ctx, scan_info *si)
+{
+  grn_obj *column;
+  int64_t size = -1;
+
+  if (si->op == GRN_OP_CALL) {
+    char name[GRN_TABLE_MAX_KEY_SIZE];
+    int name_size;
+    if (si->nargs < 3) {
+      return -1;
+    }
+    column = si->args[1];
+    if (!grn_obj_is_function_proc(ctx, si->args[0]) &&
+        !grn_obj_is_selector_proc(ctx, si->args[0])) {
+      return -1;
+    }
+    name_size = grn_obj_name(ctx, si->args[0], name, GRN_TABLE_MAX_KEY_SIZE);
+    if (name_size == (int)strlen("in_values") &&
+        memcmp(name, "in_values", name_size) == 0) {
+      int i;
+      size = 0;
+      for (i = 2; i < si->nargs; i++) {
+        int64_t value_size;
+        if (!grn_statistics_estimate_equal(ctx, column, si->args[i],
+                                           &value_size)) {
+          return -1;
+        }
+        size += value_size;
+      }
+    } else if (name_size == (int)strlen("between") &&
+               memcmp(name, "between", name_size) == 0) {
+      if (si->nargs != 6) {
+        return -1;
+      }
+      if (!grn_statistics_estimate_range(
+            ctx, column,
+            si->args[2],
+            scan_info_is_between_border_include(ctx, si->args[3]),
+            si->args[4],
+            scan_info_is_between_border_include(ctx, si->args[5]),
+            &size)) {
+        return -1;
+      }
+    }
+    return size;
+  }
+
+  if (si->nargs != 2 || (si->flags & SCAN_PRE_CONST)) {
+    return -1;
+  }
+  column = si->args[0];
+  switch (column->header.type) {
+  case GRN_COLUMN_FIX_SIZE :
+  case GRN_COLUMN_VAR_SIZE :
+    break;
+  default :
+    return -1;
+  }
+
+  switch (si->op) {
+  case GRN_OP_EQUAL :
+    if (!grn_statistics_estimate_equal(ctx, column, si->args[1], &size)) {
+      return -1;
+    }
+    break;
+  case GRN_OP_NOT_EQUAL :
+    if (!grn_statistics_estimate_equal(ctx, column, si->args[1], &size)) {
+      return -1;
+    }
+    {
+      grn_obj *table = grn_ctx_at(ctx, column->header.domain);
+      int64_t table_size = table ? grn_table_size(ctx, table) : 0;
+      size = table_size > size ? table_size - size : 0;
+    }
+    break;
+  case GRN_OP_LESS :
+  case GRN_OP_GREATER :
+  case GRN_OP_LESS_EQUAL :
+  case GRN_OP_GREATER_EQUAL :
+    if (!scan_info_estimate_range_by_statistics(ctx, column,
+                                                si->op, si->args[1],
+                                                &size)) {
+      return -1;
+    }
+    break;
+  default :
+    break;
+  }
+
+  return size;
+}
+
+static int64_t
+scan_info_estimate_size_by_index(grn_ctx *ctx, scan_info *si, grn_obj *index)
+{
+  grn_ii *ii = (grn_ii *)index;
+  grn_obj *lexicon;
+  int64_t size = -1;
+
+  if (index->header.type != GRN_COLUMN_INDEX) {
+    return -1;
+  }
+
+  switch (si->op) {
+  case GRN_OP_MATCH :
+    if (GRN_TEXT_LEN(si->query) > 0 &&
+        GRN_DB_SHORT_TEXT <= si->query->header.domain &&
+        si->query->header.domain <= GRN_DB_LONG_TEXT) {
+      size = grn_ii_estimate_size_for_query(ctx, ii,
+                                            GRN_TEXT_VALUE(si->query),
+                                            GRN_TEXT_LEN(si->query),
+                                            NULL);
+    }
+    break;
+  case GRN_OP_EQUAL :
+    if (GRN_BULK_VSIZE(si->query) == 0) {
+      break;
+    }
+    lexicon = grn_ctx_at(ctx, index->header.domain);
+    if (lexicon) {
+      grn_id tid;
+      /* The same as grn_table_select_index(). */
+      if (GRN_OBJ_GET_DOMAIN(si->query) == DB_OBJ(lexicon)->id) {
+        tid = GRN_RECORD_VALUE(si->query);
+      } else {
+        tid = grn_table_get(ctx, lexicon,
+                            GRN_BULK_HEAD(si->query),
+                            GRN_BULK_VSIZE(si->query));
+      }
+      if (tid == GRN_ID_NIL) {
+        size = 0;
+      } else {
+        size = grn_ii_estimate_size(ctx, ii, tid);
+      }
+    }
+    break;
+  case GRN_OP_LESS :
+  case GRN_OP_GREATER :
+  case GRN_OP_LESS_EQUAL :
+  case GRN_OP_GREATER_EQUAL :
+    if (scan_info_estimate_range_by_statistics(ctx, index,
+                                               si->op, si->query,
+                                               &size)) {
+      break;
+    }
+    lexicon = grn_ctx_at(ctx, index->header.domain);
+    if (lexicon) {
+      grn_obj range;
+      GRN_OBJ_INIT(&range, GRN_BULK, 0, lexicon->header.domain);
+      if (grn_obj_cast(ctx, si->query, &range, GRN_FALSE) == GRN_SUCCESS) {
+        grn_table_cursor *cursor;
+        const void *min = NULL, *max = NULL;
+        unsigned int min_size = 0, max_size = 0;
+        int flags = GRN_CURSOR_ASCENDING;
+        switch (si->op) {
+        case GRN_OP_LESS :
+          flags |= GRN_CURSOR_LT;
+          max = GRN_BULK_HEAD(&range);
+          max_size = GRN_BULK_VSIZE(&range);
+          break;
+        case GRN_OP_GREATER :
+          flags |= GRN_CURSOR_GT;
+          min = GRN_BULK_HEAD(&range);
+          min_size = GRN_BULK_VSIZE(&range);
+          break;
+        case GRN_OP_LESS_EQUAL :
+          flags |= GRN_CURSOR_LE;
+          max = GRN_BULK_HEAD(&range);
+          max_size = GRN_BULK_VSIZE(&range);
+          break;
+        default :
+          flags |= GRN_CURSOR_GE;
+          min = GRN_BULK_HEAD(&range);
+          min_size = GRN_BULK_VSIZE(&range);
+          break;
+        }
+        cursor = grn_table_cursor_open(ctx, lexicon,
+                                       min, min_size, max, max_size,
+                                       0, -1, flags);
+        if (cursor) {
+          size = grn_ii_estimate_size_for_lexicon_cursor(ctx, ii, cursor);
+          grn_table_cursor_close(ctx, cursor);
+        }
+      } else {
+        ERRCLR(ctx);
+      }
+      GRN_OBJ_FIN(ctx, &range);
+    }
+    break;
+  default :
+    break;
+  }
+
+  return size;
+}
+
+/*
+  Sets si->estimated_size when si can be evaluated by its indexes or
+  its column has statistics.
+*/
+static void
+scan_info_estimate_size(grn_ctx *ctx, grn_obj *table, scan_info *si)
+{
+  grn_obj **indexes;
+  int i, n_indexes;
+  int64_t size = 0;
+  int64_t table_size;
+
+  si->estimated_size = -1;
+  if (si->flags & (SCAN_ACCESSOR | SCAN_POP)) {
+    return;
+  }
+  n_indexes = GRN_BULK_VSIZE(&(si->index)) / sizeof(grn_obj *);
+  if (n_indexes == 0 || si->op == GRN_OP_CALL) {
+    size = scan_info_estimate_size_by_statistics(ctx, si);
+    if (size < 0) {
+      return;
+    }
+  } else {
+    if (!si->query || si->query->header.type != GRN_BULK) {
+      return;
+    }
+    if (n_indexes > 1 && si->op != GRN_OP_MATCH) {
+      return;
+    }
+
+    indexes = (grn_obj **)GRN_BULK_HEAD(&(si->index));
+    for (i = 0; i < n_indexes; i++) {
+      int64_t index_size;
+      index_size = scan_info_estimate_size_by_index(ctx, si, indexes[i]);
+      if (index_size < 0) {
+        return;
+      }
+      size += index_size;
+    }
+  }
+
+  table_size = grn_table_size(ctx, table);
+  if (size > table_size) {
+    size = table_size;
+  }
+  si->estimated_size = size;
+}
+
+typedef struct {
+  /* sis[start..end) */
+  int start;
+  int end;
+  grn_operator logical_op;
+  /* the estimated size or the table size if it's unknown */
+  int64_t size;
+  /* the number of records read when the unit is evaluated first */
+  int64_t head_cost;
+  grn_bool is_group;
+} scan_info_unit;
+
+static int
+scan_info_unit_compare(scan_info_unit *unit1, scan_info_unit *unit2)
+{
+  /* Records are removed by AND_NOT after they are narrowed by AND. */
+  if (unit1->logical_op != unit2->logical_op) {
+    return unit1->logical_op == GRN_OP_AND ? -1 : 1;
+  }
+  if (unit1->size < unit2->size) {
+    return -1;
+  } else if (unit1->size > unit2->size) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+/*
+  Reorders units that are ANDed to the same result so that the most
+  selective one is evaluated first. sis[start] is the first unit of the
+  level and it is evaluated against an empty result.
+*/
+static int
+scan_info_reorder_level(grn_ctx *ctx, grn_obj *table, int64_t table_size,
+                        scan_info **sis, scan_info **buffer,
+                        int start, int end)
+{
+  grn_obj units;
+  scan_info_unit *unit_array;
+  int i, n_units, n_reordered = 0;
+
+  GRN_TEXT_INIT(&units, 0);
+  for (i = start; i < end;) {
+    scan_info_unit unit;
+    scan_info *si = sis[i];
+
+    unit.start = i;
+    if (i != start && (si->flags & SCAN_PUSH)) {
+      int depth = 0;
+      int j;
+      for (j = i; j < end; j++) {
+        if (sis[j]->flags & SCAN_PUSH) {
+          depth++;
+        } else if (sis[j]->flags & SCAN_POP) {
+          depth--;
+          if (depth == 0) {
+            break;
+          }
+        }
+      }
+      if (j == end) {
+        /* unmatched nesting level */
+        GRN_OBJ_FIN(ctx, &units);
+        return n_reordered;
+      }
+      n_reordered += scan_info_reorder_level(ctx, table, table_size,
+                                             sis, buffer, i, j);
+      unit.end = j + 1;
+      unit.logical_op = sis[j]->logical_op;
+      unit.size = table_size;
+      unit.head_cost = table_size;
+      unit.is_group = GRN_TRUE;
+    } else if (si->flags & SCAN_POP) {
+      /* unmatched nesting level */
+      GRN_OBJ_FIN(ctx, &units);
+      return n_reordered;
+    } else {
+      scan_info_estimate_size(ctx, table, si);
+      unit.end = i + 1;
+      unit.logical_op = si->logical_op;
+      unit.size = si->estimated_size >= 0 ? si->estimated_size : table_size;
+      /* A condition without index scans all records even if it's
+         selective. */
+      if (GRN_BULK_VSIZE(&(si->index)) > 0) {
+        unit.head_cost = unit.size;
+      } else {
+        unit.head_cost = table_size;
+      }
+      unit.is_group = GRN_FALSE;
+    }
+    grn_bulk_write(ctx, &units, (const char *)&unit, sizeof(scan_info_unit));
+    i = unit.end;
+  }
+
+  unit_array = (scan_info_unit *)GRN_BULK_HEAD(&units);
+  n_units = GRN_BULK_VSIZE(&units) / sizeof(scan_info_unit);
+  for (i = 0; i < n_units;) {
+    int anchor = i, run_end, j;
+    grn_bool reordered = GRN_FALSE;
+
+    for (run_end = anchor + 1; run_end < n_units; run_end++) {
+      grn_operator logical_op = unit_array[run_end].logical_op;
+      if (logical_op != GRN_OP_AND && logical_op != GRN_OP_AND_NOT) {
+        break;
+      }
+    }
+
+    if (anchor == 0 && !unit_array[anchor].is_group &&
+        unit_array[anchor].logical_op == GRN_OP_OR) {
+      /* The first unit can be exchanged with an ANDed unit because
+         both of them are evaluated against the same records. */
+      int best = -1;
+      for (j = anchor + 1; j < run_end; j++) {
+        scan_info_unit *unit = unit_array + j;
+        if (unit->is_group || unit->logical_op != GRN_OP_AND) {
+          continue;
+        }
+        if (unit->head_cost < unit_array[anchor].head_cost &&
+            (best == -1 || unit->head_cost < unit_array[best].head_cost)) {
+          best = j;
+        }
+      }
+      if (best != -1) {
+        scan_info *head = sis[unit_array[anchor].start];
+        scan_info *new_head = sis[unit_array[best].start];
+        scan_info_unit unit;
+        new_head->flags |= head->flags & SCAN_PUSH;
+        new_head->logical_op = head->logical_op;
+        head->flags &= ~SCAN_PUSH;
+        head->logical_op = GRN_OP_AND;
+        unit = unit_array[anchor];
+        unit_array[anchor] = unit_array[best];
+        unit_array[anchor].logical_op = new_head->logical_op;
+        unit_array[best] = unit;
+        unit_array[best].logical_op = GRN_OP_AND;
+        reordered = GRN_TRUE;
+      }
+    }
+
+    /* stable insertion sort */
+    for (j = anchor + 2; j < run_end; j++) {
+      scan_info_unit unit = unit_array[j];
+      int k = j;
+      while (k > anchor + 1 &&
+             scan_info_unit_compare(unit_array + k - 1, &unit) > 0) {
+        unit_array[k] = unit_array[k - 1];
+        k--;
+        reordered = GRN_TRUE;
+      }
+      unit_array[k] = unit;
+    }
+
+    if (reordered) {
+      n_reordered++;
+    }
+    i = run_end;
+  }
+
+  if (n_reordered > 0) {
+    int offset = start;
+    for (i = 0; i < n_units; i++) {
+      int n = unit_array[i].end - unit_array[i].start;
+      grn_memcpy(buffer + offset, sis + unit_array[i].start,
+                 sizeof(scan_info *) * n);
+      offset += n;
+    }
+    grn_memcpy(sis + start, buffer + start, sizeof(scan_info *) * (end - start));
+  }
+  GRN_OBJ_FIN(ctx, &units);
+
+  return n_reordered;
+}
+
+/*
+  Reorders scan infos built for a new result by their estimated sizes.
+  Conditions that are ANDed are commutative, so the most selective
+  indexed condition is evaluated first and the later conditions can
+  be evaluated against fewer records.
+*/
+static void
+scan_info_reorder(grn_ctx *ctx, grn_obj *table, scan_info **sis, int n)
+{
+  scan_info **buffer;
+
+  if (!grn_table_select_reorder_enabled) {
+    return;
+  }
+  if (n < 2) {
+    return;
+  }
+
+  buffer = GRN_MALLOCN(scan_info *, n);
+  if (!buffer) {
+    ERRCLR(ctx);
+    return;
+  }
+  scan_info_reorder_level(ctx, table, grn_table_size(ctx, table),
+                          sis, buffer, 0, n);
+  GRN_FREE(buffer);
+}
+
+/*
+  Returns whether si should be evaluated against the current result
+  instead of the index. It's faster when the result is much smaller
+  than the records matched by the index. The conditions must return
+  the same records and scores by both ways.
+*/
+static grn_bool
+scan_info_should_probe(grn_ctx *ctx, scan_info *si, grn_obj *res)
+{
+  grn_obj *index, *column, *lexicon;
+  grn_obj *tokenizer = NULL, *normalizer = NULL;
+  uint32_t n_records;
+
+  if (grn_table_select_too_many_index_match_ratio < 0.0) {
+    return GRN_FALSE;
+  }
+  if (si->logical_op != GRN_OP_AND) {
+    return GRN_FALSE;
+  }
+  if (si->flags & (SCAN_PUSH | SCAN_POP | SCAN_ACCESSOR | SCAN_PRE_CONST)) {
+    return GRN_FALSE;
+  }
+  if (si->estimated_size < 0) {
+    return GRN_FALSE;
+  }
+
+  switch (si->op) {
+  case GRN_OP_EQUAL :
+  case GRN_OP_LESS :
+  case GRN_OP_GREATER :
+  case GRN_OP_LESS_EQUAL :
+  case GRN_OP_GREATER_EQUAL :
+    break;
+  default :
+    return GRN_FALSE;
+  }
+
+  if (GRN_BULK_VSIZE(&(si->index)) != sizeof(grn_obj *)) {
+    return GRN_FALSE;
+  }
+  index = GRN_PTR_VALUE(&(si->index));
+  if (index->header.flags & GRN_OBJ_WITH_WEIGHT) {
+    return GRN_FALSE;
+  }
+
+  if (si->nargs != 2) {
+    return GRN_FALSE;
+  }
+  column = si->args[0];
+  switch (column->header.type) {
+  case GRN_COLUMN_FIX_SIZE :
+  case GRN_COLUMN_VAR_SIZE :
+    break;
+  default :
+    return GRN_FALSE;
+  }
+  if ((column->header.flags & GRN_OBJ_COLUMN_TYPE_MASK) !=
+      GRN_OBJ_COLUMN_SCALAR) {
+    return GRN_FALSE;
+  }
+
+  /* The index compares normalized keys but the column doesn't. */
+  lexicon = grn_ctx_at(ctx, index->header.domain);
+  if (!lexicon) {
+    return GRN_FALSE;
+  }
+  if (GRN_OBJ_GET_DOMAIN(si->query) != lexicon->header.domain ||
+      grn_obj_get_range(ctx, column) != lexicon->header.domain) {
+    return GRN_FALSE;
+  }
+  grn_table_get_info(ctx, lexicon, NULL, NULL, &tokenizer, &normalizer, NULL);
+  if (tokenizer || normalizer) {
+    return GRN_FALSE;
+  }
+
+  n_records = grn_table_size(ctx, res);
+  /*
+   * Same as:
+   * ((n_records / estimated_size) > too_many_index_match_ratio)
+   */
+  if (n_records > si->estimated_size *
+      grn_table_select_too_many_index_match_ratio) {
+    return GRN_FALSE;
+  }
+
+  return GRN_TRUE;
+}
+
 grn_obj *
 grn_table_select(grn_ctx *ctx, grn_obj *table, grn_obj *expr,
                  grn_obj *res, grn_operator op)
@@ -5483,6 +6503,9 @@ grn_table_select(grn_ctx *ctx, grn_obj *table, grn_obj *expr,
       grn_expr *e = (grn_expr *)expr;
       grn_expr_code *codes = e->codes;
       uint32_t codes_curr = e->codes_curr;
+      if (op == GRN_OP_OR && res_size == 0) {
+        scan_info_reorder(ctx, table, sis, n);
+      }
       GRN_PTR_INIT(&res_stack, GRN_OBJ_VECTOR, GRN_ID_NIL);
       for (i = 0; i < n; i++) {
         scan_info *si = sis[i];
@@ -5511,7 +6534,9 @@ grn_table_select(grn_ctx *ctx, grn_obj *table, grn_obj *expr,
             GRN_PTR_PUT(ctx, &res_stack, res);
             res = res_;
           }
-          processed = grn_table_select_index(ctx, table, si, res);
+          if (!scan_info_should_probe(ctx, si, res)) {
+            processed = grn_table_select_index(ctx, table, si, res);
+          }
           if (!processed) {
             if (ctx->rc) { break; }
             e->codes = codes + si->start;
@@ -5593,6 +6618,7 @@ typedef struct {
   int weight_offset;
   grn_hash *weight_set;
   snip_cond *snip_conds;
+  grn_obj *literals;
 } efs_info;
 
 typedef struct {
@@ -6095,31 +7121,115 @@ exit :
 }
 
 static grn_rc
-get_string(grn_ctx *ctx, efs_info *q, char quote)
+parse_string_literal(grn_ctx *ctx, const char *str, const char *str_end,
+                     grn_obj *value, const char **rest)
 {
   const char *s;
   unsigned int len;
+  char quote = *str;
   grn_rc rc = GRN_END_OF_DATA;
-  GRN_BULK_REWIND(&q->buf);
-  for (s = q->cur + 1; s < q->str_end; s += len) {
-    if (!(len = grn_charlen(ctx, s, q->str_end))) { break; }
+  GRN_BULK_REWIND(value);
+  for (s = str + 1; s < str_end; s += len) {
+    if (!(len = grn_charlen(ctx, s, str_end))) { break; }
     if (len == 1) {
       if (*s == quote) {
         s++;
         rc = GRN_SUCCESS;
         break;
       }
-      if (*s == GRN_QUERY_ESCAPE && s + 1 < q->str_end) {
+      if (*s == GRN_QUERY_ESCAPE && s + 1 < str_end) {
         s++;
-        if (!(len = grn_charlen(ctx, s, q->str_end))) { break; }
+        if (!(len = grn_charlen(ctx, s, str_end))) { break; }
       }
     }
-    GRN_TEXT_PUT(ctx, &q->buf, s, len);
+    GRN_TEXT_PUT(ctx, value, s, len);
   }
-  q->cur = s;
+  *rest = s;
   return rc;
 }
 
+static grn_rc
+get_string(grn_ctx *ctx, efs_info *q, char quote)
+{
+  return parse_string_literal(ctx, q->cur, q->str_end, &q->buf, &q->cur);
+}
+
+/* `str' must begin with a digit. */
+static void
+parse_number_literal(grn_ctx *ctx, const char *str, const char *str_end,
+                     grn_obj *value, const char **rest)
+{
+  int64_t int64 = grn_atoll(str, str_end, rest);
+  // checks to see grn_atoll was appropriate
+  // (NOTE: *str begins with a digit. Thus, grn_atoll parses at leaset
+  //        one char.)
+  if (str_end != *rest &&
+      (**rest == '.' || **rest == 'e' || **rest == 'E' ||
+       (**rest >= '0' && **rest <= '9'))) {
+    char *rest_float;
+    double d = strtod(str, &rest_float);
+    grn_obj_reinit(ctx, value, GRN_DB_FLOAT, 0);
+    GRN_FLOAT_SET(ctx, value, d);
+    *rest = rest_float;
+  } else {
+    const char *rest64 = *rest;
+    grn_atoui(str, str_end, rest);
+    // checks to see grn_atoi failed (see above NOTE)
+    if ((int64 > UINT32_MAX) ||
+        (str_end != *rest && **rest >= '0' && **rest <= '9')) {
+      grn_obj_reinit(ctx, value, GRN_DB_INT64, 0);
+      GRN_INT64_SET(ctx, value, int64);
+      *rest = rest64;
+    } else if (int64 > INT32_MAX || int64 < INT32_MIN) {
+      grn_obj_reinit(ctx, value, GRN_DB_INT64, 0);
+      GRN_INT64_SET(ctx, value, int64);
+    } else {
+      grn_obj_reinit(ctx, value, GRN_DB_INT32, 0);
+      GRN_INT32_SET(ctx, value, (int32_t)int64);
+    }
+  }
+}
+
+/*
+  Parses a string or number literal at `str' in the same way as the
+  script syntax. `value' is reinitialized for the literal.
+*/
+grn_rc
+grn_expr_parse_literal(grn_ctx *ctx, const char *str, const char *str_end,
+                       grn_obj *value, const char **rest)
+{
+  if (str >= str_end) {
+    return GRN_INVALID_ARGUMENT;
+  }
+  switch (*str) {
+  case '"' :
+  case '\'' :
+    grn_obj_reinit(ctx, value, GRN_DB_TEXT, 0);
+    return parse_string_literal(ctx, str, str_end, value, rest);
+  case '0' : case '1' : case '2' : case '3' : case '4' :
+  case '5' : case '6' : case '7' : case '8' : case '9' :
+    parse_number_literal(ctx, str, str_end, value, rest);
+    return GRN_SUCCESS;
+  default :
+    return GRN_INVALID_ARGUMENT;
+  }
+}
+
+static void
+parse_script_add_literal(grn_ctx *ctx, efs_info *q,
+                         const char *start, grn_obj *value)
+{
+  grn_expr_literal literal;
+
+  if (!q->literals || !value) {
+    return;
+  }
+  literal.offset = start - q->str;
+  literal.length = q->cur - start;
+  literal.value = value;
+  grn_bulk_write(ctx, q->literals, (const char *)&literal, sizeof(literal));
+}
+
 static grn_obj *
 resolve_top_level_name(grn_ctx *ctx, const char *name, unsigned int name_size)
 {
@@ -6406,14 +7516,15 @@ parse_script(grn_ctx *ctx, efs_info *q)
       grn_expr_append_op(ctx, q->e, GRN_OP_CJUMP, 0);
       break;
     case '"' :
-      if ((rc = get_string(ctx, q, '"'))) { goto exit; }
-      PARSE(GRN_EXPR_TOKEN_STRING);
-      grn_expr_append_const(ctx, q->e, &q->buf, GRN_OP_PUSH, 1);
-      break;
     case '\'' :
-      if ((rc = get_string(ctx, q, '\''))) { goto exit; }
-      PARSE(GRN_EXPR_TOKEN_STRING);
-      grn_expr_append_const(ctx, q->e, &q->buf, GRN_OP_PUSH, 1);
+      {
+        const char *start = q->cur;
+        grn_obj *value;
+        if ((rc = get_string(ctx, q, *start))) { goto exit; }
+        PARSE(GRN_EXPR_TOKEN_STRING);
+        value = grn_expr_append_const(ctx, q->e, &q->buf, GRN_OP_PUSH, 1);
+        parse_script_add_literal(ctx, q, start, value);
+      }
       break;
     case '*' :
       switch (q->cur[1]) {
@@ -6712,46 +7823,17 @@ parse_script(grn_ctx *ctx, efs_info *q)
     case '0' : case '1' : case '2' : case '3' : case '4' :
     case '5' : case '6' : case '7' : case '8' : case '9' :
       {
+        const char *start = q->cur;
         const char *rest;
-        int64_t int64 = grn_atoll(q->cur, q->str_end, &rest);
-        // checks to see grn_atoll was appropriate
-        // (NOTE: *q->cur begins with a digit. Thus, grn_atoll parses at leaset
-        //        one char.)
-        if (q->str_end != rest &&
-            (*rest == '.' || *rest == 'e' || *rest == 'E' ||
-             (*rest >= '0' && *rest <= '9'))) {
-          char *rest_float;
-          double d = strtod(q->cur, &rest_float);
-          grn_obj floatbuf;
-          GRN_FLOAT_INIT(&floatbuf, 0);
-          GRN_FLOAT_SET(ctx, &floatbuf, d);
-          grn_expr_append_const(ctx, q->e, &floatbuf, GRN_OP_PUSH, 1);
-          rest = rest_float;
-        } else {
-          const char *rest64 = rest;
-          grn_atoui(q->cur, q->str_end, &rest);
-          // checks to see grn_atoi failed (see above NOTE)
-          if ((int64 > UINT32_MAX) ||
-              (q->str_end != rest && *rest >= '0' && *rest <= '9')) {
-            grn_obj int64buf;
-            GRN_INT64_INIT(&int64buf, 0);
-            GRN_INT64_SET(ctx, &int64buf, int64);
-            grn_expr_append_const(ctx, q->e, &int64buf, GRN_OP_PUSH, 1);
-            rest = rest64;
-          } else if (int64 > INT32_MAX || int64 < INT32_MIN) {
-            grn_obj int64buf;
-            GRN_INT64_INIT(&int64buf, 0);
-            GRN_INT64_SET(ctx, &int64buf, int64);
-            grn_expr_append_const(ctx, q->e, &int64buf, GRN_OP_PUSH, 1);
-          } else {
-            grn_obj int32buf;
-            GRN_INT32_INIT(&int32buf, 0);
-            GRN_INT32_SET(ctx, &int32buf, (int32_t)int64);
-            grn_expr_append_const(ctx, q->e, &int32buf, GRN_OP_PUSH, 1);
-          }
-        }
+        grn_obj number;
+        grn_obj *value;
+        GRN_VOID_INIT(&number);
+        parse_number_literal(ctx, q->cur, q->str_end, &number, &rest);
+        value = grn_expr_append_const(ctx, q->e, &number, GRN_OP_PUSH, 1);
+        GRN_OBJ_FIN(ctx, &number);
         PARSE(GRN_EXPR_TOKEN_DECIMAL);
         q->cur = rest;
+        parse_script_add_literal(ctx, q, start, value);
       }
       break;
     default :
@@ -6772,12 +7854,32 @@ grn_expr_parse(grn_ctx *ctx, grn_obj *expr,
                const char *str, unsigned int str_size,
                grn_obj *default_column, grn_operator default_mode,
                grn_operator default_op, grn_expr_flags flags)
+{
+  return grn_expr_parse_with_literals(ctx, expr, str, str_size,
+                                      default_column, default_mode,
+                                      default_op, flags, NULL);
+}
+
+/*
+  It's the same as grn_expr_parse() but it also appends a
+  grn_expr_literal to `literals' for each string and number literal in
+  the script syntax.
+*/
+grn_rc
+grn_expr_parse_with_literals(grn_ctx *ctx, grn_obj *expr,
+                             const char *str, unsigned int str_size,
+                             grn_obj *default_column,
+                             grn_operator default_mode,
+                             grn_operator default_op,
+                             grn_expr_flags flags,
+                             grn_obj *literals)
 {
   efs_info efsi;
   if (grn_expr_parser_open(ctx)) { return ctx->rc; }
   GRN_API_ENTER;
   efsi.ctx = ctx;
   efsi.str = str;
+  efsi.literals = literals;
   if ((efsi.v = grn_expr_get_var_by_offset(ctx, expr, 0)) &&
       (efsi.table = grn_ctx_at(ctx, efsi.v->header.domain))) {
     GRN_TEXT_INIT(&efsi.buf, 0);
@@ -7074,6 +8176,14 @@ grn_expr_dump_plan(grn_ctx *ctx, grn_obj *expr, grn_obj *buffer)
   sis = scan_info_build(ctx, expr, &n, GRN_OP_OR, 0);
   if (sis) {
     int i;
+    grn_obj *variable;
+    variable = grn_expr_get_var_by_offset(ctx, expr, 0);
+    if (variable) {
+      grn_obj *table = grn_ctx_at(ctx, variable->header.domain);
+      if (table) {
+        scan_info_reorder(ctx, table, sis, n);
+      }
+    }
     grn_inspect_scan_info_list(ctx, buffer, sis, n);
     for (i = 0; i < n; i++) {
       SI_FREE(sis[i]);
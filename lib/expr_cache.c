@@ -0,0 +1,735 @@
+/* -*- c-basic-offset: 2 -*- */
+/*
+  Copyright(C) 2015 Brazil
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License version 2.1 as published by the Free Software Foundation.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "grn_expr_cache.h"
+#include "grn_ctx_impl.h"
+#include "grn_db.h"
+#include "grn_expr.h"
+#include "grn_str.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* It never appears in valid expressions. */
+#define GRN_EXPR_CACHE_PLACEHOLDER '\x01'
+
+typedef struct {
+  grn_obj *value;
+  /* the domain of the literal before the parser casts it */
+  grn_id literal_domain;
+} grn_expr_cache_literal;
+
+typedef struct _grn_expr_cache_entry grn_expr_cache_entry;
+
+struct _grn_expr_cache_entry {
+  grn_expr_cache_entry *next;
+  grn_expr_cache_entry *prev;
+  grn_id id;
+  grn_obj *db;
+  uint32_t generation;
+  grn_bool in_use;
+  grn_bool parameterized;
+  grn_obj *condition;
+  grn_obj *match_columns;
+  /* the exact filter for not parameterized entries */
+  grn_obj filter;
+  grn_obj literals;
+};
+
+struct _grn_expr_cache {
+  grn_expr_cache_entry *next;
+  grn_expr_cache_entry *prev;
+  grn_hash *hash;
+  /* statistics not merged into the global statistics yet */
+  uint32_t n_fetches;
+  uint32_t n_hits;
+};
+
+typedef struct {
+  uint32_t offset;
+  uint32_t length;
+} grn_expr_cache_span;
+
+#define GRN_EXPR_CACHE_FLUSH_INTERVAL 1024
+
+static uint32_t grn_expr_cache_max_n_entries =
+  GRN_EXPR_CACHE_DEFAULT_MAX_N_ENTRIES;
+static uint32_t grn_expr_cache_generation = 0;
+static grn_expr_cache_statistics grn_expr_cache_total;
+static grn_critical_section grn_expr_cache_lock;
+
+void
+grn_expr_cache_init_from_env(void)
+{
+  char grn_expr_cache_max_n_entries_env[GRN_ENV_BUFFER_SIZE];
+  grn_getenv("GRN_EXPR_CACHE_MAX_N_ENTRIES",
+             grn_expr_cache_max_n_entries_env,
+             GRN_ENV_BUFFER_SIZE);
+  if (grn_expr_cache_max_n_entries_env[0]) {
+    int max_n_entries = atoi(grn_expr_cache_max_n_entries_env);
+    /* 0 disables the cache. */
+    if (max_n_entries >= 0) {
+      grn_expr_cache_max_n_entries = max_n_entries;
+    }
+  }
+}
+
+grn_rc
+grn_expr_cache_init(void)
+{
+  grn_expr_cache_total.n_fetches = 0;
+  grn_expr_cache_total.n_hits = 0;
+  CRITICAL_SECTION_INIT(grn_expr_cache_lock);
+  return GRN_SUCCESS;
+}
+
+grn_rc
+grn_expr_cache_fin(void)
+{
+  CRITICAL_SECTION_FIN(grn_expr_cache_lock);
+  return GRN_SUCCESS;
+}
+
+grn_bool
+grn_expr_cache_is_enabled(grn_ctx *ctx)
+{
+  return grn_expr_cache_max_n_entries > 0 && ctx->impl;
+}
+
+static void
+grn_expr_cache_flush_statistics(grn_expr_cache *cache)
+{
+  if (cache->n_fetches == 0) {
+    return;
+  }
+  CRITICAL_SECTION_ENTER(grn_expr_cache_lock);
+  grn_expr_cache_total.n_fetches += cache->n_fetches;
+  grn_expr_cache_total.n_hits += cache->n_hits;
+  CRITICAL_SECTION_LEAVE(grn_expr_cache_lock);
+  cache->n_fetches = 0;
+  cache->n_hits = 0;
+}
+
+static grn_expr_cache *
+grn_expr_cache_open(grn_ctx *ctx)
+{
+  grn_expr_cache *cache;
+
+  cache = GRN_MALLOC(sizeof(grn_expr_cache));
+  if (!cache) {
+    return NULL;
+  }
+  cache->hash = grn_hash_create(ctx, NULL, GRN_TABLE_MAX_KEY_SIZE,
+                                sizeof(grn_expr_cache_entry),
+                                GRN_OBJ_KEY_VAR_SIZE|GRN_OBJ_TEMPORARY|
+                                GRN_HASH_TINY);
+  if (!cache->hash) {
+    GRN_FREE(cache);
+    return NULL;
+  }
+  cache->next = (grn_expr_cache_entry *)cache;
+  cache->prev = (grn_expr_cache_entry *)cache;
+  cache->n_fetches = 0;
+  cache->n_hits = 0;
+  return cache;
+}
+
+static void
+grn_expr_cache_entry_close(grn_ctx *ctx, grn_expr_cache *cache,
+                           grn_expr_cache_entry *entry)
+{
+  entry->prev->next = entry->next;
+  entry->next->prev = entry->prev;
+  if (entry->match_columns) {
+    grn_obj_unlink(ctx, entry->match_columns);
+  }
+  grn_obj_unlink(ctx, entry->condition);
+  GRN_OBJ_FIN(ctx, &(entry->filter));
+  GRN_OBJ_FIN(ctx, &(entry->literals));
+  grn_hash_delete_by_id(ctx, cache->hash, entry->id, NULL);
+}
+
+/* It must be called before the database and temporary objects of
+   `ctx' are closed. */
+void
+grn_expr_cache_close(grn_ctx *ctx)
+{
+  grn_expr_cache *cache;
+
+  if (!ctx->impl || !ctx->impl->expr_cache) {
+    return;
+  }
+
+  cache = ctx->impl->expr_cache;
+  while (cache->next != (grn_expr_cache_entry *)cache) {
+    grn_expr_cache_entry_close(ctx, cache, cache->next);
+  }
+  grn_expr_cache_flush_statistics(cache);
+  grn_hash_close(ctx, cache->hash);
+  GRN_FREE(cache);
+  ctx->impl->expr_cache = NULL;
+}
+
+/* Makes all entries in all contexts stale. */
+void
+grn_expr_cache_expire(grn_ctx *ctx)
+{
+  uint32_t generation;
+  GRN_ATOMIC_ADD_EX(&grn_expr_cache_generation, 1, generation);
+}
+
+static grn_bool
+grn_expr_cache_is_identifier_delimiter(char c)
+{
+  switch (c) {
+  case '\0' : case '(' : case ')' : case '{' : case '}' :
+  case '[' : case ']' : case ',' : case ':' : case '@' :
+  case '?' : case '"' : case '*' : case '+' : case '-' :
+  case '|' : case '/' : case '%' : case '!' : case '^' :
+  case '&' : case '>' : case '<' : case '=' : case '~' :
+    return GRN_TRUE;
+  default :
+    return GRN_FALSE;
+  }
+}
+
+/*
+  Splits `filter' into tokens like the script syntax parser and appends
+  it to `template' with placeholders instead of literals. The positions
+  of the literals are appended to `spans'.
+*/
+static grn_bool
+grn_expr_cache_scan_filter(grn_ctx *ctx, const char *filter,
+                           unsigned int filter_len,
+                           grn_obj *template, grn_obj *spans)
+{
+  const char *current = filter;
+  const char *end = filter + filter_len;
+  grn_obj literal;
+  grn_bool succeeded = GRN_TRUE;
+
+  GRN_VOID_INIT(&literal);
+  while (current < end) {
+    const char *token_start = current;
+    unsigned int space_len;
+    unsigned int len;
+
+    if ((space_len = grn_isspace(current, ctx->encoding))) {
+      GRN_TEXT_PUT(ctx, template, current, space_len);
+      current += space_len;
+      continue;
+    }
+
+    if (!(len = grn_charlen(ctx, current, end))) {
+      succeeded = GRN_FALSE;
+      break;
+    }
+
+    if (len == 1) {
+      switch (*current) {
+      case GRN_EXPR_CACHE_PLACEHOLDER :
+        succeeded = GRN_FALSE;
+        break;
+      case '"' : case '\'' :
+      case '0' : case '1' : case '2' : case '3' : case '4' :
+      case '5' : case '6' : case '7' : case '8' : case '9' :
+        {
+          grn_expr_cache_span span;
+          if (grn_expr_parse_literal(ctx, current, end,
+                                     &literal, &current) != GRN_SUCCESS) {
+            succeeded = GRN_FALSE;
+            break;
+          }
+          span.offset = token_start - filter;
+          span.length = current - token_start;
+          grn_bulk_write(ctx, spans, (const char *)&span, sizeof(span));
+          GRN_TEXT_PUTC(ctx, template, GRN_EXPR_CACHE_PLACEHOLDER);
+          GRN_TEXT_PUTC(ctx, template,
+                        literal.header.domain == GRN_DB_TEXT ? 's' : 'n');
+        }
+        break;
+      case '*' :
+        if (current + 1 < end &&
+            (current[1] == 'N' || current[1] == 'S' || current[1] == 'T')) {
+          current += 2;
+        } else {
+          current++;
+        }
+        GRN_TEXT_PUT(ctx, template, token_start, current - token_start);
+        break;
+      case '.' :
+        current++;
+        GRN_TEXT_PUT(ctx, template, token_start, current - token_start);
+        break;
+      default :
+        if (grn_expr_cache_is_identifier_delimiter(*current)) {
+          current++;
+          GRN_TEXT_PUT(ctx, template, token_start, current - token_start);
+          len = 0;
+        }
+        break;
+      }
+      if (!succeeded) {
+        break;
+      }
+      if (current != token_start) {
+        continue;
+      }
+    }
+
+    /* identifier */
+    for (; current < end; current += len) {
+      if (!(len = grn_charlen(ctx, current, end))) {
+        break;
+      }
+      if (grn_isspace(current, ctx->encoding)) {
+        break;
+      }
+      if (len == 1) {
+        if (*current == GRN_EXPR_CACHE_PLACEHOLDER) {
+          succeeded = GRN_FALSE;
+          break;
+        }
+        if (grn_expr_cache_is_identifier_delimiter(*current)) {
+          break;
+        }
+      }
+    }
+    if (!succeeded || current == token_start) {
+      succeeded = GRN_FALSE;
+      break;
+    }
+    GRN_TEXT_PUT(ctx, template, token_start, current - token_start);
+  }
+  GRN_OBJ_FIN(ctx, &literal);
+
+  return succeeded;
+}
+
+/* Builds the key of the cache and finds literals in the filter. */
+static grn_bool
+grn_expr_cache_build_key(grn_ctx *ctx, grn_expr_cache_key *key,
+                         grn_obj *cache_key, grn_obj *spans)
+{
+  grn_id table_id = DB_OBJ(key->table)->id;
+  grn_obj template;
+  grn_bool succeeded;
+
+  GRN_TEXT_INIT(&template, 0);
+  succeeded = grn_expr_cache_scan_filter(ctx, key->filter, key->filter_len,
+                                         &template, spans);
+  if (succeeded) {
+    uint32_t template_len = GRN_TEXT_LEN(&template);
+    grn_bulk_write(ctx, cache_key, (const char *)&table_id, sizeof(grn_id));
+    grn_bulk_write(ctx, cache_key, (const char *)&(key->match_columns_len),
+                   sizeof(unsigned int));
+    grn_bulk_write(ctx, cache_key, (const char *)&(key->query_len),
+                   sizeof(unsigned int));
+    grn_bulk_write(ctx, cache_key, (const char *)&(key->query_flags_len),
+                   sizeof(unsigned int));
+    grn_bulk_write(ctx, cache_key, (const char *)&template_len,
+                   sizeof(uint32_t));
+    GRN_TEXT_PUT(ctx, cache_key, key->match_columns, key->match_columns_len);
+    GRN_TEXT_PUT(ctx, cache_key, key->query, key->query_len);
+    GRN_TEXT_PUT(ctx, cache_key, key->query_flags, key->query_flags_len);
+    GRN_TEXT_PUT(ctx, cache_key,
+                 GRN_TEXT_VALUE(&template), GRN_TEXT_LEN(&template));
+    if (GRN_TEXT_LEN(cache_key) > GRN_TABLE_MAX_KEY_SIZE) {
+      succeeded = GRN_FALSE;
+    }
+  }
+  GRN_OBJ_FIN(ctx, &template);
+
+  return succeeded;
+}
+
+static grn_bool
+grn_expr_cache_entry_is_fresh(grn_ctx *ctx, grn_expr_cache_entry *entry)
+{
+  return (entry->db == grn_ctx_db(ctx) &&
+          entry->generation == grn_expr_cache_generation);
+}
+
+/*
+  Casts `literal' in the same way as the parser did for the constant
+  of `cached_literal'. The result is stored into `value'.
+*/
+static grn_bool
+grn_expr_cache_literal_cast(grn_ctx *ctx,
+                            grn_expr_cache_literal *cached_literal,
+                            grn_obj *literal, grn_obj *value)
+{
+  grn_id domain = cached_literal->value->header.domain;
+
+  if (literal->header.domain != cached_literal->literal_domain) {
+    return GRN_FALSE;
+  }
+  if (domain == literal->header.domain) {
+    grn_obj_reinit(ctx, value, domain, 0);
+    grn_bulk_write(ctx, value,
+                   GRN_BULK_HEAD(literal), GRN_BULK_VSIZE(literal));
+    return GRN_TRUE;
+  }
+  grn_obj_reinit(ctx, value, domain, 0);
+  if (grn_obj_cast(ctx, literal, value, GRN_FALSE) != GRN_SUCCESS) {
+    ERRCLR(ctx);
+    return GRN_FALSE;
+  }
+  return GRN_TRUE;
+}
+
+/* Binds the literals in `filter' to the constants of `entry'. */
+static grn_bool
+grn_expr_cache_entry_bind(grn_ctx *ctx, grn_expr_cache_entry *entry,
+                          grn_expr_cache_key *key, grn_obj *spans)
+{
+  grn_expr_cache_literal *literals;
+  grn_expr_cache_span *span_array;
+  unsigned int i, n_literals;
+  grn_obj literal;
+  grn_obj values;
+  grn_obj *value_array;
+  grn_bool succeeded = GRN_TRUE;
+
+  if (!entry->parameterized) {
+    return (GRN_TEXT_LEN(&(entry->filter)) == key->filter_len &&
+            memcmp(GRN_TEXT_VALUE(&(entry->filter)),
+                   key->filter, key->filter_len) == 0);
+  }
+
+  literals = (grn_expr_cache_literal *)GRN_BULK_HEAD(&(entry->literals));
+  n_literals = GRN_BULK_VSIZE(&(entry->literals)) / sizeof(grn_expr_cache_literal);
+  span_array = (grn_expr_cache_span *)GRN_BULK_HEAD(spans);
+  if (GRN_BULK_VSIZE(spans) / sizeof(grn_expr_cache_span) != n_literals) {
+    return GRN_FALSE;
+  }
+
+  /* Values are bound after all literals are converted successfully. */
+  GRN_VOID_INIT(&literal);
+  GRN_TEXT_INIT(&values, 0);
+  value_array = NULL;
+  if (n_literals > 0) {
+    grn_bulk_space(ctx, &values, sizeof(grn_obj) * n_literals);
+    value_array = (grn_obj *)GRN_BULK_HEAD(&values);
+    for (i = 0; i < n_literals; i++) {
+      GRN_VOID_INIT(value_array + i);
+    }
+  }
+  for (i = 0; i < n_literals; i++) {
+    const char *start = key->filter + span_array[i].offset;
+    const char *rest;
+    if (grn_expr_parse_literal(ctx, start, start + span_array[i].length,
+                               &literal, &rest) != GRN_SUCCESS ||
+        !grn_expr_cache_literal_cast(ctx, literals + i, &literal,
+                                     value_array + i)) {
+      succeeded = GRN_FALSE;
+      break;
+    }
+  }
+  if (succeeded) {
+    for (i = 0; i < n_literals; i++) {
+      grn_obj *value = literals[i].value;
+      GRN_BULK_REWIND(value);
+      grn_bulk_write(ctx, value,
+                     GRN_BULK_HEAD(value_array + i),
+                     GRN_BULK_VSIZE(value_array + i));
+    }
+  }
+  for (i = 0; i < n_literals; i++) {
+    GRN_OBJ_FIN(ctx, value_array + i);
+  }
+  GRN_OBJ_FIN(ctx, &values);
+  GRN_OBJ_FIN(ctx, &literal);
+
+  return succeeded;
+}
+
+grn_bool
+grn_expr_cache_fetch(grn_ctx *ctx, grn_expr_cache_key *key,
+                     grn_obj **condition, grn_obj **match_columns)
+{
+  grn_expr_cache *cache;
+  grn_expr_cache_entry *entry;
+  grn_obj cache_key;
+  grn_obj spans;
+  grn_bool hit = GRN_FALSE;
+
+  if (!grn_expr_cache_is_enabled(ctx)) {
+    return GRN_FALSE;
+  }
+  cache = ctx->impl->expr_cache;
+  if (!cache) {
+    return GRN_FALSE;
+  }
+
+  GRN_TEXT_INIT(&cache_key, 0);
+  GRN_TEXT_INIT(&spans, 0);
+  cache->n_fetches++;
+  if (!grn_expr_cache_build_key(ctx, key, &cache_key, &spans)) {
+    goto exit;
+  }
+  if (!grn_hash_get(ctx, cache->hash,
+                    GRN_TEXT_VALUE(&cache_key), GRN_TEXT_LEN(&cache_key),
+                    (void **)&entry)) {
+    goto exit;
+  }
+  if (entry->in_use) {
+    goto exit;
+  }
+  if (!grn_expr_cache_entry_is_fresh(ctx, entry)) {
+    grn_expr_cache_entry_close(ctx, cache, entry);
+    goto exit;
+  }
+  if (!grn_expr_cache_entry_bind(ctx, entry, key, &spans)) {
+    goto exit;
+  }
+
+  entry->in_use = GRN_TRUE;
+  entry->prev->next = entry->next;
+  entry->next->prev = entry->prev;
+  entry->next = cache->next;
+  entry->prev = (grn_expr_cache_entry *)cache;
+  cache->next->prev = entry;
+  cache->next = entry;
+  *condition = entry->condition;
+  *match_columns = entry->match_columns;
+  cache->n_hits++;
+  hit = GRN_TRUE;
+
+exit :
+  if (cache->n_fetches == GRN_EXPR_CACHE_FLUSH_INTERVAL) {
+    grn_expr_cache_flush_statistics(cache);
+  }
+  GRN_OBJ_FIN(ctx, &spans);
+  GRN_OBJ_FIN(ctx, &cache_key);
+  return hit;
+}
+
+static grn_bool
+grn_expr_cache_literal_is_bindable(grn_ctx *ctx, grn_obj *condition,
+                                   const char *filter,
+                                   grn_expr_literal *literal,
+                                   grn_expr_cache_literal *cached_literal)
+{
+  grn_expr *e = (grn_expr *)condition;
+  grn_expr_code *code, *codes_end;
+  int n_references = 0;
+  grn_obj raw_literal;
+  grn_obj value;
+  const char *start = filter + literal->offset;
+  const char *rest;
+  grn_bool bindable = GRN_FALSE;
+
+  /* The constant must be used as is. It must not be folded into
+     another constant. */
+  codes_end = e->codes + e->codes_curr;
+  for (code = e->codes; code < codes_end; code++) {
+    if (code->value == literal->value) {
+      n_references++;
+    }
+  }
+  if (n_references != 1) {
+    return GRN_FALSE;
+  }
+  if (literal->value->header.type != GRN_BULK) {
+    return GRN_FALSE;
+  }
+
+  GRN_VOID_INIT(&raw_literal);
+  GRN_VOID_INIT(&value);
+  if (grn_expr_parse_literal(ctx, start, start + literal->length,
+                             &raw_literal, &rest) == GRN_SUCCESS) {
+    cached_literal->value = literal->value;
+    cached_literal->literal_domain = raw_literal.header.domain;
+    if (grn_expr_cache_literal_cast(ctx, cached_literal,
+                                    &raw_literal, &value) &&
+        GRN_BULK_VSIZE(&value) == GRN_BULK_VSIZE(literal->value) &&
+        memcmp(GRN_BULK_HEAD(&value), GRN_BULK_HEAD(literal->value),
+               GRN_BULK_VSIZE(&value)) == 0) {
+      bindable = GRN_TRUE;
+    }
+  }
+  GRN_OBJ_FIN(ctx, &value);
+  GRN_OBJ_FIN(ctx, &raw_literal);
+
+  return bindable;
+}
+
+static grn_bool
+grn_expr_cache_entry_set_literals(grn_ctx *ctx, grn_expr_cache_entry *entry,
+                                  grn_expr_cache_key *key, grn_obj *spans,
+                                  grn_obj *filter_literals)
+{
+  grn_expr_literal *literals;
+  grn_expr_cache_span *span_array;
+  unsigned int i, n_literals;
+
+  n_literals = GRN_BULK_VSIZE(filter_literals) / sizeof(grn_expr_literal);
+  if (GRN_BULK_VSIZE(spans) / sizeof(grn_expr_cache_span) != n_literals) {
+    return GRN_FALSE;
+  }
+
+  literals = (grn_expr_literal *)GRN_BULK_HEAD(filter_literals);
+  span_array = (grn_expr_cache_span *)GRN_BULK_HEAD(spans);
+  for (i = 0; i < n_literals; i++) {
+    grn_expr_cache_literal cached_literal;
+    if (literals[i].offset != span_array[i].offset ||
+        literals[i].length != span_array[i].length) {
+      return GRN_FALSE;
+    }
+    if (!grn_expr_cache_literal_is_bindable(ctx, entry->condition,
+                                            key->filter, literals + i,
+                                            &cached_literal)) {
+      return GRN_FALSE;
+    }
+    grn_bulk_write(ctx, &(entry->literals),
+                   (const char *)&cached_literal, sizeof(cached_literal));
+  }
+  return GRN_TRUE;
+}
+
+static void
+grn_expr_cache_expire_entries(grn_ctx *ctx, grn_expr_cache *cache)
+{
+  grn_expr_cache_entry *entry = cache->prev;
+
+  while (GRN_HASH_SIZE(cache->hash) > grn_expr_cache_max_n_entries &&
+         entry != (grn_expr_cache_entry *)cache) {
+    grn_expr_cache_entry *prev = entry->prev;
+    if (!entry->in_use) {
+      grn_expr_cache_entry_close(ctx, cache, entry);
+    }
+    entry = prev;
+  }
+}
+
+/*
+  Passes the ownership of `condition' and `match_columns' to the cache
+  on success. They are in use until grn_expr_cache_release() is called.
+  `filter_literals' must be the literals of key->filter recorded by
+  grn_expr_parse_with_literals().
+*/
+grn_bool
+grn_expr_cache_add(grn_ctx *ctx, grn_expr_cache_key *key,
+                   grn_obj *condition, grn_obj *match_columns,
+                   grn_obj *filter_literals)
+{
+  grn_expr_cache *cache;
+  grn_expr_cache_entry *entry;
+  grn_obj cache_key;
+  grn_obj spans;
+  int added;
+  grn_id id;
+  grn_bool succeeded = GRN_FALSE;
+
+  if (!grn_expr_cache_is_enabled(ctx)) {
+    return GRN_FALSE;
+  }
+  cache = ctx->impl->expr_cache;
+  if (!cache) {
+    cache = grn_expr_cache_open(ctx);
+    if (!cache) {
+      return GRN_FALSE;
+    }
+    ctx->impl->expr_cache = cache;
+  }
+
+  GRN_TEXT_INIT(&cache_key, 0);
+  GRN_TEXT_INIT(&spans, 0);
+  if (!grn_expr_cache_build_key(ctx, key, &cache_key, &spans)) {
+    goto exit;
+  }
+  if (grn_hash_get(ctx, cache->hash,
+                   GRN_TEXT_VALUE(&cache_key), GRN_TEXT_LEN(&cache_key),
+                   (void **)&entry)) {
+    if (entry->in_use) {
+      goto exit;
+    }
+    grn_expr_cache_entry_close(ctx, cache, entry);
+  }
+  id = grn_hash_add(ctx, cache->hash,
+                    GRN_TEXT_VALUE(&cache_key), GRN_TEXT_LEN(&cache_key),
+                    (void **)&entry, &added);
+  if (!id) {
+    goto exit;
+  }
+
+  entry->id = id;
+  entry->db = grn_ctx_db(ctx);
+  entry->generation = grn_expr_cache_generation;
+  entry->in_use = GRN_TRUE;
+  entry->condition = condition;
+  entry->match_columns = match_columns;
+  GRN_TEXT_INIT(&(entry->filter), 0);
+  GRN_TEXT_INIT(&(entry->literals), 0);
+  entry->parameterized =
+    grn_expr_cache_entry_set_literals(ctx, entry, key, &spans,
+                                      filter_literals);
+  if (!entry->parameterized) {
+    GRN_BULK_REWIND(&(entry->literals));
+    GRN_TEXT_SET(ctx, &(entry->filter), key->filter, key->filter_len);
+  }
+  entry->next = cache->next;
+  entry->prev = (grn_expr_cache_entry *)cache;
+  cache->next->prev = entry;
+  cache->next = entry;
+
+  grn_expr_unlink_persistent_objs(ctx, condition);
+  if (match_columns) {
+    grn_expr_unlink_persistent_objs(ctx, match_columns);
+  }
+  grn_expr_cache_expire_entries(ctx, cache);
+  succeeded = GRN_TRUE;
+
+exit :
+  GRN_OBJ_FIN(ctx, &spans);
+  GRN_OBJ_FIN(ctx, &cache_key);
+  return succeeded;
+}
+
+void
+grn_expr_cache_release(grn_ctx *ctx, grn_obj *condition)
+{
+  grn_expr_cache *cache = ctx->impl->expr_cache;
+  grn_expr_cache_entry *entry;
+
+  if (!cache) {
+    return;
+  }
+  for (entry = cache->next;
+       entry != (grn_expr_cache_entry *)cache;
+       entry = entry->next) {
+    if (entry->condition == condition) {
+      entry->in_use = GRN_FALSE;
+      break;
+    }
+  }
+  grn_expr_cache_expire_entries(ctx, cache);
+}
+
+void
+grn_expr_cache_get_statistics(grn_ctx *ctx,
+                              grn_expr_cache_statistics *statistics)
+{
+  if (ctx->impl && ctx->impl->expr_cache) {
+    grn_expr_cache_flush_statistics(ctx->impl->expr_cache);
+  }
+  CRITICAL_SECTION_ENTER(grn_expr_cache_lock);
+  *statistics = grn_expr_cache_total;
+  CRITICAL_SECTION_LEAVE(grn_expr_cache_lock);
+}
@@ -0,0 +1,1342 @@
+/* -*- c-basic-offset: 2 -*- */
+/*
+  Copyright(C) 2015 Brazil
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License version 2.1 as published by the Free Software Foundation.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "grn_expr_program.h"
+#include "grn_db.h"
+#include "grn_store.h"
+
+#include <string.h>
+
+#define GRN_EXPR_PROGRAM_MAX_N_NODES        128
+#define GRN_EXPR_PROGRAM_MAX_N_COLUMNS      16
+#define GRN_EXPR_PROGRAM_MAX_N_REGISTERS    256
+#define GRN_EXPR_PROGRAM_MAX_N_INSTRUCTIONS 256
+
+#if defined(__GNUC__) && !defined(GRN_EXPR_PROGRAM_NO_COMPUTED_GOTO)
+# define GRN_EXPR_PROGRAM_USE_COMPUTED_GOTO
+#endif
+
+#define GRN_EXPR_PROGRAM_OPS(OP)                \
+  OP(LOAD_BOOL)                                 \
+  OP(LOAD_INT8)                                 \
+  OP(LOAD_UINT8)                                \
+  OP(LOAD_INT16)                                \
+  OP(LOAD_UINT16)                               \
+  OP(LOAD_INT32)                                \
+  OP(LOAD_INT64)                                \
+  OP(LOAD_FLOAT)                                \
+  OP(MOVE)                                      \
+  OP(INT_TO_FLOAT)                              \
+  OP(EQUAL_INT)                                 \
+  OP(NOT_EQUAL_INT)                             \
+  OP(LESS_INT)                                  \
+  OP(GREATER_INT)                               \
+  OP(LESS_EQUAL_INT)                            \
+  OP(GREATER_EQUAL_INT)                         \
+  OP(EQUAL_FLOAT)                               \
+  OP(NOT_EQUAL_FLOAT)                           \
+  OP(LESS_FLOAT)                                \
+  OP(GREATER_FLOAT)                             \
+  OP(LESS_EQUAL_FLOAT)                          \
+  OP(GREATER_EQUAL_FLOAT)                       \
+  OP(PLUS_INT32)                                \
+  OP(MINUS_INT32)                               \
+  OP(STAR_INT32)                                \
+  OP(PLUS_INT64)                                \
+  OP(MINUS_INT64)                               \
+  OP(STAR_INT64)                                \
+  OP(PLUS_FLOAT)                                \
+  OP(MINUS_FLOAT)                               \
+  OP(STAR_FLOAT)                                \
+  OP(NOT)                                       \
+  OP(AND)                                       \
+  OP(OR)                                        \
+  OP(JUMP_IF_FALSE)                             \
+  OP(JUMP_IF_TRUE)                              \
+  OP(RETURN)
+
+#define GRN_EXPR_PROGRAM_OP_ENUM(name) GRN_EXPR_PROGRAM_OP_ ## name,
+typedef enum {
+  GRN_EXPR_PROGRAM_OPS(GRN_EXPR_PROGRAM_OP_ENUM)
+  GRN_EXPR_PROGRAM_N_OPS
+} grn_expr_program_op;
+#undef GRN_EXPR_PROGRAM_OP_ENUM
+
+typedef struct {
+  uint8_t op;
+  /* the output register */
+  uint8_t dst;
+  /* the input registers or the column for LOAD_* */
+  uint8_t x;
+  uint8_t y;
+  /* the instruction to jump */
+  uint32_t target;
+} grn_expr_program_instruction;
+
+typedef union {
+  int64_t i;
+  double f;
+} grn_expr_program_register;
+
+typedef struct {
+  grn_ra *ra;
+  grn_ra_cache cache;
+} grn_expr_program_column;
+
+struct _grn_expr_program {
+  grn_expr_program_instruction instructions[GRN_EXPR_PROGRAM_MAX_N_INSTRUCTIONS];
+  int n_instructions;
+  /* constants are set to their registers when the program is compiled */
+  grn_expr_program_register registers[GRN_EXPR_PROGRAM_MAX_N_REGISTERS];
+  int n_registers;
+  grn_expr_program_column columns[GRN_EXPR_PROGRAM_MAX_N_COLUMNS];
+  int n_columns;
+  /* GRN_EXPR_PROGRAM_BATCH_SIZE values for each register */
+  grn_expr_program_register *batch_registers;
+};
+
+typedef enum {
+  GRN_EXPR_PROGRAM_TYPE_BOOL,
+  GRN_EXPR_PROGRAM_TYPE_INT,
+  GRN_EXPR_PROGRAM_TYPE_FLOAT,
+  GRN_EXPR_PROGRAM_TYPE_TIME,
+  /* only for constants */
+  GRN_EXPR_PROGRAM_TYPE_TEXT
+} grn_expr_program_type;
+
+typedef struct {
+  grn_operator op;
+  grn_expr_program_type type;
+  /* the domain of values of GRN_EXPR_PROGRAM_TYPE_INT */
+  grn_id domain;
+  int args[2];
+  /* for GRN_OP_GET_VALUE and GRN_OP_PUSH */
+  grn_obj *value;
+  /* the value of a number constant */
+  grn_expr_program_register constant;
+  /* comparisons and arithmetic operations */
+  grn_expr_program_type operand_type;
+} grn_expr_program_node;
+
+typedef struct {
+  grn_ctx *ctx;
+  grn_obj *table;
+  grn_expr_program *program;
+  grn_expr_program_node nodes[GRN_EXPR_PROGRAM_MAX_N_NODES];
+  int n_nodes;
+} grn_expr_program_compiler;
+
+static grn_bool grn_expr_program_enabled = GRN_TRUE;
+
+void
+grn_expr_program_init_from_env(void)
+{
+  char grn_expr_program_enabled_env[GRN_ENV_BUFFER_SIZE];
+  grn_getenv("GRN_EXPR_PROGRAM_ENABLED",
+             grn_expr_program_enabled_env,
+             GRN_ENV_BUFFER_SIZE);
+  if (strcmp(grn_expr_program_enabled_env, "no") == 0) {
+    grn_expr_program_enabled = GRN_FALSE;
+  } else {
+    grn_expr_program_enabled = GRN_TRUE;
+  }
+}
+
+static grn_bool
+grn_expr_program_is_int_domain(grn_id domain)
+{
+  switch (domain) {
+  case GRN_DB_INT8 :
+  case GRN_DB_UINT8 :
+  case GRN_DB_INT16 :
+  case GRN_DB_UINT16 :
+  case GRN_DB_INT32 :
+  case GRN_DB_INT64 :
+    return GRN_TRUE;
+  default :
+    return GRN_FALSE;
+  }
+}
+
+static int
+grn_expr_program_add_node(grn_expr_program_compiler *compiler,
+                          grn_operator op)
+{
+  grn_expr_program_node *node;
+  if (compiler->n_nodes == GRN_EXPR_PROGRAM_MAX_N_NODES) {
+    return -1;
+  }
+  node = compiler->nodes + compiler->n_nodes;
+  memset(node, 0, sizeof(grn_expr_program_node));
+  node->op = op;
+  node->args[0] = -1;
+  node->args[1] = -1;
+  return compiler->n_nodes++;
+}
+
+static int
+grn_expr_program_add_column(grn_expr_program_compiler *compiler,
+                            grn_obj *column)
+{
+  grn_ctx *ctx = compiler->ctx;
+  grn_obj *range;
+  grn_id domain;
+  int i;
+
+  if (column->header.type != GRN_COLUMN_FIX_SIZE) {
+    return -1;
+  }
+  if ((column->header.flags & GRN_OBJ_COLUMN_TYPE_MASK) !=
+      GRN_OBJ_COLUMN_SCALAR) {
+    return -1;
+  }
+  if (column->header.domain != DB_OBJ(compiler->table)->id) {
+    return -1;
+  }
+  domain = grn_obj_get_range(ctx, column);
+  range = grn_ctx_at(ctx, domain);
+  if (!range || range->header.type != GRN_TYPE) {
+    return -1;
+  }
+  switch (domain) {
+  case GRN_DB_BOOL :
+  case GRN_DB_FLOAT :
+  case GRN_DB_TIME :
+    break;
+  default :
+    if (!grn_expr_program_is_int_domain(domain)) {
+      return -1;
+    }
+    break;
+  }
+
+  i = grn_expr_program_add_node(compiler, GRN_OP_GET_VALUE);
+  if (i < 0) {
+    return -1;
+  }
+  compiler->nodes[i].value = column;
+  compiler->nodes[i].domain = domain;
+  switch (domain) {
+  case GRN_DB_BOOL :
+    compiler->nodes[i].type = GRN_EXPR_PROGRAM_TYPE_BOOL;
+    break;
+  case GRN_DB_FLOAT :
+    compiler->nodes[i].type = GRN_EXPR_PROGRAM_TYPE_FLOAT;
+    break;
+  case GRN_DB_TIME :
+    compiler->nodes[i].type = GRN_EXPR_PROGRAM_TYPE_TIME;
+    break;
+  default :
+    compiler->nodes[i].type = GRN_EXPR_PROGRAM_TYPE_INT;
+    break;
+  }
+  return i;
+}
+
+static int
+grn_expr_program_add_constant(grn_expr_program_compiler *compiler,
+                              grn_obj *value)
+{
+  grn_expr_program_node *node;
+  grn_id domain;
+  int i;
+
+  if (value->header.type != GRN_BULK) {
+    return -1;
+  }
+  domain = value->header.domain;
+
+  i = grn_expr_program_add_node(compiler, GRN_OP_PUSH);
+  if (i < 0) {
+    return -1;
+  }
+  node = compiler->nodes + i;
+  node->value = value;
+  node->domain = domain;
+
+  if (GRN_DB_SHORT_TEXT <= domain && domain <= GRN_DB_LONG_TEXT) {
+    node->type = GRN_EXPR_PROGRAM_TYPE_TEXT;
+    return i;
+  }
+
+  if (GRN_BULK_VSIZE(value) == 0) {
+    return -1;
+  }
+  switch (domain) {
+  case GRN_DB_BOOL :
+    node->type = GRN_EXPR_PROGRAM_TYPE_BOOL;
+    node->constant.i = GRN_BOOL_VALUE(value) ? 1 : 0;
+    break;
+  case GRN_DB_INT8 :
+    node->type = GRN_EXPR_PROGRAM_TYPE_INT;
+    node->constant.i = GRN_INT8_VALUE(value);
+    break;
+  case GRN_DB_UINT8 :
+    node->type = GRN_EXPR_PROGRAM_TYPE_INT;
+    node->constant.i = GRN_UINT8_VALUE(value);
+    break;
+  case GRN_DB_INT16 :
+    node->type = GRN_EXPR_PROGRAM_TYPE_INT;
+    node->constant.i = GRN_INT16_VALUE(value);
+    break;
+  case GRN_DB_UINT16 :
+    node->type = GRN_EXPR_PROGRAM_TYPE_INT;
+    node->constant.i = GRN_UINT16_VALUE(value);
+    break;
+  case GRN_DB_INT32 :
+    node->type = GRN_EXPR_PROGRAM_TYPE_INT;
+    node->constant.i = GRN_INT32_VALUE(value);
+    break;
+  case GRN_DB_INT64 :
+    node->type = GRN_EXPR_PROGRAM_TYPE_INT;
+    node->constant.i = GRN_INT64_VALUE(value);
+    break;
+  case GRN_DB_TIME :
+    node->type = GRN_EXPR_PROGRAM_TYPE_TIME;
+    node->constant.i = GRN_TIME_VALUE(value);
+    break;
+  case GRN_DB_FLOAT :
+    node->type = GRN_EXPR_PROGRAM_TYPE_FLOAT;
+    node->constant.f = GRN_FLOAT_VALUE(value);
+    break;
+  default :
+    return -1;
+  }
+  return i;
+}
+
+/*
+  Converts a constant that is compared with a time value in the same
+  way as grn_operator_exec_equal() and grn_operator_exec_less().
+*/
+static grn_bool
+grn_expr_program_constant_to_time(grn_expr_program_compiler *compiler,
+                                  grn_expr_program_node *node)
+{
+  grn_ctx *ctx = compiler->ctx;
+
+  switch (node->domain) {
+  case GRN_DB_INT32 :
+    node->constant.i = GRN_TIME_PACK(node->constant.i, 0);
+    break;
+  case GRN_DB_INT64 :
+  case GRN_DB_TIME :
+    break;
+  case GRN_DB_FLOAT :
+    node->constant.i = GRN_TIME_PACK(node->constant.f, 0);
+    break;
+  case GRN_DB_SHORT_TEXT :
+  case GRN_DB_TEXT :
+  case GRN_DB_LONG_TEXT :
+    {
+      grn_obj time_value;
+      grn_rc rc;
+      GRN_TIME_INIT(&time_value, 0);
+      rc = grn_obj_cast(ctx, node->value, &time_value, GRN_FALSE);
+      if (rc == GRN_SUCCESS) {
+        node->constant.i = GRN_TIME_VALUE(&time_value);
+      }
+      GRN_OBJ_FIN(ctx, &time_value);
+      if (rc != GRN_SUCCESS) {
+        ERRCLR(ctx);
+        return GRN_FALSE;
+      }
+    }
+    break;
+  default :
+    return GRN_FALSE;
+  }
+  node->type = GRN_EXPR_PROGRAM_TYPE_TIME;
+  node->domain = GRN_DB_TIME;
+  return GRN_TRUE;
+}
+
+static int
+grn_expr_program_add_comparison(grn_expr_program_compiler *compiler,
+                                grn_operator op, int x, int y)
+{
+  grn_expr_program_node *x_node = compiler->nodes + x;
+  grn_expr_program_node *y_node = compiler->nodes + y;
+  grn_expr_program_type operand_type;
+  int i;
+
+  if (x_node->type == GRN_EXPR_PROGRAM_TYPE_TIME) {
+    if (y_node->type == GRN_EXPR_PROGRAM_TYPE_TIME) {
+      operand_type = GRN_EXPR_PROGRAM_TYPE_INT;
+    } else if (y_node->op == GRN_OP_PUSH) {
+      if (!grn_expr_program_constant_to_time(compiler, y_node)) {
+        return -1;
+      }
+      operand_type = GRN_EXPR_PROGRAM_TYPE_INT;
+    } else if (y_node->domain == GRN_DB_INT64) {
+      operand_type = GRN_EXPR_PROGRAM_TYPE_INT;
+    } else {
+      return -1;
+    }
+  } else if (x_node->type == GRN_EXPR_PROGRAM_TYPE_BOOL &&
+             y_node->type == GRN_EXPR_PROGRAM_TYPE_BOOL) {
+    if (op != GRN_OP_EQUAL && op != GRN_OP_NOT_EQUAL) {
+      return -1;
+    }
+    operand_type = GRN_EXPR_PROGRAM_TYPE_INT;
+  } else if (x_node->type == GRN_EXPR_PROGRAM_TYPE_INT &&
+             y_node->type == GRN_EXPR_PROGRAM_TYPE_INT) {
+    operand_type = GRN_EXPR_PROGRAM_TYPE_INT;
+  } else if (x_node->type == GRN_EXPR_PROGRAM_TYPE_FLOAT &&
+             y_node->type == GRN_EXPR_PROGRAM_TYPE_INT &&
+             y_node->domain != GRN_DB_INT32 &&
+             y_node->domain != GRN_DB_INT64 &&
+             (op == GRN_OP_EQUAL || op == GRN_OP_NOT_EQUAL)) {
+    /* grn_operator_exec_equal() doesn't compare a float value with a
+       small integer value. */
+    return -1;
+  } else if ((x_node->type == GRN_EXPR_PROGRAM_TYPE_INT ||
+              x_node->type == GRN_EXPR_PROGRAM_TYPE_FLOAT) &&
+             (y_node->type == GRN_EXPR_PROGRAM_TYPE_INT ||
+              y_node->type == GRN_EXPR_PROGRAM_TYPE_FLOAT)) {
+    operand_type = GRN_EXPR_PROGRAM_TYPE_FLOAT;
+  } else {
+    return -1;
+  }
+
+  i = grn_expr_program_add_node(compiler, op);
+  if (i < 0) {
+    return -1;
+  }
+  compiler->nodes[i].type = GRN_EXPR_PROGRAM_TYPE_BOOL;
+  compiler->nodes[i].operand_type = operand_type;
+  compiler->nodes[i].args[0] = x;
+  compiler->nodes[i].args[1] = y;
+  return i;
+}
+
+/*
+  The result has the type of the left hand side value. It's a float
+  value when one of them is a float value. It's the same as
+  grn_expr_exec().
+*/
+static int
+grn_expr_program_add_arithmetic(grn_expr_program_compiler *compiler,
+                                grn_operator op, int x, int y)
+{
+  grn_expr_program_node *x_node = compiler->nodes + x;
+  grn_expr_program_node *y_node = compiler->nodes + y;
+  grn_expr_program_type type;
+  grn_id domain = GRN_DB_FLOAT;
+  int i;
+
+  if (x_node->type == GRN_EXPR_PROGRAM_TYPE_FLOAT) {
+    if (y_node->type != GRN_EXPR_PROGRAM_TYPE_INT &&
+        y_node->type != GRN_EXPR_PROGRAM_TYPE_FLOAT) {
+      return -1;
+    }
+    type = GRN_EXPR_PROGRAM_TYPE_FLOAT;
+  } else if (x_node->type == GRN_EXPR_PROGRAM_TYPE_INT &&
+             (x_node->domain == GRN_DB_INT32 ||
+              x_node->domain == GRN_DB_INT64)) {
+    if (y_node->type == GRN_EXPR_PROGRAM_TYPE_FLOAT) {
+      type = GRN_EXPR_PROGRAM_TYPE_FLOAT;
+    } else if (y_node->type == GRN_EXPR_PROGRAM_TYPE_INT) {
+      type = GRN_EXPR_PROGRAM_TYPE_INT;
+      domain = x_node->domain;
+    } else {
+      return -1;
+    }
+  } else {
+    return -1;
+  }
+
+  i = grn_expr_program_add_node(compiler, op);
+  if (i < 0) {
+    return -1;
+  }
+  compiler->nodes[i].type = type;
+  compiler->nodes[i].domain = domain;
+  compiler->nodes[i].operand_type = type;
+  compiler->nodes[i].args[0] = x;
+  compiler->nodes[i].args[1] = y;
+  return i;
+}
+
+static int
+grn_expr_program_add_logical(grn_expr_program_compiler *compiler,
+                             grn_operator op, int x, int y)
+{
+  int i;
+
+  if (compiler->nodes[x].type != GRN_EXPR_PROGRAM_TYPE_BOOL) {
+    return -1;
+  }
+  if (y >= 0 && compiler->nodes[y].type != GRN_EXPR_PROGRAM_TYPE_BOOL) {
+    return -1;
+  }
+
+  i = grn_expr_program_add_node(compiler, op);
+  if (i < 0) {
+    return -1;
+  }
+  compiler->nodes[i].type = GRN_EXPR_PROGRAM_TYPE_BOOL;
+  compiler->nodes[i].args[0] = x;
+  compiler->nodes[i].args[1] = y;
+  return i;
+}
+
+/* Builds a tree from the codes in postfix notation. */
+static int
+grn_expr_program_parse(grn_expr_program_compiler *compiler, grn_obj *expr)
+{
+  grn_expr *e = (grn_expr *)expr;
+  grn_expr_code *code, *codes_end;
+  int stack[GRN_EXPR_PROGRAM_MAX_N_NODES];
+  int depth = 0;
+
+  codes_end = e->codes + e->codes_curr;
+  for (code = e->codes; code < codes_end; code++) {
+    int node = -1;
+
+    switch (code->op) {
+    case GRN_OP_GET_VALUE :
+      if (code->nargs != 1 || !code->value) {
+        return -1;
+      }
+      node = grn_expr_program_add_column(compiler, code->value);
+      break;
+    case GRN_OP_PUSH :
+      if (!code->value) {
+        return -1;
+      }
+      node = grn_expr_program_add_constant(compiler, code->value);
+      break;
+    case GRN_OP_EQUAL :
+    case GRN_OP_NOT_EQUAL :
+    case GRN_OP_LESS :
+    case GRN_OP_GREATER :
+    case GRN_OP_LESS_EQUAL :
+    case GRN_OP_GREATER_EQUAL :
+      if (code->nargs != 2 || depth < 2) {
+        return -1;
+      }
+      depth -= 2;
+      node = grn_expr_program_add_comparison(compiler, code->op,
+                                             stack[depth],
+                                             stack[depth + 1]);
+      break;
+    case GRN_OP_PLUS :
+    case GRN_OP_MINUS :
+    case GRN_OP_STAR :
+      if (code->nargs != 2 || depth < 2) {
+        return -1;
+      }
+      depth -= 2;
+      node = grn_expr_program_add_arithmetic(compiler, code->op,
+                                             stack[depth],
+                                             stack[depth + 1]);
+      break;
+    case GRN_OP_AND :
+    case GRN_OP_OR :
+      if (code->nargs != 2 || depth < 2) {
+        return -1;
+      }
+      depth -= 2;
+      node = grn_expr_program_add_logical(compiler, code->op,
+                                          stack[depth],
+                                          stack[depth + 1]);
+      break;
+    case GRN_OP_NOT :
+      if (code->nargs != 1 || depth < 1) {
+        return -1;
+      }
+      depth--;
+      node = grn_expr_program_add_logical(compiler, code->op,
+                                          stack[depth], -1);
+      break;
+    default :
+      return -1;
+    }
+
+    if (node < 0) {
+      return -1;
+    }
+    stack[depth++] = node;
+  }
+
+  if (depth != 1) {
+    return -1;
+  }
+  if (compiler->nodes[stack[0]].type != GRN_EXPR_PROGRAM_TYPE_BOOL) {
+    return -1;
+  }
+  return stack[0];
+}
+
+static int
+grn_expr_program_emit(grn_expr_program_compiler *compiler,
+                      grn_expr_program_op op, int dst, int x, int y)
+{
+  grn_expr_program *program = compiler->program;
+  grn_expr_program_instruction *instruction;
+
+  if (program->n_instructions == GRN_EXPR_PROGRAM_MAX_N_INSTRUCTIONS) {
+    return -1;
+  }
+  instruction = program->instructions + program->n_instructions;
+  instruction->op = op;
+  instruction->dst = dst;
+  instruction->x = x;
+  instruction->y = y;
+  instruction->target = 0;
+  return program->n_instructions++;
+}
+
+static int
+grn_expr_program_new_register(grn_expr_program_compiler *compiler)
+{
+  grn_expr_program *program = compiler->program;
+  if (program->n_registers == GRN_EXPR_PROGRAM_MAX_N_REGISTERS) {
+    return -1;
+  }
+  program->registers[program->n_registers].i = 0;
+  return program->n_registers++;
+}
+
+static int
+grn_expr_program_column_index(grn_expr_program_compiler *compiler,
+                              grn_obj *column)
+{
+  grn_expr_program *program = compiler->program;
+  int i;
+
+  for (i = 0; i < program->n_columns; i++) {
+    if (program->columns[i].ra == (grn_ra *)column) {
+      return i;
+    }
+  }
+  if (program->n_columns == GRN_EXPR_PROGRAM_MAX_N_COLUMNS) {
+    return -1;
+  }
+  program->columns[i].ra = (grn_ra *)column;
+  GRN_RA_CACHE_INIT((grn_ra *)column, &(program->columns[i].cache));
+  return program->n_columns++;
+}
+
+static grn_bool
+grn_expr_program_emit_into(grn_expr_program_compiler *compiler,
+                           int node_index, int dst);
+
+/* Returns the register that has the value of the node. */
+static int
+grn_expr_program_emit_operand(grn_expr_program_compiler *compiler,
+                              int node_index,
+                              grn_expr_program_type operand_type)
+{
+  grn_expr_program_node *node = compiler->nodes + node_index;
+  int reg;
+
+  reg = grn_expr_program_new_register(compiler);
+  if (reg < 0) {
+    return -1;
+  }
+
+  if (node->op == GRN_OP_PUSH) {
+    grn_expr_program_register *constant;
+    constant = compiler->program->registers + reg;
+    if (operand_type == GRN_EXPR_PROGRAM_TYPE_FLOAT &&
+        node->type != GRN_EXPR_PROGRAM_TYPE_FLOAT) {
+      constant->f = (double)(node->constant.i);
+    } else {
+      *constant = node->constant;
+    }
+    return reg;
+  }
+
+  if (!grn_expr_program_emit_into(compiler, node_index, reg)) {
+    return -1;
+  }
+  if (operand_type == GRN_EXPR_PROGRAM_TYPE_FLOAT &&
+      node->type != GRN_EXPR_PROGRAM_TYPE_FLOAT) {
+    if (grn_expr_program_emit(compiler, GRN_EXPR_PROGRAM_OP_INT_TO_FLOAT,
+                              reg, reg, 0) < 0) {
+      return -1;
+    }
+  }
+  return reg;
+}
+
+static grn_expr_program_op
+grn_expr_program_binary_op(grn_expr_program_node *node)
+{
+  grn_bool is_float = (node->operand_type == GRN_EXPR_PROGRAM_TYPE_FLOAT);
+
+  switch (node->op) {
+  case GRN_OP_EQUAL :
+    return is_float ?
+      GRN_EXPR_PROGRAM_OP_EQUAL_FLOAT : GRN_EXPR_PROGRAM_OP_EQUAL_INT;
+  case GRN_OP_NOT_EQUAL :
+    return is_float ?
+      GRN_EXPR_PROGRAM_OP_NOT_EQUAL_FLOAT : GRN_EXPR_PROGRAM_OP_NOT_EQUAL_INT;
+  case GRN_OP_LESS :
+    return is_float ?
+      GRN_EXPR_PROGRAM_OP_LESS_FLOAT : GRN_EXPR_PROGRAM_OP_LESS_INT;
+  case GRN_OP_GREATER :
+    return is_float ?
+      GRN_EXPR_PROGRAM_OP_GREATER_FLOAT : GRN_EXPR_PROGRAM_OP_GREATER_INT;
+  case GRN_OP_LESS_EQUAL :
+    return is_float ?
+      GRN_EXPR_PROGRAM_OP_LESS_EQUAL_FLOAT :
+      GRN_EXPR_PROGRAM_OP_LESS_EQUAL_INT;
+  case GRN_OP_GREATER_EQUAL :
+    return is_float ?
+      GRN_EXPR_PROGRAM_OP_GREATER_EQUAL_FLOAT :
+      GRN_EXPR_PROGRAM_OP_GREATER_EQUAL_INT;
+  case GRN_OP_PLUS :
+    if (is_float) {
+      return GRN_EXPR_PROGRAM_OP_PLUS_FLOAT;
+    } else if (node->domain == GRN_DB_INT32) {
+      return GRN_EXPR_PROGRAM_OP_PLUS_INT32;
+    } else {
+      return GRN_EXPR_PROGRAM_OP_PLUS_INT64;
+    }
+  case GRN_OP_MINUS :
+    if (is_float) {
+      return GRN_EXPR_PROGRAM_OP_MINUS_FLOAT;
+    } else if (node->domain == GRN_DB_INT32) {
+      return GRN_EXPR_PROGRAM_OP_MINUS_INT32;
+    } else {
+      return GRN_EXPR_PROGRAM_OP_MINUS_INT64;
+    }
+  default :
+    if (is_float) {
+      return GRN_EXPR_PROGRAM_OP_STAR_FLOAT;
+    } else if (node->domain == GRN_DB_INT32) {
+      return GRN_EXPR_PROGRAM_OP_STAR_INT32;
+    } else {
+      return GRN_EXPR_PROGRAM_OP_STAR_INT64;
+    }
+  }
+}
+
+static grn_expr_program_op
+grn_expr_program_load_op(grn_id domain)
+{
+  switch (domain) {
+  case GRN_DB_BOOL :
+    return GRN_EXPR_PROGRAM_OP_LOAD_BOOL;
+  case GRN_DB_INT8 :
+    return GRN_EXPR_PROGRAM_OP_LOAD_INT8;
+  case GRN_DB_UINT8 :
+    return GRN_EXPR_PROGRAM_OP_LOAD_UINT8;
+  case GRN_DB_INT16 :
+    return GRN_EXPR_PROGRAM_OP_LOAD_INT16;
+  case GRN_DB_UINT16 :
+    return GRN_EXPR_PROGRAM_OP_LOAD_UINT16;
+  case GRN_DB_INT32 :
+    return GRN_EXPR_PROGRAM_OP_LOAD_INT32;
+  case GRN_DB_FLOAT :
+    return GRN_EXPR_PROGRAM_OP_LOAD_FLOAT;
+  default :
+    /* GRN_DB_INT64 and GRN_DB_TIME */
+    return GRN_EXPR_PROGRAM_OP_LOAD_INT64;
+  }
+}
+
+/* Emits instructions that set the value of the node to dst. */
+static grn_bool
+grn_expr_program_emit_into(grn_expr_program_compiler *compiler,
+                           int node_index, int dst)
+{
+  grn_expr_program_node *node = compiler->nodes + node_index;
+  int x, y, jump;
+
+  switch (node->op) {
+  case GRN_OP_GET_VALUE :
+    x = grn_expr_program_column_index(compiler, node->value);
+    if (x < 0) {
+      return GRN_FALSE;
+    }
+    return grn_expr_program_emit(compiler,
+                                 grn_expr_program_load_op(node->domain),
+                                 dst, x, 0) >= 0;
+  case GRN_OP_PUSH :
+    x = grn_expr_program_emit_operand(compiler, node_index, node->type);
+    if (x < 0) {
+      return GRN_FALSE;
+    }
+    return grn_expr_program_emit(compiler, GRN_EXPR_PROGRAM_OP_MOVE,
+                                 dst, x, 0) >= 0;
+  case GRN_OP_AND :
+  case GRN_OP_OR :
+    /* The right hand side isn't evaluated when the left hand side
+       decides the result. It's evaluated into another register and
+       combined with the left hand side because the jump is taken only
+       when the left hand side decides the results of all records in
+       grn_expr_program_exec_batch(). */
+    if (!grn_expr_program_emit_into(compiler, node->args[0], dst)) {
+      return GRN_FALSE;
+    }
+    jump = grn_expr_program_emit(compiler,
+                                 node->op == GRN_OP_AND ?
+                                 GRN_EXPR_PROGRAM_OP_JUMP_IF_FALSE :
+                                 GRN_EXPR_PROGRAM_OP_JUMP_IF_TRUE,
+                                 0, dst, 0);
+    if (jump < 0) {
+      return GRN_FALSE;
+    }
+    y = grn_expr_program_new_register(compiler);
+    if (y < 0) {
+      return GRN_FALSE;
+    }
+    if (!grn_expr_program_emit_into(compiler, node->args[1], y)) {
+      return GRN_FALSE;
+    }
+    if (grn_expr_program_emit(compiler,
+                              node->op == GRN_OP_AND ?
+                              GRN_EXPR_PROGRAM_OP_AND :
+                              GRN_EXPR_PROGRAM_OP_OR,
+                              dst, dst, y) < 0) {
+      return GRN_FALSE;
+    }
+    compiler->program->instructions[jump].target =
+      compiler->program->n_instructions;
+    return GRN_TRUE;
+  case GRN_OP_NOT :
+    if (!grn_expr_program_emit_into(compiler, node->args[0], dst)) {
+      return GRN_FALSE;
+    }
+    return grn_expr_program_emit(compiler, GRN_EXPR_PROGRAM_OP_NOT,
+                                 dst, dst, 0) >= 0;
+  default :
+    x = grn_expr_program_emit_operand(compiler, node->args[0],
+                                      node->operand_type);
+    if (x < 0) {
+      return GRN_FALSE;
+    }
+    y = grn_expr_program_emit_operand(compiler, node->args[1],
+                                      node->operand_type);
+    if (y < 0) {
+      return GRN_FALSE;
+    }
+    return grn_expr_program_emit(compiler,
+                                 grn_expr_program_binary_op(node),
+                                 dst, x, y) >= 0;
+  }
+}
+
+grn_expr_program *
+grn_expr_program_open(grn_ctx *ctx, grn_obj *table, grn_obj *expr)
+{
+  grn_expr_program_compiler *compiler;
+  grn_expr_program *program;
+  int root, result;
+
+  if (!grn_expr_program_enabled) {
+    return NULL;
+  }
+  if (expr->header.type != GRN_EXPR) {
+    return NULL;
+  }
+
+  compiler = GRN_MALLOC(sizeof(grn_expr_program_compiler));
+  if (!compiler) {
+    ERRCLR(ctx);
+    return NULL;
+  }
+  program = GRN_MALLOC(sizeof(grn_expr_program));
+  if (!program) {
+    ERRCLR(ctx);
+    GRN_FREE(compiler);
+    return NULL;
+  }
+  program->n_instructions = 0;
+  program->n_registers = 0;
+  program->n_columns = 0;
+  program->batch_registers = NULL;
+
+  compiler->ctx = ctx;
+  compiler->table = table;
+  compiler->program = program;
+  compiler->n_nodes = 0;
+
+  root = grn_expr_program_parse(compiler, expr);
+  if (root < 0) {
+    goto error;
+  }
+  result = grn_expr_program_new_register(compiler);
+  if (result < 0) {
+    goto error;
+  }
+  if (!grn_expr_program_emit_into(compiler, root, result)) {
+    goto error;
+  }
+  if (grn_expr_program_emit(compiler, GRN_EXPR_PROGRAM_OP_RETURN,
+                            0, result, 0) < 0) {
+    goto error;
+  }
+
+  program->batch_registers =
+    GRN_MALLOC(sizeof(grn_expr_program_register) *
+               program->n_registers * GRN_EXPR_PROGRAM_BATCH_SIZE);
+  if (!program->batch_registers) {
+    ERRCLR(ctx);
+    goto error;
+  }
+  {
+    int i, j;
+    /* Constants are never overwritten. */
+    for (i = 0; i < program->n_registers; i++) {
+      grn_expr_program_register *batch_register;
+      batch_register = program->batch_registers +
+        i * GRN_EXPR_PROGRAM_BATCH_SIZE;
+      for (j = 0; j < GRN_EXPR_PROGRAM_BATCH_SIZE; j++) {
+        batch_register[j] = program->registers[i];
+      }
+    }
+  }
+
+  GRN_FREE(compiler);
+  return program;
+
+error :
+  GRN_FREE(compiler);
+  grn_expr_program_close(ctx, program);
+  return NULL;
+}
+
+void
+grn_expr_program_close(grn_ctx *ctx, grn_expr_program *program)
+{
+  int i;
+
+  if (!program) {
+    return;
+  }
+  for (i = 0; i < program->n_columns; i++) {
+    GRN_RA_CACHE_FIN(program->columns[i].ra, &(program->columns[i].cache));
+  }
+  if (program->batch_registers) {
+    GRN_FREE(program->batch_registers);
+  }
+  GRN_FREE(program);
+}
+
+static inline const void *
+grn_expr_program_column_ref(grn_ctx *ctx, grn_expr_program *program,
+                            int column_index, grn_id id)
+{
+  grn_expr_program_column *column = program->columns + column_index;
+  return grn_ra_ref_cache(ctx, column->ra, id, &(column->cache));
+}
+
+#define GRN_EXPR_PROGRAM_LOAD(type, member, value) do {                 \
+  const void *raw_value_;                                               \
+  raw_value_ = grn_expr_program_column_ref(ctx, program, pc->x, id);    \
+  if (raw_value_) {                                                     \
+    type value_;                                                        \
+    grn_memcpy(&value_, raw_value_, sizeof(type));                      \
+    registers[pc->dst].member = (value);                                \
+  } else {                                                              \
+    registers[pc->dst].member = 0;                                      \
+  }                                                                     \
+} while (0)
+
+#define GRN_EXPR_PROGRAM_COMPARE(member, op) do {                       \
+  registers[pc->dst].i =                                                \
+    (registers[pc->x].member op registers[pc->y].member);               \
+} while (0)
+
+/* Integer operations wrap around like grn_expr_exec(). */
+#define GRN_EXPR_PROGRAM_INT_OPERATION(type, op) do {                   \
+  registers[pc->dst].i =                                                \
+    (type)((uint64_t)registers[pc->x].i op (uint64_t)registers[pc->y].i); \
+} while (0)
+
+#define GRN_EXPR_PROGRAM_FLOAT_OPERATION(op) do {                       \
+  registers[pc->dst].f = registers[pc->x].f op registers[pc->y].f;      \
+} while (0)
+
+#ifdef GRN_EXPR_PROGRAM_USE_COMPUTED_GOTO
+# define GRN_EXPR_PROGRAM_DISPATCH() goto *labels[pc->op]
+# define GRN_EXPR_PROGRAM_CASE(name) op_ ## name :
+# define GRN_EXPR_PROGRAM_SWITCH_END()
+#else
+# define GRN_EXPR_PROGRAM_DISPATCH() goto dispatch
+# define GRN_EXPR_PROGRAM_CASE(name) case GRN_EXPR_PROGRAM_OP_ ## name :
+# define GRN_EXPR_PROGRAM_SWITCH_END() default : break; }
+#endif
+
+#define GRN_EXPR_PROGRAM_NEXT() do {            \
+  pc++;                                         \
+  GRN_EXPR_PROGRAM_DISPATCH();                  \
+} while (0)
+
+#define GRN_EXPR_PROGRAM_JUMP(target_) do {     \
+  pc = program->instructions + (target_);       \
+  GRN_EXPR_PROGRAM_DISPATCH();                  \
+} while (0)
+
+grn_bool
+grn_expr_program_exec(grn_ctx *ctx, grn_expr_program *program, grn_id id)
+{
+#ifdef GRN_EXPR_PROGRAM_USE_COMPUTED_GOTO
+# define GRN_EXPR_PROGRAM_OP_LABEL(name) &&op_ ## name,
+  static const void *labels[] = {
+    GRN_EXPR_PROGRAM_OPS(GRN_EXPR_PROGRAM_OP_LABEL)
+  };
+# undef GRN_EXPR_PROGRAM_OP_LABEL
+#endif
+  grn_expr_program_register *registers = program->registers;
+  grn_expr_program_instruction *pc = program->instructions;
+
+#ifdef GRN_EXPR_PROGRAM_USE_COMPUTED_GOTO
+  GRN_EXPR_PROGRAM_DISPATCH();
+#else
+dispatch :
+  switch (pc->op) {
+#endif
+  GRN_EXPR_PROGRAM_CASE(LOAD_BOOL)
+    GRN_EXPR_PROGRAM_LOAD(unsigned char, i, value_ ? 1 : 0);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(LOAD_INT8)
+    GRN_EXPR_PROGRAM_LOAD(int8_t, i, value_);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(LOAD_UINT8)
+    GRN_EXPR_PROGRAM_LOAD(uint8_t, i, value_);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(LOAD_INT16)
+    GRN_EXPR_PROGRAM_LOAD(int16_t, i, value_);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(LOAD_UINT16)
+    GRN_EXPR_PROGRAM_LOAD(uint16_t, i, value_);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(LOAD_INT32)
+    GRN_EXPR_PROGRAM_LOAD(int32_t, i, value_);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(LOAD_INT64)
+    GRN_EXPR_PROGRAM_LOAD(int64_t, i, value_);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(LOAD_FLOAT)
+    GRN_EXPR_PROGRAM_LOAD(double, f, value_);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(MOVE)
+    registers[pc->dst] = registers[pc->x];
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(INT_TO_FLOAT)
+    registers[pc->dst].f = (double)(registers[pc->x].i);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(EQUAL_INT)
+    GRN_EXPR_PROGRAM_COMPARE(i, ==);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(NOT_EQUAL_INT)
+    GRN_EXPR_PROGRAM_COMPARE(i, !=);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(LESS_INT)
+    GRN_EXPR_PROGRAM_COMPARE(i, <);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(GREATER_INT)
+    GRN_EXPR_PROGRAM_COMPARE(i, >);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(LESS_EQUAL_INT)
+    GRN_EXPR_PROGRAM_COMPARE(i, <=);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(GREATER_EQUAL_INT)
+    GRN_EXPR_PROGRAM_COMPARE(i, >=);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(EQUAL_FLOAT)
+    GRN_EXPR_PROGRAM_COMPARE(f, ==);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(NOT_EQUAL_FLOAT)
+    GRN_EXPR_PROGRAM_COMPARE(f, !=);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(LESS_FLOAT)
+    GRN_EXPR_PROGRAM_COMPARE(f, <);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(GREATER_FLOAT)
+    GRN_EXPR_PROGRAM_COMPARE(f, >);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(LESS_EQUAL_FLOAT)
+    GRN_EXPR_PROGRAM_COMPARE(f, <=);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(GREATER_EQUAL_FLOAT)
+    GRN_EXPR_PROGRAM_COMPARE(f, >=);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(PLUS_INT32)
+    GRN_EXPR_PROGRAM_INT_OPERATION(int32_t, +);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(MINUS_INT32)
+    GRN_EXPR_PROGRAM_INT_OPERATION(int32_t, -);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(STAR_INT32)
+    GRN_EXPR_PROGRAM_INT_OPERATION(int32_t, *);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(PLUS_INT64)
+    GRN_EXPR_PROGRAM_INT_OPERATION(int64_t, +);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(MINUS_INT64)
+    GRN_EXPR_PROGRAM_INT_OPERATION(int64_t, -);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(STAR_INT64)
+    GRN_EXPR_PROGRAM_INT_OPERATION(int64_t, *);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(PLUS_FLOAT)
+    GRN_EXPR_PROGRAM_FLOAT_OPERATION(+);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(MINUS_FLOAT)
+    GRN_EXPR_PROGRAM_FLOAT_OPERATION(-);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(STAR_FLOAT)
+    GRN_EXPR_PROGRAM_FLOAT_OPERATION(*);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(NOT)
+    registers[pc->dst].i = !registers[pc->x].i;
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(AND)
+    registers[pc->dst].i = (registers[pc->x].i && registers[pc->y].i);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(OR)
+    registers[pc->dst].i = (registers[pc->x].i || registers[pc->y].i);
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(JUMP_IF_FALSE)
+    if (!registers[pc->x].i) {
+      GRN_EXPR_PROGRAM_JUMP(pc->target);
+    }
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(JUMP_IF_TRUE)
+    if (registers[pc->x].i) {
+      GRN_EXPR_PROGRAM_JUMP(pc->target);
+    }
+    GRN_EXPR_PROGRAM_NEXT();
+  GRN_EXPR_PROGRAM_CASE(RETURN)
+    return registers[pc->x].i != 0;
+  GRN_EXPR_PROGRAM_SWITCH_END()
+
+  return GRN_FALSE;
+}
+
+#define GRN_EXPR_PROGRAM_BATCH_REGISTER(index)                          \
+  (program->batch_registers + (index) * GRN_EXPR_PROGRAM_BATCH_SIZE)
+
+#define GRN_EXPR_PROGRAM_BATCH_LOAD(type, member, value) do {           \
+  grn_expr_program_register *dst_ =                                     \
+    GRN_EXPR_PROGRAM_BATCH_REGISTER(pc->dst);                           \
+  for (i = 0; i < n_ids; i++) {                                         \
+    const void *raw_value_;                                             \
+    raw_value_ = grn_expr_program_column_ref(ctx, program, pc->x, ids[i]); \
+    if (raw_value_) {                                                   \
+      type value_;                                                      \
+      grn_memcpy(&value_, raw_value_, sizeof(type));                    \
+      dst_[i].member = (value);                                         \
+    } else {                                                            \
+      dst_[i].member = 0;                                               \
+    }                                                                   \
+  }                                                                     \
+} while (0)
+
+#define GRN_EXPR_PROGRAM_BATCH_APPLY_UNARY(statement) do {              \
+  grn_expr_program_register *dst_ =                                     \
+    GRN_EXPR_PROGRAM_BATCH_REGISTER(pc->dst);                           \
+  grn_expr_program_register *x_ =                                       \
+    GRN_EXPR_PROGRAM_BATCH_REGISTER(pc->x);                             \
+  for (i = 0; i < n_ids; i++) {                                         \
+    statement;                                                          \
+  }                                                                     \
+} while (0)
+
+#define GRN_EXPR_PROGRAM_BATCH_APPLY(statement) do {                    \
+  grn_expr_program_register *dst_ =                                     \
+    GRN_EXPR_PROGRAM_BATCH_REGISTER(pc->dst);                           \
+  grn_expr_program_register *x_ =                                       \
+    GRN_EXPR_PROGRAM_BATCH_REGISTER(pc->x);                             \
+  grn_expr_program_register *y_ =                                       \
+    GRN_EXPR_PROGRAM_BATCH_REGISTER(pc->y);                             \
+  for (i = 0; i < n_ids; i++) {                                         \
+    statement;                                                          \
+  }                                                                     \
+} while (0)
+
+#define GRN_EXPR_PROGRAM_BATCH_COMPARE(member, op)                      \
+  GRN_EXPR_PROGRAM_BATCH_APPLY(dst_[i].i = (x_[i].member op y_[i].member))
+
+#define GRN_EXPR_PROGRAM_BATCH_INT_OPERATION(type, op)                  \
+  GRN_EXPR_PROGRAM_BATCH_APPLY(                                         \
+    dst_[i].i = (type)((uint64_t)x_[i].i op (uint64_t)y_[i].i))
+
+#define GRN_EXPR_PROGRAM_BATCH_FLOAT_OPERATION(op)                      \
+  GRN_EXPR_PROGRAM_BATCH_APPLY(dst_[i].f = x_[i].f op y_[i].f)
+
+/*
+  Each instruction is applied to all records before the next
+  instruction. Jumps are taken only when the left hand side of && or
+  || decides the results of all records.
+*/
+int
+grn_expr_program_exec_batch(grn_ctx *ctx, grn_expr_program *program,
+                            const grn_id *ids, int n_ids,
+                            grn_bool *results)
+{
+  grn_expr_program_instruction *pc = program->instructions;
+  int i;
+
+  for (;;) {
+    switch (pc->op) {
+    case GRN_EXPR_PROGRAM_OP_LOAD_BOOL :
+      GRN_EXPR_PROGRAM_BATCH_LOAD(unsigned char, i, value_ ? 1 : 0);
+      break;
+    case GRN_EXPR_PROGRAM_OP_LOAD_INT8 :
+      GRN_EXPR_PROGRAM_BATCH_LOAD(int8_t, i, value_);
+      break;
+    case GRN_EXPR_PROGRAM_OP_LOAD_UINT8 :
+      GRN_EXPR_PROGRAM_BATCH_LOAD(uint8_t, i, value_);
+      break;
+    case GRN_EXPR_PROGRAM_OP_LOAD_INT16 :
+      GRN_EXPR_PROGRAM_BATCH_LOAD(int16_t, i, value_);
+      break;
+    case GRN_EXPR_PROGRAM_OP_LOAD_UINT16 :
+      GRN_EXPR_PROGRAM_BATCH_LOAD(uint16_t, i, value_);
+      break;
+    case GRN_EXPR_PROGRAM_OP_LOAD_INT32 :
+      GRN_EXPR_PROGRAM_BATCH_LOAD(int32_t, i, value_);
+      break;
+    case GRN_EXPR_PROGRAM_OP_LOAD_INT64 :
+      GRN_EXPR_PROGRAM_BATCH_LOAD(int64_t, i, value_);
+      break;
+    case GRN_EXPR_PROGRAM_OP_LOAD_FLOAT :
+      GRN_EXPR_PROGRAM_BATCH_LOAD(double, f, value_);
+      break;
+    case GRN_EXPR_PROGRAM_OP_MOVE :
+      GRN_EXPR_PROGRAM_BATCH_APPLY_UNARY(dst_[i] = x_[i]);
+      break;
+    case GRN_EXPR_PROGRAM_OP_INT_TO_FLOAT :
+      GRN_EXPR_PROGRAM_BATCH_APPLY_UNARY(dst_[i].f = (double)(x_[i].i));
+      break;
+    case GRN_EXPR_PROGRAM_OP_EQUAL_INT :
+      GRN_EXPR_PROGRAM_BATCH_COMPARE(i, ==);
+      break;
+    case GRN_EXPR_PROGRAM_OP_NOT_EQUAL_INT :
+      GRN_EXPR_PROGRAM_BATCH_COMPARE(i, !=);
+      break;
+    case GRN_EXPR_PROGRAM_OP_LESS_INT :
+      GRN_EXPR_PROGRAM_BATCH_COMPARE(i, <);
+      break;
+    case GRN_EXPR_PROGRAM_OP_GREATER_INT :
+      GRN_EXPR_PROGRAM_BATCH_COMPARE(i, >);
+      break;
+    case GRN_EXPR_PROGRAM_OP_LESS_EQUAL_INT :
+      GRN_EXPR_PROGRAM_BATCH_COMPARE(i, <=);
+      break;
+    case GRN_EXPR_PROGRAM_OP_GREATER_EQUAL_INT :
+      GRN_EXPR_PROGRAM_BATCH_COMPARE(i, >=);
+      break;
+    case GRN_EXPR_PROGRAM_OP_EQUAL_FLOAT :
+      GRN_EXPR_PROGRAM_BATCH_COMPARE(f, ==);
+      break;
+    case GRN_EXPR_PROGRAM_OP_NOT_EQUAL_FLOAT :
+      GRN_EXPR_PROGRAM_BATCH_COMPARE(f, !=);
+      break;
+    case GRN_EXPR_PROGRAM_OP_LESS_FLOAT :
+      GRN_EXPR_PROGRAM_BATCH_COMPARE(f, <);
+      break;
+    case GRN_EXPR_PROGRAM_OP_GREATER_FLOAT :
+      GRN_EXPR_PROGRAM_BATCH_COMPARE(f, >);
+      break;
+    case GRN_EXPR_PROGRAM_OP_LESS_EQUAL_FLOAT :
+      GRN_EXPR_PROGRAM_BATCH_COMPARE(f, <=);
+      break;
+    case GRN_EXPR_PROGRAM_OP_GREATER_EQUAL_FLOAT :
+      GRN_EXPR_PROGRAM_BATCH_COMPARE(f, >=);
+      break;
+    case GRN_EXPR_PROGRAM_OP_PLUS_INT32 :
+      GRN_EXPR_PROGRAM_BATCH_INT_OPERATION(int32_t, +);
+      break;
+    case GRN_EXPR_PROGRAM_OP_MINUS_INT32 :
+      GRN_EXPR_PROGRAM_BATCH_INT_OPERATION(int32_t, -);
+      break;
+    case GRN_EXPR_PROGRAM_OP_STAR_INT32 :
+      GRN_EXPR_PROGRAM_BATCH_INT_OPERATION(int32_t, *);
+      break;
+    case GRN_EXPR_PROGRAM_OP_PLUS_INT64 :
+      GRN_EXPR_PROGRAM_BATCH_INT_OPERATION(int64_t, +);
+      break;
+    case GRN_EXPR_PROGRAM_OP_MINUS_INT64 :
+      GRN_EXPR_PROGRAM_BATCH_INT_OPERATION(int64_t, -);
+      break;
+    case GRN_EXPR_PROGRAM_OP_STAR_INT64 :
+      GRN_EXPR_PROGRAM_BATCH_INT_OPERATION(int64_t, *);
+      break;
+    case GRN_EXPR_PROGRAM_OP_PLUS_FLOAT :
+      GRN_EXPR_PROGRAM_BATCH_FLOAT_OPERATION(+);
+      break;
+    case GRN_EXPR_PROGRAM_OP_MINUS_FLOAT :
+      GRN_EXPR_PROGRAM_BATCH_FLOAT_OPERATION(-);
+      break;
+    case GRN_EXPR_PROGRAM_OP_STAR_FLOAT :
+      GRN_EXPR_PROGRAM_BATCH_FLOAT_OPERATION(*);
+      break;
+    case GRN_EXPR_PROGRAM_OP_NOT :
+      GRN_EXPR_PROGRAM_BATCH_APPLY_UNARY(dst_[i].i = !x_[i].i);
+      break;
+    case GRN_EXPR_PROGRAM_OP_AND :
+      GRN_EXPR_PROGRAM_BATCH_APPLY(dst_[i].i = (x_[i].i && y_[i].i));
+      break;
+    case GRN_EXPR_PROGRAM_OP_OR :
+      GRN_EXPR_PROGRAM_BATCH_APPLY(dst_[i].i = (x_[i].i || y_[i].i));
+      break;
+    case GRN_EXPR_PROGRAM_OP_JUMP_IF_FALSE :
+      {
+        grn_expr_program_register *x = GRN_EXPR_PROGRAM_BATCH_REGISTER(pc->x);
+        for (i = 0; i < n_ids; i++) {
+          if (x[i].i) {
+            break;
+          }
+        }
+        if (i == n_ids) {
+          pc = program->instructions + pc->target;
+          continue;
+        }
+      }
+      break;
+    case GRN_EXPR_PROGRAM_OP_JUMP_IF_TRUE :
+      {
+        grn_expr_program_register *x = GRN_EXPR_PROGRAM_BATCH_REGISTER(pc->x);
+        for (i = 0; i < n_ids; i++) {
+          if (!x[i].i) {
+            break;
+          }
+        }
+        if (i == n_ids) {
+          pc = program->instructions + pc->target;
+          continue;
+        }
+      }
+      break;
+    case GRN_EXPR_PROGRAM_OP_RETURN :
+      {
+        grn_expr_program_register *x = GRN_EXPR_PROGRAM_BATCH_REGISTER(pc->x);
+        int n_matched = 0;
+        for (i = 0; i < n_ids; i++) {
+          results[i] = (x[i].i != 0);
+          if (results[i]) {
+            n_matched++;
+          }
+        }
+        return n_matched;
+      }
+    default :
+      return 0;
+    }
+    pc++;
+  }
+}
@@ -17,11 +17,17 @@
 
 #include "grn_geo.h"
 #include "grn_pat.h"
+#include "grn_store.h"
 #include "grn_util.h"
 
 #include <string.h>
 #include <stdlib.h>
 
+#if defined(__AVX2__)
+# define GRN_GEO_USE_AVX2
+# include <immintrin.h>
+#endif
+
 #define GRN_GEO_POINT_IN_NORTH_EAST(point) \
   ((point)->latitude >= 0 && (point)->longitude >= 0)
 #define GRN_GEO_POINT_IN_NORTH_WEST(point) \
@@ -254,82 +260,6 @@ inspect_cursor_entry_targets(grn_ctx *ctx, grn_geo_cursor_entry *entry,
 #  define inspect_cursor_entry_targets(...)
 #endif
 
-static int
-grn_geo_table_sort_detect_far_point(grn_ctx *ctx, grn_obj *table, grn_obj *index,
-                                    grn_pat *pat, geo_entry *entries,
-                                    grn_pat_cursor *pc, int n,
-                                    grn_bool accessorp,
-                                    grn_geo_point *base_point,
-                                    double *d_far, int *diff_bit)
-{
-  int i = 0, diff_bit_prev, diff_bit_current;
-  grn_id tid;
-  geo_entry *ep, *p;
-  double d;
-  uint8_t geo_key_prev[sizeof(grn_geo_point)];
-  uint8_t geo_key_curr[sizeof(grn_geo_point)];
-  grn_geo_point point;
-
-  *d_far = 0.0;
-  grn_gton(geo_key_curr, base_point, sizeof(grn_geo_point));
-  *diff_bit = sizeof(grn_geo_point) * 8;
-  diff_bit_current = sizeof(grn_geo_point) * 8;
-  grn_memcpy(&point, base_point, sizeof(grn_geo_point));
-  ep = entries;
-  inspect_mesh(ctx, &point, *diff_bit, -1);
-  while ((tid = grn_pat_cursor_next(ctx, pc))) {
-    grn_ii_cursor *ic = grn_ii_cursor_open(ctx, (grn_ii *)index, tid, 0, 0, 1, 0);
-    if (ic) {
-      grn_ii_posting *posting;
-      grn_gton(geo_key_prev, &point, sizeof(grn_geo_point));
-      grn_pat_get_key(ctx, pat, tid, &point, sizeof(grn_geo_point));
-      grn_gton(geo_key_curr, &point, sizeof(grn_geo_point));
-      d = grn_geo_distance_rectangle_raw(ctx, base_point, &point);
-      inspect_tid(ctx, tid, &point, d);
-
-      diff_bit_prev = diff_bit_current;
-      diff_bit_current = compute_diff_bit(geo_key_curr, geo_key_prev);
-#ifdef GEO_DEBUG
-      printf("diff: %d:%d:%d\n", *diff_bit, diff_bit_prev, diff_bit_current);
-#endif
-      if ((diff_bit_current % 2) == 1) {
-        diff_bit_current--;
-      }
-      if (diff_bit_current < diff_bit_prev && *diff_bit > diff_bit_current) {
-        if (i == n) {
-          grn_ii_cursor_close(ctx, ic);
-          break;
-        }
-        *diff_bit = diff_bit_current;
-      }
-
-      if (d > *d_far) {
-        *d_far = d;
-      }
-      while ((posting = grn_ii_cursor_next(ctx, ic))) {
-        grn_id rid = accessorp
-          ? grn_table_get(ctx, table, &posting->rid, sizeof(grn_id))
-          : posting->rid;
-        if (rid) {
-          for (p = ep; entries < p && p[-1].d > d; p--) {
-            p->id = p[-1].id;
-            p->d = p[-1].d;
-          }
-          p->id = rid;
-          p->d = d;
-          if (i < n) {
-            ep++;
-            i++;
-          }
-        }
-      }
-      grn_ii_cursor_close(ctx, ic);
-    }
-  }
-
-  return i;
-}
-
 typedef enum {
   MESH_LEFT_TOP,
   MESH_RIGHT_TOP,
@@ -522,64 +452,300 @@ grn_geo_get_meshes_for_circle(grn_ctx *ctx, grn_geo_point *base_point,
   return n_meshes;
 }
 
+/*
+  Nearest neighbor search: nodes of the patricia trie of an index are
+  visited in ascending order of the lower bound of the distance from
+  the base point. A branch of the trie covers a mesh that is given by
+  the common prefix of its keys. Its lower bound is the distance to the
+  nearest point in the mesh. So keys are found in ascending order of
+  their distances without collecting and sorting points around the base
+  point.
+*/
+typedef struct {
+  double d;
+  grn_id id;
+  /* the check of the parent node: the node is a leaf when its check
+     isn't larger than this. */
+  int check;
+  /* whether d is the distance of the key instead of a lower bound */
+  grn_bool exact;
+} geo_nearest_entry;
+
+typedef struct {
+  geo_nearest_entry *entries;
+  int n_entries;
+  int size;
+} geo_nearest_queue;
+
+static inline grn_bool
+geo_nearest_entry_less(geo_nearest_entry *entry1, geo_nearest_entry *entry2)
+{
+  if (entry1->d != entry2->d) {
+    return entry1->d < entry2->d;
+  }
+  return entry1->id < entry2->id;
+}
+
+static grn_bool
+geo_nearest_queue_push(grn_ctx *ctx, geo_nearest_queue *queue,
+                       double d, grn_id id, int check, grn_bool exact)
+{
+  geo_nearest_entry entry;
+  int i;
+
+  if (queue->n_entries == queue->size) {
+    int new_size = queue->size ? queue->size * 2 : 256;
+    geo_nearest_entry *entries;
+    entries = GRN_REALLOC(queue->entries,
+                          sizeof(geo_nearest_entry) * new_size);
+    if (!entries) {
+      return GRN_FALSE;
+    }
+    queue->entries = entries;
+    queue->size = new_size;
+  }
+
+  entry.d = d;
+  entry.id = id;
+  entry.check = check;
+  entry.exact = exact;
+  i = queue->n_entries++;
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (!geo_nearest_entry_less(&entry, queue->entries + parent)) {
+      break;
+    }
+    queue->entries[i] = queue->entries[parent];
+    i = parent;
+  }
+  queue->entries[i] = entry;
+  return GRN_TRUE;
+}
+
+static void
+geo_nearest_queue_pop(geo_nearest_queue *queue, geo_nearest_entry *entry)
+{
+  geo_nearest_entry last;
+  int i, n_entries;
+
+  *entry = queue->entries[0];
+  n_entries = --queue->n_entries;
+  if (n_entries == 0) {
+    return;
+  }
+  last = queue->entries[n_entries];
+  i = 0;
+  for (;;) {
+    int child = i * 2 + 1;
+    if (child >= n_entries) {
+      break;
+    }
+    if (child + 1 < n_entries &&
+        geo_nearest_entry_less(queue->entries + child + 1,
+                               queue->entries + child)) {
+      child++;
+    }
+    if (!geo_nearest_entry_less(queue->entries + child, &last)) {
+      break;
+    }
+    queue->entries[i] = queue->entries[child];
+    i = child;
+  }
+  queue->entries[i] = last;
+}
+
+/*
+  It's never larger than grn_geo_distance_rectangle_raw() from the base
+  point to any point in the mesh [min, max].
+*/
+static double
+geo_distance_rectangle_lower_bound(grn_geo_point *base_point,
+                                   grn_geo_point *min, grn_geo_point *max)
+{
+  const int64_t full_longitude = (int64_t)GRN_GEO_RESOLUTION * 360;
+  int64_t latitude_delta, longitude_delta;
+  double latitude_mid_min, latitude_mid_max, cos_max;
+  double x, y;
+
+  if (base_point->latitude < min->latitude) {
+    latitude_delta = (int64_t)min->latitude - base_point->latitude;
+  } else if (base_point->latitude > max->latitude) {
+    latitude_delta = (int64_t)base_point->latitude - max->latitude;
+  } else {
+    latitude_delta = 0;
+  }
+
+  if (min->longitude <= base_point->longitude &&
+      base_point->longitude <= max->longitude) {
+    longitude_delta = 0;
+  } else {
+    int64_t east, west;
+    east = ((int64_t)min->longitude - base_point->longitude) % full_longitude;
+    if (east < 0) {
+      east += full_longitude;
+    }
+    west = ((int64_t)base_point->longitude - max->longitude) % full_longitude;
+    if (west < 0) {
+      west += full_longitude;
+    }
+    longitude_delta = (east < west) ? east : west;
+  }
+
+  /* The longitude distance is scaled by the cosine of the mid latitude
+     of two points. Use the largest one in the mesh. */
+  latitude_mid_min =
+    GRN_GEO_INT2RAD(((double)base_point->latitude + min->latitude) * 0.5);
+  latitude_mid_max =
+    GRN_GEO_INT2RAD(((double)base_point->latitude + max->latitude) * 0.5);
+  if (latitude_mid_min <= 0.0 && 0.0 <= latitude_mid_max) {
+    cos_max = 1.0;
+  } else if (fabs(latitude_mid_min) < fabs(latitude_mid_max)) {
+    cos_max = cos(latitude_mid_min);
+  } else {
+    cos_max = cos(latitude_mid_max);
+  }
+
+  x = GRN_GEO_INT2RAD((double)longitude_delta) * cos_max;
+  y = GRN_GEO_INT2RAD((double)latitude_delta);
+  /* Shrink a little for rounding errors. It must not be larger than
+     the distance of any key in the mesh. */
+  return sqrt((x * x) + (y * y)) * GRN_GEO_RADIUS * (1.0 - 1e-9);
+}
+
+static grn_bool
+geo_nearest_push_children(grn_ctx *ctx, geo_nearest_queue *queue,
+                          grn_geo_point *base_point,
+                          grn_pat_node_info *node)
+{
+  int i, n_bits;
+  uint8_t prefix[sizeof(grn_geo_point)];
+
+  n_bits = node->check >> 1;
+  if (node->key_size != sizeof(grn_geo_point) ||
+      n_bits >= GRN_GEO_KEY_MAX_BITS) {
+    return GRN_FALSE;
+  }
+  grn_memcpy(prefix, node->key, sizeof(grn_geo_point));
+  for (i = 0; i < 2; i++) {
+    grn_geo_point min, max;
+    uint8_t key_min[sizeof(grn_geo_point)];
+    uint8_t key_max[sizeof(grn_geo_point)];
+    int prefix_size = n_bits;
+    double d;
+
+    if (!node->children[i]) {
+      continue;
+    }
+    if (!(node->check & 1)) {
+      uint8_t mask = 0x80 >> (n_bits % 8);
+      if (i == 0) {
+        prefix[n_bits / 8] &= ~mask;
+      } else {
+        prefix[n_bits / 8] |= mask;
+      }
+      prefix_size++;
+    }
+    compute_min_and_max_key(prefix, prefix_size, key_min, key_max);
+    grn_ntog((uint8_t *)&min, key_min, sizeof(grn_geo_point));
+    grn_ntog((uint8_t *)&max, key_max, sizeof(grn_geo_point));
+    d = geo_distance_rectangle_lower_bound(base_point, &min, &max);
+    if (!geo_nearest_queue_push(ctx, queue, d, node->children[i],
+                                node->check, GRN_FALSE)) {
+      return GRN_FALSE;
+    }
+  }
+  return GRN_TRUE;
+}
+
+/*
+  Collects n records that are nearest to base_point in ascending order
+  of their distances.
+*/
 static int
-grn_geo_table_sort_collect_points(grn_ctx *ctx, grn_obj *table, grn_obj *index,
-                                  grn_pat *pat,
-                                  geo_entry *entries, int n_entries,
-                                  int n, grn_bool accessorp,
-                                  grn_geo_point *base_point,
-                                  double d_far, int diff_bit)
+grn_geo_table_sort_collect_nearest_points(grn_ctx *ctx,
+                                          grn_obj *table,
+                                          grn_obj *index,
+                                          grn_pat *pat,
+                                          geo_entry *entries,
+                                          int n,
+                                          grn_bool accessorp,
+                                          grn_geo_point *base_point)
 {
-  int n_meshes;
-  mesh_entry meshes[86];
-  geo_entry *ep, *p;
+  int n_entries = 0;
+  geo_nearest_queue queue;
+  geo_nearest_entry entry;
+  grn_id root;
 
-  n_meshes = grn_geo_get_meshes_for_circle(ctx, base_point, d_far, diff_bit,
-                                           GRN_FALSE, meshes);
+  queue.entries = NULL;
+  queue.n_entries = 0;
+  queue.size = 0;
 
-  ep = entries + n_entries;
-  while (n_meshes--) {
-    grn_id tid;
-    grn_pat_cursor *pc = grn_pat_cursor_open(ctx, pat,
-                                             &(meshes[n_meshes].key),
-                                             meshes[n_meshes].key_size,
-                                             NULL, 0,
-                                             0, -1,
-                                             GRN_CURSOR_PREFIX|GRN_CURSOR_SIZE_BY_BIT);
-    inspect_mesh_entry(ctx, meshes, n_meshes);
-    if (pc) {
-      while ((tid = grn_pat_cursor_next(ctx, pc))) {
-        grn_ii_cursor *ic = grn_ii_cursor_open(ctx, (grn_ii *)index, tid, 0, 0, 1, 0);
-        if (ic) {
-          double d;
-          grn_geo_point pos;
-          grn_ii_posting *posting;
-          grn_pat_get_key(ctx, pat, tid, &pos, sizeof(grn_geo_point));
-          d = grn_geo_distance_rectangle_raw(ctx, base_point, &pos);
-          inspect_tid(ctx, tid, &pos, d);
-          while ((posting = grn_ii_cursor_next(ctx, ic))) {
-            grn_id rid = accessorp
-              ? grn_table_get(ctx, table, &posting->rid, sizeof(grn_id))
-              : posting->rid;
-            if (rid) {
-              for (p = ep; entries < p && p[-1].d > d; p--) {
-                p->id = p[-1].id;
-                p->d = p[-1].d;
-              }
-              p->id = rid;
-              p->d = d;
-              if (n_entries < n) {
-                ep++;
-                n_entries++;
-              }
-            }
+  root = grn_pat_root_node(ctx, pat);
+  if (root == GRN_ID_NIL) {
+    return 0;
+  }
+  /* The root node is always a branch. */
+  if (!geo_nearest_queue_push(ctx, &queue, 0.0, root, -1, GRN_FALSE)) {
+    return 0;
+  }
+
+  while (n_entries < n && queue.n_entries > 0) {
+    grn_pat_node_info node;
+
+    geo_nearest_queue_pop(&queue, &entry);
+    if (grn_pat_node_get_info(ctx, pat, entry.id, &node) != GRN_SUCCESS) {
+      break;
+    }
+
+    if (node.check > entry.check) {
+      if (!geo_nearest_push_children(ctx, &queue, base_point, &node)) {
+        break;
+      }
+      continue;
+    }
+
+    if (!entry.exact) {
+      grn_geo_point point;
+      double d;
+      grn_ntog((uint8_t *)&point, node.key, sizeof(grn_geo_point));
+      d = grn_geo_distance_rectangle_raw(ctx, base_point, &point);
+      inspect_tid(ctx, entry.id, &point, d);
+      entry.d = d;
+      entry.exact = GRN_TRUE;
+      if (queue.n_entries > 0 &&
+          geo_nearest_entry_less(queue.entries, &entry)) {
+        /* A nearer key may exist. */
+        if (!geo_nearest_queue_push(ctx, &queue, entry.d, entry.id,
+                                    entry.check, entry.exact)) {
+          break;
+        }
+        continue;
+      }
+    }
+
+    {
+      grn_ii_cursor *ic;
+      ic = grn_ii_cursor_open(ctx, (grn_ii *)index, entry.id, 0, 0, 1, 0);
+      if (ic) {
+        grn_ii_posting *posting;
+        while (n_entries < n && (posting = grn_ii_cursor_next(ctx, ic))) {
+          grn_id rid = accessorp
+            ? grn_table_get(ctx, table, &posting->rid, sizeof(grn_id))
+            : posting->rid;
+          if (rid) {
+            entries[n_entries].id = rid;
+            entries[n_entries].d = entry.d;
+            n_entries++;
           }
-          grn_ii_cursor_close(ctx, ic);
         }
+        grn_ii_cursor_close(ctx, ic);
       }
-      grn_pat_cursor_close(ctx, pc);
     }
   }
+
+  if (queue.entries) {
+    GRN_FREE(queue.entries);
+  }
   return n_entries;
 }
 
@@ -615,7 +781,6 @@ grn_geo_table_sort_by_distance(grn_ctx *ctx,
                                grn_obj *table,
                                grn_obj *index,
                                grn_pat *pat,
-                               grn_pat_cursor *pc,
                                grn_bool accessorp,
                                grn_geo_point *base_point,
                                int offset,
@@ -626,21 +791,14 @@ grn_geo_table_sort_by_distance(grn_ctx *ctx,
   geo_entry *entries;
 
   if ((entries = GRN_MALLOC(sizeof(geo_entry) * (e + 1)))) {
-    int n, diff_bit;
-    double d_far;
+    int n;
     geo_entry *ep;
     grn_bool need_not_indexed_records;
     grn_hash *indexed_records = NULL;
 
-    n = grn_geo_table_sort_detect_far_point(ctx, table, index, pat,
-                                            entries, pc, e, accessorp,
-                                            base_point,
-                                            &d_far, &diff_bit);
-    if (diff_bit > 0) {
-      n = grn_geo_table_sort_collect_points(ctx, table, index, pat,
-                                            entries, n, e, accessorp,
-                                            base_point, d_far, diff_bit);
-    }
+    n = grn_geo_table_sort_collect_nearest_points(ctx, table, index, pat,
+                                                  entries, e, accessorp,
+                                                  base_point);
     need_not_indexed_records = offset + limit > n;
     if (need_not_indexed_records) {
       indexed_records = grn_hash_create(ctx, NULL, sizeof(grn_id), 0,
@@ -684,6 +842,168 @@ grn_geo_table_sort_by_distance(grn_ctx *ctx,
   return n_entries;
 }
 
+#define GEO_SORT_BLOCK_SIZE 256
+
+static inline grn_bool
+geo_entry_less(geo_entry *entry1, geo_entry *entry2)
+{
+  if (entry1->d != entry2->d) {
+    return entry1->d < entry2->d;
+  }
+  return entry1->id < entry2->id;
+}
+
+static int
+geo_entry_compare(const void *entry1, const void *entry2)
+{
+  if (geo_entry_less((geo_entry *)entry1, (geo_entry *)entry2)) {
+    return -1;
+  } else if (geo_entry_less((geo_entry *)entry2, (geo_entry *)entry1)) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+/*
+  Adds points to entries that is a max heap of the n nearest points
+  found so far.
+*/
+static void
+geo_sort_add_points(grn_ctx *ctx,
+                    grn_geo_point *base_point,
+                    const grn_id *ids,
+                    const grn_geo_point *points,
+                    int n_points,
+                    geo_entry *entries,
+                    int *n_entries,
+                    int n)
+{
+  int i;
+  double distances[GEO_SORT_BLOCK_SIZE];
+
+  grn_geo_distance_rectangle_raw_batch(ctx, base_point, points, n_points,
+                                       distances);
+  for (i = 0; i < n_points; i++) {
+    geo_entry entry;
+    int current;
+    entry.id = ids[i];
+    entry.d = distances[i];
+    if (*n_entries < n) {
+      current = (*n_entries)++;
+      while (current > 0) {
+        int parent = (current - 1) / 2;
+        if (!geo_entry_less(entries + parent, &entry)) {
+          break;
+        }
+        entries[current] = entries[parent];
+        current = parent;
+      }
+      entries[current] = entry;
+    } else if (geo_entry_less(&entry, entries)) {
+      current = 0;
+      for (;;) {
+        int child = current * 2 + 1;
+        if (child >= n) {
+          break;
+        }
+        if (child + 1 < n && geo_entry_less(entries + child, entries + child + 1)) {
+          child++;
+        }
+        if (!geo_entry_less(&entry, entries + child)) {
+          break;
+        }
+        entries[current] = entries[child];
+        current = child;
+      }
+      entries[current] = entry;
+    }
+  }
+}
+
+/*
+  Sorts records by distance without index. Points are read a block at
+  a time and their distances are computed by the batch version. Only
+  the offset + limit nearest records are kept.
+*/
+static int
+grn_geo_table_sort_by_distance_without_index(grn_ctx *ctx,
+                                             grn_obj *table,
+                                             grn_obj *key,
+                                             grn_geo_point *base_point,
+                                             int offset,
+                                             int limit,
+                                             grn_obj *result)
+{
+  int i, n_entries = 0, n_points = 0, e = offset + limit;
+  geo_entry *entries;
+  grn_id ids[GEO_SORT_BLOCK_SIZE];
+  grn_geo_point points[GEO_SORT_BLOCK_SIZE];
+  grn_ra *ra = NULL;
+  grn_ra_cache cache;
+  grn_obj value;
+
+  if (e <= 0) {
+    return 0;
+  }
+  if (!(entries = GRN_MALLOC(sizeof(geo_entry) * e))) {
+    return 0;
+  }
+
+  if (key->header.type == GRN_COLUMN_FIX_SIZE) {
+    ra = (grn_ra *)key;
+    GRN_RA_CACHE_INIT(ra, &cache);
+  }
+  GRN_VOID_INIT(&value);
+  GRN_TABLE_EACH(ctx, table, GRN_ID_NIL, GRN_ID_MAX, id, NULL, NULL, NULL, {
+    grn_geo_point *point = points + n_points;
+    if (ra) {
+      void *raw_value = grn_ra_ref_cache(ctx, ra, id, &cache);
+      if (raw_value) {
+        *point = *((grn_geo_point *)raw_value);
+      } else {
+        point->latitude = 0;
+        point->longitude = 0;
+      }
+    } else {
+      GRN_BULK_REWIND(&value);
+      grn_obj_get_value(ctx, key, id, &value);
+      if (GRN_BULK_VSIZE(&value) == sizeof(grn_geo_point)) {
+        *point = *((grn_geo_point *)GRN_BULK_HEAD(&value));
+      } else {
+        point->latitude = 0;
+        point->longitude = 0;
+      }
+    }
+    ids[n_points++] = id;
+    if (n_points == GEO_SORT_BLOCK_SIZE) {
+      geo_sort_add_points(ctx, base_point, ids, points, n_points,
+                          entries, &n_entries, e);
+      n_points = 0;
+    }
+  });
+  if (n_points > 0) {
+    geo_sort_add_points(ctx, base_point, ids, points, n_points,
+                        entries, &n_entries, e);
+  }
+  GRN_OBJ_FIN(ctx, &value);
+  if (ra) {
+    GRN_RA_CACHE_FIN(ra, &cache);
+  }
+
+  qsort(entries, n_entries, sizeof(geo_entry), geo_entry_compare);
+  for (i = offset; i < n_entries; i++) {
+    grn_id *sorted_id;
+    if (!grn_array_add(ctx, (grn_array *)result, (void **)&sorted_id)) {
+      break;
+    }
+    *sorted_id = entries[i].id;
+  }
+  GRN_FREE(entries);
+
+  return i > offset ? i - offset : 0;
+}
+
 int
 grn_geo_table_sort(grn_ctx *ctx, grn_obj *table, int offset, int limit,
                    grn_obj *result, grn_table_sort_key *keys, int n_keys)
@@ -696,11 +1016,16 @@ grn_geo_table_sort(grn_ctx *ctx, grn_obj *table, int offset, int limit,
     grn_obj *arg = keys[1].key;
     grn_pat *pat = (grn_pat *)grn_ctx_at(ctx, index->header.domain);
     grn_id domain = pat->obj.header.domain;
-    grn_pat_cursor *pc = grn_pat_cursor_open(ctx, pat, NULL, 0,
-                                             GRN_BULK_HEAD(arg), GRN_BULK_VSIZE(arg),
-                                             0, -1, GRN_CURSOR_PREFIX);
-    if (pc) {
-      if (domain != GRN_DB_TOKYO_GEO_POINT && domain != GRN_DB_WGS84_GEO_POINT) {
+    if (domain == GRN_DB_TOKYO_GEO_POINT || domain == GRN_DB_WGS84_GEO_POINT) {
+      grn_geo_point *base_point = (grn_geo_point *)GRN_BULK_HEAD(arg);
+      i = grn_geo_table_sort_by_distance(ctx, table, index, pat,
+                                         accessorp, base_point,
+                                         offset, limit, result);
+    } else {
+      grn_pat_cursor *pc = grn_pat_cursor_open(ctx, pat, NULL, 0,
+                                               GRN_BULK_HEAD(arg), GRN_BULK_VSIZE(arg),
+                                               0, -1, GRN_CURSOR_PREFIX);
+      if (pc) {
         while (i < e && (tid = grn_pat_cursor_next(ctx, pc))) {
           grn_ii_cursor *ic = grn_ii_cursor_open(ctx, (grn_ii *)index, tid, 0, 0, 1, 0);
           if (ic) {
@@ -716,13 +1041,18 @@ grn_geo_table_sort(grn_ctx *ctx, grn_obj *table, int offset, int limit,
             grn_ii_cursor_close(ctx, ic);
           }
         }
-      } else {
-        grn_geo_point *base_point = (grn_geo_point *)GRN_BULK_HEAD(arg);
-        i = grn_geo_table_sort_by_distance(ctx, table, index, pat,
-                                           pc, accessorp, base_point,
-                                           offset, limit, result);
+        grn_pat_cursor_close(ctx, pc);
       }
-      grn_pat_cursor_close(ctx, pc);
+    }
+  } else if (n_keys == 2) {
+    grn_obj *arg = keys[1].key;
+    grn_id range = grn_obj_get_range(ctx, keys->key);
+    if ((range == GRN_DB_TOKYO_GEO_POINT || range == GRN_DB_WGS84_GEO_POINT) &&
+        GRN_BULK_VSIZE(arg) == sizeof(grn_geo_point)) {
+      grn_geo_point *base_point = (grn_geo_point *)GRN_BULK_HEAD(arg);
+      i = grn_geo_table_sort_by_distance_without_index(ctx, table, keys->key,
+                                                       base_point,
+                                                       offset, limit, result);
     }
   }
   return i;
@@ -2567,6 +2897,367 @@ grn_geo_distance_ellipsoid_raw_wgs84(grn_ctx *ctx,
                                         GRN_GEO_GRS_C3);
 }
 
+/*
+  Polynomial approximations used by grn_geo_distance_*_raw_batch().
+  They are truncated Taylor series evaluated by Horner's method. Their
+  absolute errors are bounded by the Lagrange remainders on the ranges
+  used by the distance formulas:
+
+    sin(x),  0 <= x <= pi/2: up to x^17: < 4.4e-14
+    cos(x), |x| <= pi/2:     up to x^18: < 3.5e-15
+    asin(x), 0 <= x <= 1/2:  up to x^35: < 3.5e-14
+
+  sin(x) for pi/2 < x <= pi uses sin(pi - x) and asin(x) for
+  1/2 < x <= 1 uses pi/2 - 2 * asin(sqrt((1 - x) / 2)), so the error of
+  asin() is less than 7.0e-14 on [0, 1]. The series are relatively
+  accurate for small x too. Relative errors of distances are less than
+  1e-13 except nearly antipodal points with the sphere approximation.
+  asin() is ill-conditioned near 1 and its relative error is less than
+  1e-10 (less than 1mm) there.
+*/
+static const double geo_batch_sin_coefficients[] = {
+  1.0,
+  -1.0 / 6.0,
+  1.0 / 120.0,
+  -1.0 / 5040.0,
+  1.0 / 362880.0,
+  -1.0 / 39916800.0,
+  1.0 / 6227020800.0,
+  -1.0 / 1307674368000.0,
+  1.0 / 355687428096000.0
+};
+
+static const double geo_batch_cos_coefficients[] = {
+  1.0,
+  -1.0 / 2.0,
+  1.0 / 24.0,
+  -1.0 / 720.0,
+  1.0 / 40320.0,
+  -1.0 / 3628800.0,
+  1.0 / 479001600.0,
+  -1.0 / 87178291200.0,
+  1.0 / 20922789888000.0,
+  -1.0 / 6402373705728000.0
+};
+
+/* (2n)! / (4^n * (n!)^2 * (2n + 1)) */
+static const double geo_batch_asin_coefficients[] = {
+  1.0,
+  1.0 / 6.0,
+  3.0 / 40.0,
+  5.0 / 112.0,
+  35.0 / 1152.0,
+  63.0 / 2816.0,
+  231.0 / 13312.0,
+  143.0 / 10240.0,
+  6435.0 / 557056.0,
+  12155.0 / 1245184.0,
+  46189.0 / 5505024.0,
+  88179.0 / 12058624.0,
+  676039.0 / 104857600.0,
+  1300075.0 / 226492416.0,
+  5014575.0 / 973078528.0,
+  9694845.0 / 2080374784.0,
+  100180065.0 / 23622320128.0,
+  116680311.0 / 30064771072.0
+};
+
+#define GEO_BATCH_N_COEFFICIENTS(coefficients) \
+  (sizeof(coefficients) / sizeof(double))
+
+static inline double
+geo_batch_polynomial(const double *coefficients, int n_coefficients, double t)
+{
+  int i;
+  double p = coefficients[n_coefficients - 1];
+  for (i = n_coefficients - 2; i >= 0; i--) {
+    p = p * t + coefficients[i];
+  }
+  return p;
+}
+
+/* 0 <= x <= pi */
+static inline double
+geo_batch_sin(double x)
+{
+  if (x > M_PI_2) {
+    x = M_PI - x;
+  }
+  return x * geo_batch_polynomial(geo_batch_sin_coefficients,
+                                  GEO_BATCH_N_COEFFICIENTS(geo_batch_sin_coefficients),
+                                  x * x);
+}
+
+/* -pi/2 <= x <= pi/2 */
+static inline double
+geo_batch_cos(double x)
+{
+  return geo_batch_polynomial(geo_batch_cos_coefficients,
+                              GEO_BATCH_N_COEFFICIENTS(geo_batch_cos_coefficients),
+                              x * x);
+}
+
+/* 0 <= x <= 1 */
+static inline double
+geo_batch_asin(double x)
+{
+  if (x > 0.5) {
+    double s = sqrt((1.0 - x) * 0.5);
+    return M_PI_2 - 2.0 * s *
+      geo_batch_polynomial(geo_batch_asin_coefficients,
+                           GEO_BATCH_N_COEFFICIENTS(geo_batch_asin_coefficients),
+                           s * s);
+  } else {
+    return x *
+      geo_batch_polynomial(geo_batch_asin_coefficients,
+                           GEO_BATCH_N_COEFFICIENTS(geo_batch_asin_coefficients),
+                           x * x);
+  }
+}
+
+#ifdef GRN_GEO_USE_AVX2
+# ifdef __FMA__
+#  define GEO_BATCH_MADD(a, b, c) _mm256_fmadd_pd((a), (b), (c))
+# else
+#  define GEO_BATCH_MADD(a, b, c) _mm256_add_pd(_mm256_mul_pd((a), (b)), (c))
+# endif
+
+static inline __m256d
+geo_batch_polynomial_avx2(const double *coefficients, int n_coefficients,
+                          __m256d t)
+{
+  int i;
+  __m256d p = _mm256_set1_pd(coefficients[n_coefficients - 1]);
+  for (i = n_coefficients - 2; i >= 0; i--) {
+    p = GEO_BATCH_MADD(p, t, _mm256_set1_pd(coefficients[i]));
+  }
+  return p;
+}
+
+static inline __m256d
+geo_batch_abs_avx2(__m256d x)
+{
+  return _mm256_andnot_pd(_mm256_set1_pd(-0.0), x);
+}
+
+static inline __m256d
+geo_batch_sin_avx2(__m256d x)
+{
+  __m256d over = _mm256_cmp_pd(x, _mm256_set1_pd(M_PI_2), _CMP_GT_OQ);
+  x = _mm256_blendv_pd(x, _mm256_sub_pd(_mm256_set1_pd(M_PI), x), over);
+  return _mm256_mul_pd(x,
+                       geo_batch_polynomial_avx2(geo_batch_sin_coefficients,
+                                                 GEO_BATCH_N_COEFFICIENTS(geo_batch_sin_coefficients),
+                                                 _mm256_mul_pd(x, x)));
+}
+
+static inline __m256d
+geo_batch_cos_avx2(__m256d x)
+{
+  return geo_batch_polynomial_avx2(geo_batch_cos_coefficients,
+                                   GEO_BATCH_N_COEFFICIENTS(geo_batch_cos_coefficients),
+                                   _mm256_mul_pd(x, x));
+}
+
+static inline __m256d
+geo_batch_asin_avx2(__m256d x)
+{
+  __m256d over = _mm256_cmp_pd(x, _mm256_set1_pd(0.5), _CMP_GT_OQ);
+  __m256d s = _mm256_sqrt_pd(_mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(1.0),
+                                                         x),
+                                           _mm256_set1_pd(0.5)));
+  __m256d u = _mm256_blendv_pd(x, s, over);
+  __m256d p;
+  p = _mm256_mul_pd(u,
+                    geo_batch_polynomial_avx2(geo_batch_asin_coefficients,
+                                              GEO_BATCH_N_COEFFICIENTS(geo_batch_asin_coefficients),
+                                              _mm256_mul_pd(u, u)));
+  return _mm256_blendv_pd(p,
+                          _mm256_sub_pd(_mm256_set1_pd(M_PI_2),
+                                        _mm256_add_pd(p, p)),
+                          over);
+}
+
+/* Loads 4 points as radians. */
+static inline void
+geo_batch_load_avx2(const grn_geo_point *points,
+                    __m256d *latitudes, __m256d *longitudes)
+{
+  const __m256d scale = _mm256_set1_pd(GRN_GEO_INT2RAD(1));
+  __m256i values;
+
+  values = _mm256_loadu_si256((const __m256i *)points);
+  values = _mm256_permutevar8x32_epi32(values,
+                                       _mm256_setr_epi32(0, 2, 4, 6,
+                                                         1, 3, 5, 7));
+  *latitudes =
+    _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(values)), scale);
+  *longitudes =
+    _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(values, 1)),
+                  scale);
+}
+#endif /* GRN_GEO_USE_AVX2 */
+
+void
+grn_geo_distance_rectangle_raw_batch(grn_ctx *ctx,
+                                     grn_geo_point *base_point,
+                                     const grn_geo_point *points,
+                                     int n_points,
+                                     double *distances)
+{
+  int i = 0;
+  double lat1, lng1;
+
+  lat1 = GRN_GEO_INT2RAD(base_point->latitude);
+  lng1 = GRN_GEO_INT2RAD(base_point->longitude);
+#ifdef GRN_GEO_USE_AVX2
+  {
+    const __m256d lat1s = _mm256_set1_pd(lat1);
+    const __m256d lng1s = _mm256_set1_pd(lng1);
+    const __m256d radius = _mm256_set1_pd(GRN_GEO_RADIUS);
+    for (; i + 4 <= n_points; i += 4) {
+      __m256d lat2s, lng2s, x, y;
+      geo_batch_load_avx2(points + i, &lat2s, &lng2s);
+      x = _mm256_mul_pd(_mm256_sub_pd(lng2s, lng1s),
+                        geo_batch_cos_avx2(_mm256_mul_pd(_mm256_add_pd(lat1s,
+                                                                       lat2s),
+                                                         _mm256_set1_pd(0.5))));
+      y = _mm256_sub_pd(lat2s, lat1s);
+      _mm256_storeu_pd(distances + i,
+                       _mm256_mul_pd(_mm256_sqrt_pd(GEO_BATCH_MADD(x, x,
+                                                                   _mm256_mul_pd(y, y))),
+                                     radius));
+    }
+  }
+#endif /* GRN_GEO_USE_AVX2 */
+  for (; i < n_points; i++) {
+    double lat2, lng2, x, y;
+    lat2 = GRN_GEO_INT2RAD(points[i].latitude);
+    lng2 = GRN_GEO_INT2RAD(points[i].longitude);
+    x = (lng2 - lng1) * geo_batch_cos((lat1 + lat2) * 0.5);
+    y = lat2 - lat1;
+    distances[i] = sqrt((x * x) + (y * y)) * GRN_GEO_RADIUS;
+  }
+
+  /* Points in other quadrants are rare. They are computed by the non
+     batch version. */
+  for (i = 0; i < n_points; i++) {
+    grn_geo_point *point = (grn_geo_point *)(points + i);
+    if (geo_quadrant_type(base_point, point) > QUADRANT_4TH) {
+      distances[i] = grn_geo_distance_rectangle_raw(ctx, base_point, point);
+    }
+  }
+}
+
+void
+grn_geo_distance_sphere_raw_batch(grn_ctx *ctx,
+                                  grn_geo_point *base_point,
+                                  const grn_geo_point *points,
+                                  int n_points,
+                                  double *distances)
+{
+  int i = 0;
+  double lat1, lng1, cos_lat1;
+
+  lat1 = GRN_GEO_INT2RAD(base_point->latitude);
+  lng1 = GRN_GEO_INT2RAD(base_point->longitude);
+  cos_lat1 = geo_batch_cos(lat1);
+#ifdef GRN_GEO_USE_AVX2
+  {
+    const __m256d lat1s = _mm256_set1_pd(lat1);
+    const __m256d lng1s = _mm256_set1_pd(lng1);
+    const __m256d cos_lat1s = _mm256_set1_pd(cos_lat1);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d diameter = _mm256_set1_pd(2.0 * GRN_GEO_RADIUS);
+    for (; i + 4 <= n_points; i += 4) {
+      __m256d lat2s, lng2s, x, y, h;
+      geo_batch_load_avx2(points + i, &lat2s, &lng2s);
+      x = geo_batch_sin_avx2(_mm256_mul_pd(geo_batch_abs_avx2(_mm256_sub_pd(lng2s,
+                                                                            lng1s)),
+                                           half));
+      y = geo_batch_sin_avx2(_mm256_mul_pd(geo_batch_abs_avx2(_mm256_sub_pd(lat2s,
+                                                                            lat1s)),
+                                           half));
+      h = _mm256_mul_pd(_mm256_mul_pd(cos_lat1s, geo_batch_cos_avx2(lat2s)),
+                        _mm256_mul_pd(x, x));
+      h = _mm256_min_pd(GEO_BATCH_MADD(y, y, h), one);
+      _mm256_storeu_pd(distances + i,
+                       _mm256_mul_pd(geo_batch_asin_avx2(_mm256_sqrt_pd(h)),
+                                     diameter));
+    }
+  }
+#endif /* GRN_GEO_USE_AVX2 */
+  for (; i < n_points; i++) {
+    double lat2, lng2, x, y, h;
+    lat2 = GRN_GEO_INT2RAD(points[i].latitude);
+    lng2 = GRN_GEO_INT2RAD(points[i].longitude);
+    x = geo_batch_sin(fabs(lng2 - lng1) * 0.5);
+    y = geo_batch_sin(fabs(lat2 - lat1) * 0.5);
+    h = (y * y) + cos_lat1 * geo_batch_cos(lat2) * x * x;
+    if (h > 1.0) {
+      h = 1.0;
+    }
+    distances[i] = geo_batch_asin(sqrt(h)) * 2 * GRN_GEO_RADIUS;
+  }
+}
+
+void
+grn_geo_distance_ellipsoid_raw_batch(grn_ctx *ctx,
+                                     grn_geo_point *base_point,
+                                     const grn_geo_point *points,
+                                     int n_points,
+                                     int c1, int c2, double c3,
+                                     double *distances)
+{
+  int i = 0;
+  double lat1, lng1;
+
+  lat1 = GRN_GEO_INT2RAD(base_point->latitude);
+  lng1 = GRN_GEO_INT2RAD(base_point->longitude);
+#ifdef GRN_GEO_USE_AVX2
+  {
+    const __m256d lat1s = _mm256_set1_pd(lat1);
+    const __m256d lng1s = _mm256_set1_pd(lng1);
+    const __m256d c1s = _mm256_set1_pd(c1);
+    const __m256d c2s = _mm256_set1_pd(c2);
+    const __m256d c3s = _mm256_set1_pd(c3);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d one = _mm256_set1_pd(1.0);
+    for (; i + 4 <= n_points; i += 4) {
+      __m256d lat2s, lng2s, p, sin_p, q, r, m, n, x, y;
+      geo_batch_load_avx2(points + i, &lat2s, &lng2s);
+      p = _mm256_mul_pd(_mm256_add_pd(lat1s, lat2s), half);
+      sin_p = geo_batch_sin_avx2(geo_batch_abs_avx2(p));
+      q = _mm256_sub_pd(one, _mm256_mul_pd(_mm256_mul_pd(c3s, sin_p), sin_p));
+      r = _mm256_sqrt_pd(q);
+      m = _mm256_div_pd(c1s, _mm256_mul_pd(q, r));
+      n = _mm256_div_pd(c2s, r);
+      x = _mm256_mul_pd(_mm256_mul_pd(n, geo_batch_cos_avx2(p)),
+                        geo_batch_abs_avx2(_mm256_sub_pd(lng1s, lng2s)));
+      y = _mm256_mul_pd(m, geo_batch_abs_avx2(_mm256_sub_pd(lat1s, lat2s)));
+      _mm256_storeu_pd(distances + i,
+                       _mm256_sqrt_pd(GEO_BATCH_MADD(x, x,
+                                                     _mm256_mul_pd(y, y))));
+    }
+  }
+#endif /* GRN_GEO_USE_AVX2 */
+  for (; i < n_points; i++) {
+    double lat2, lng2, p, sin_p, q, r, m, n, x, y;
+    lat2 = GRN_GEO_INT2RAD(points[i].latitude);
+    lng2 = GRN_GEO_INT2RAD(points[i].longitude);
+    p = (lat1 + lat2) * 0.5;
+    sin_p = geo_batch_sin(fabs(p));
+    q = (1 - c3 * sin_p * sin_p);
+    r = sqrt(q);
+    m = c1 / (q * r);
+    n = c2 / r;
+    x = n * geo_batch_cos(p) * fabs(lng1 - lng2);
+    y = m * fabs(lat1 - lat2);
+    distances[i] = sqrt((x * x) + (y * y));
+  }
+}
+
 double
 grn_geo_distance(grn_ctx *ctx, grn_obj *point1, grn_obj *point2,
                  grn_geo_approximate_type type)
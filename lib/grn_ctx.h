@@ -535,6 +535,8 @@ typedef struct {
   union {
     grn_table_group_flags group;
   } flags;
+  /* changed when keys are deleted. see grn_lexicon_cache.h. */
+  uint32_t cache_generation;
   //  grn_obj_flags flags;
 } grn_db_obj;
 
@@ -553,6 +555,7 @@ typedef struct {
   (db_obj)->obj.hooks[4] = NULL;\
   (db_obj)->obj.source = NULL;\
   (db_obj)->obj.source_size = 0;\
+  (db_obj)->obj.cache_generation = 0;\
 } while (0)
 
 /**** cache ****/
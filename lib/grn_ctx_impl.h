@@ -27,6 +27,8 @@
 #endif /* GRN_COM_H */
 
 #include "grn_msgpack.h"
+#include "grn_lexicon_cache.h"
+#include "grn_expr_cache.h"
 
 #ifdef GRN_WITH_MRUBY
 # include <mruby.h>
@@ -188,6 +190,12 @@ struct _grn_ctx_impl {
   char previous_errbuf[GRN_CTX_MSGSIZE];
   unsigned int n_same_error_messages;
 
+  /* lexicon cache portion */
+  grn_lexicon_cache *lexicon_cache;
+
+  /* expression cache portion */
+  grn_expr_cache *expr_cache;
+
 #ifdef GRN_WITH_MESSAGE_PACK
   msgpack_packer msgpacker;
 #endif
@@ -174,6 +174,9 @@ struct _grn_proc {
     struct {
       grn_scorer_score_func *score;
     } scorer;
+    struct {
+      grn_tokenizer_next_batch_func *next_batch;
+    } tokenizer;
   } callbacks;
 
   void *user_data;
@@ -414,6 +417,8 @@ grn_rc grn_db_obj_init(grn_ctx *ctx, grn_obj *db, grn_id id, grn_db_obj *obj);
 grn_id grn_obj_register(grn_ctx *ctx, grn_obj *db, const char *name, unsigned int name_size);
 int grn_obj_is_persistent(grn_ctx *ctx, grn_obj *obj);
 void grn_obj_spec_save(grn_ctx *ctx, grn_db_obj *obj);
+grn_rc grn_obj_get_statistics(grn_ctx *ctx, grn_obj *obj, grn_obj *statistics);
+grn_rc grn_obj_set_statistics(grn_ctx *ctx, grn_obj *obj, grn_obj *statistics);
 
 grn_rc grn_obj_reinit_for(grn_ctx *ctx, grn_obj *obj, grn_obj *domain_obj);
 
@@ -453,6 +458,13 @@ GRN_API grn_rc grn_table_group_with_range_gap(grn_ctx *ctx, grn_obj *table,
                                               grn_obj *result_set,
                                               uint32_t range_gap);
 
+grn_rc grn_table_sort_merge(grn_ctx *ctx,
+                            grn_obj **sorted_tables,
+                            grn_table_sort_key **keys_list,
+                            int n_tables, int n_keys,
+                            int offset, int limit,
+                            grn_obj *runs);
+
 GRN_API grn_rc grn_column_filter(grn_ctx *ctx, grn_obj *column,
                                  grn_operator op,
                                  grn_obj *value, grn_obj *result_set,
@@ -39,6 +39,8 @@ typedef enum {
 } scan_stat;
 
 typedef struct _grn_scan_info scan_info;
+
+void grn_expr_init_from_env(void);
 typedef grn_bool (*grn_scan_info_each_arg_callback)(grn_ctx *ctx, grn_obj *obj, void *user_data);
 
 scan_info *grn_scan_info_open(grn_ctx *ctx, int start);
@@ -73,8 +75,28 @@ grn_rc grn_expr_code_inspect_indented(grn_ctx *ctx,
 void grn_p_expr_code(grn_ctx *ctx, grn_expr_code *code);
 
 void grn_expr_take_obj(grn_ctx *ctx, grn_obj *expr, grn_obj *obj);
+void grn_expr_unlink_persistent_objs(grn_ctx *ctx, grn_obj *expr);
 grn_obj *grn_expr_alloc_const(grn_ctx *ctx, grn_obj *expr);
 
+typedef struct {
+  /* the position of the literal in the parsed text */
+  uint32_t offset;
+  uint32_t length;
+  /* the constant for the literal in the expression */
+  grn_obj *value;
+} grn_expr_literal;
+
+grn_rc grn_expr_parse_with_literals(grn_ctx *ctx, grn_obj *expr,
+                                    const char *str, unsigned int str_size,
+                                    grn_obj *default_column,
+                                    grn_operator default_mode,
+                                    grn_operator default_op,
+                                    grn_expr_flags flags,
+                                    grn_obj *literals);
+grn_rc grn_expr_parse_literal(grn_ctx *ctx,
+                              const char *str, const char *str_end,
+                              grn_obj *value, const char **rest);
+
 #ifdef __cplusplus
 }
 #endif
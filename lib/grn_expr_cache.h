@@ -0,0 +1,89 @@
+/* -*- c-basic-offset: 2 -*- */
+/*
+  Copyright(C) 2015 Brazil
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License version 2.1 as published by the Free Software Foundation.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef GRN_EXPR_CACHE_H
+#define GRN_EXPR_CACHE_H
+
+#include "grn.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  The expression cache keeps parsed select conditions so that select
+  doesn't parse the same --match_columns, --query and --filter again.
+
+  Each grn_ctx has its own LRU cache because expressions are temporary
+  objects of a context. The key of --filter is a template: string and
+  number literals are replaced with placeholders and the literals in
+  the current filter are bound to the constants of the cached
+  expression. A template is used only when the parser created exactly
+  one constant for each literal. Otherwise the filter must match
+  exactly.
+
+  All entries become stale when any object is created, removed or
+  renamed because names in them may be resolved to other objects.
+*/
+
+#define GRN_EXPR_CACHE_DEFAULT_MAX_N_ENTRIES 256
+
+typedef struct _grn_expr_cache grn_expr_cache;
+
+typedef struct {
+  grn_obj *table;
+  const char *match_columns;
+  unsigned int match_columns_len;
+  const char *query;
+  unsigned int query_len;
+  const char *query_flags;
+  unsigned int query_flags_len;
+  const char *filter;
+  unsigned int filter_len;
+} grn_expr_cache_key;
+
+typedef struct {
+  uint64_t n_fetches;
+  uint64_t n_hits;
+} grn_expr_cache_statistics;
+
+void grn_expr_cache_init_from_env(void);
+grn_rc grn_expr_cache_init(void);
+grn_rc grn_expr_cache_fin(void);
+
+grn_bool grn_expr_cache_is_enabled(grn_ctx *ctx);
+void grn_expr_cache_close(grn_ctx *ctx);
+void grn_expr_cache_expire(grn_ctx *ctx);
+
+grn_bool grn_expr_cache_fetch(grn_ctx *ctx, grn_expr_cache_key *key,
+                              grn_obj **condition,
+                              grn_obj **match_columns);
+grn_bool grn_expr_cache_add(grn_ctx *ctx, grn_expr_cache_key *key,
+                            grn_obj *condition,
+                            grn_obj *match_columns,
+                            grn_obj *filter_literals);
+void grn_expr_cache_release(grn_ctx *ctx, grn_obj *condition);
+
+void grn_expr_cache_get_statistics(grn_ctx *ctx,
+                                   grn_expr_cache_statistics *statistics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GRN_EXPR_CACHE_H */
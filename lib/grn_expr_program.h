@@ -0,0 +1,73 @@
+/* -*- c-basic-offset: 2 -*- */
+/*
+  Copyright(C) 2015 Brazil
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License version 2.1 as published by the Free Software Foundation.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef GRN_EXPR_PROGRAM_H
+#define GRN_EXPR_PROGRAM_H
+
+#include "grn.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  grn_expr_program is a condition compiled into typed register based
+  instructions. It's used instead of grn_expr_exec() to evaluate a
+  condition for each record. Values aren't boxed into grn_obj and
+  instructions are specialized by value types when the condition is
+  compiled.
+
+  Only conditions that consist of comparisons, arithmetic operations
+  and logical operations on number and time values of scalar fixed
+  size columns and constants can be compiled. grn_expr_program_open()
+  returns NULL for other conditions and the caller should use
+  grn_expr_exec(). Compiled conditions return the same result as
+  grn_expr_exec().
+
+  grn_expr_program_exec_batch() evaluates a condition for
+  GRN_EXPR_PROGRAM_BATCH_SIZE records at a time. Column values of the
+  records are loaded together and each instruction is applied to all
+  of them. It reduces dispatch cost per record.
+*/
+
+#define GRN_EXPR_PROGRAM_BATCH_SIZE 256
+
+typedef struct _grn_expr_program grn_expr_program;
+
+void grn_expr_program_init_from_env(void);
+
+grn_expr_program *grn_expr_program_open(grn_ctx *ctx,
+                                        grn_obj *table,
+                                        grn_obj *expr);
+void grn_expr_program_close(grn_ctx *ctx, grn_expr_program *program);
+grn_bool grn_expr_program_exec(grn_ctx *ctx,
+                               grn_expr_program *program,
+                               grn_id id);
+/* n_ids must not be larger than GRN_EXPR_PROGRAM_BATCH_SIZE. It returns
+   the number of matched records. */
+int grn_expr_program_exec_batch(grn_ctx *ctx,
+                                grn_expr_program *program,
+                                const grn_id *ids,
+                                int n_ids,
+                                grn_bool *results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GRN_EXPR_PROGRAM_H */
@@ -200,6 +200,31 @@ double grn_geo_distance_ellipsoid_raw_wgs84(grn_ctx *ctx,
                                             grn_geo_point *point1,
                                             grn_geo_point *point2);
 
+/*
+  grn_geo_distance_*_raw_batch() compute distances between base_point
+  and each of n_points points into distances. They use polynomial
+  approximations of sin(), cos() and asin() instead of libm and process
+  4 points at a time with AVX2 when it's available. Relative errors
+  from the non batch versions are less than 1e-10. See geo.c for
+  error bounds of the approximations.
+*/
+void grn_geo_distance_rectangle_raw_batch(grn_ctx *ctx,
+                                          grn_geo_point *base_point,
+                                          const grn_geo_point *points,
+                                          int n_points,
+                                          double *distances);
+void grn_geo_distance_sphere_raw_batch(grn_ctx *ctx,
+                                       grn_geo_point *base_point,
+                                       const grn_geo_point *points,
+                                       int n_points,
+                                       double *distances);
+void grn_geo_distance_ellipsoid_raw_batch(grn_ctx *ctx,
+                                          grn_geo_point *base_point,
+                                          const grn_geo_point *points,
+                                          int n_points,
+                                          int c1, int c2, double c3,
+                                          double *distances);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,71 @@
+/* -*- c-basic-offset: 2 -*- */
+/*
+  Copyright(C) 2015 Brazil
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License version 2.1 as published by the Free Software Foundation.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef GRN_LEXICON_CACHE_H
+#define GRN_LEXICON_CACHE_H
+
+#include "grn.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  The lexicon cache maps token keys to term IDs in front of
+  grn_pat/grn_hash/grn_dat lookups done by grn_token_cursor.
+
+  Each grn_ctx has its own direct mapped cache, so no locking is needed
+  on lookups. A cached entry is tagged with the cache_generation of the
+  lexicon. grn_lexicon_cache_expire() gives the lexicon a new
+  generation after keys are deleted or the lexicon is truncated, so
+  the entries in every context become stale at once.
+*/
+
+#define GRN_LEXICON_CACHE_MAX_KEY_SIZE 20
+#define GRN_LEXICON_CACHE_DEFAULT_SIZE 2048
+
+typedef struct _grn_lexicon_cache grn_lexicon_cache;
+
+typedef struct {
+  uint64_t n_lookups;
+  uint64_t n_hits;
+} grn_lexicon_cache_statistics;
+
+void grn_lexicon_cache_init_from_env(void);
+grn_rc grn_lexicon_cache_init(void);
+grn_rc grn_lexicon_cache_fin(void);
+
+void grn_lexicon_cache_close(grn_ctx *ctx);
+
+uint32_t grn_lexicon_cache_generation(grn_ctx *ctx, grn_obj *lexicon);
+grn_id grn_lexicon_cache_get(grn_ctx *ctx, grn_obj *lexicon,
+                             const void *key, unsigned int key_size,
+                             uint32_t generation);
+void grn_lexicon_cache_set(grn_ctx *ctx, grn_obj *lexicon,
+                           const void *key, unsigned int key_size,
+                           uint32_t generation, grn_id id);
+void grn_lexicon_cache_expire(grn_ctx *ctx, grn_obj *lexicon);
+
+void grn_lexicon_cache_get_statistics(grn_ctx *ctx,
+                                      grn_lexicon_cache_statistics *statistics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GRN_LEXICON_CACHE_H */
@@ -0,0 +1,70 @@
+/* -*- c-basic-offset: 2 -*- */
+/*
+  Copyright(C) 2015 Brazil
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License version 2.1 as published by the Free Software Foundation.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef GRN_PARALLEL_H
+#define GRN_PARALLEL_H
+
+#include "grn.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  grn_parallel runs independent grn_table_select() calls, e.g. one per
+  shard, on a process wide pool of worker threads. Each worker thread
+  has its own grn_ctx that uses the database of the caller while it
+  runs tasks. The caller also runs tasks in its own context, so
+  `n_workers' is the total degree of parallelism and 1 means that all
+  tasks are run sequentially by the caller.
+
+  Expressions and result tables must be created by the caller. Each
+  task must have its own expression and result table because they are
+  used by only one thread at a time. Variables of temporary expressions
+  live in the context that created them, so workers borrow them from
+  the caller.
+*/
+
+#define GRN_PARALLEL_DEFAULT_MAX_N_WORKERS 8
+
+typedef struct {
+  grn_obj *table;
+  grn_obj *expression;
+  grn_obj *result;
+  grn_rc rc;
+  char message[GRN_CTX_MSGSIZE];
+  /* for internal use */
+  grn_hash *vars;
+} grn_parallel_select_task;
+
+void grn_parallel_init_from_env(void);
+grn_rc grn_parallel_init(void);
+grn_rc grn_parallel_fin(void);
+
+int grn_parallel_get_max_n_workers(void);
+
+grn_rc grn_parallel_select(grn_ctx *ctx,
+                           grn_parallel_select_task *tasks,
+                           int n_tasks,
+                           int n_workers);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GRN_PARALLEL_H */
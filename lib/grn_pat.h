@@ -76,6 +76,22 @@ struct _grn_pat_cursor_entry {
 
 typedef struct _grn_pat_cursor_entry grn_pat_cursor_entry;
 
+/*
+  A node of the trie. A node whose check is larger than the check of
+  its parent is a branch and its children are the next nodes. Other
+  nodes are leaves and each of them is the record of its ID. The key
+  is encoded and the first (check >> 1) bits of it are shared by all
+  keys under a branch.
+*/
+struct _grn_pat_node_info {
+  uint16_t check;
+  grn_id children[2];
+  const uint8_t *key;
+  uint32_t key_size;
+};
+
+typedef struct _grn_pat_node_info grn_pat_node_info;
+
 struct _grn_pat_cursor {
   grn_db_obj obj;
   grn_id curr_rec;
@@ -101,6 +117,11 @@ void grn_pat_check(grn_ctx *ctx, grn_pat *pat);
 void grn_pat_inspect_nodes(grn_ctx *ctx, grn_pat *pat, grn_obj *buf);
 void grn_pat_cursor_inspect(grn_ctx *ctx, grn_pat_cursor *c, grn_obj *buf);
 
+/* for traversing nodes in an order other than the key order */
+grn_id grn_pat_root_node(grn_ctx *ctx, grn_pat *pat);
+grn_rc grn_pat_node_get_info(grn_ctx *ctx, grn_pat *pat, grn_id id,
+                             grn_pat_node_info *info);
+
 grn_rc grn_pat_cache_enable(grn_ctx *ctx, grn_pat *pat, uint32_t cache_size);
 void grn_pat_cache_disable(grn_ctx *ctx, grn_pat *pat);
 
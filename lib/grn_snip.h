@@ -87,6 +87,8 @@ typedef struct
   unsigned int tag_count;
 } _snip_result;
 
+typedef struct _grn_snip_matcher grn_snip_matcher;
+
 typedef struct _grn_snip
 {
   grn_db_obj obj;
@@ -116,6 +118,9 @@ typedef struct _grn_snip
   size_t max_tagged_len;
 
   grn_obj *normalizer;
+
+  /* finds all conditions in one pass. built on the first grn_snip_exec(). */
+  grn_snip_matcher *matcher;
 } grn_snip;
 
 grn_rc grn_snip_close(grn_ctx *ctx, grn_snip *snip);
@@ -0,0 +1,68 @@
+/* -*- c-basic-offset: 2 -*- */
+/*
+  Copyright(C) 2015 Brazil
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License version 2.1 as published by the Free Software Foundation.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef GRN_STATISTICS_H
+#define GRN_STATISTICS_H
+
+#include "grn.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+  Statistics of the values of a column are used to estimate the number
+  of records matched by a condition without its index. They are built
+  by the statistics_update command and saved in the spec of the column.
+
+  Statistics have the number of values, the number of distinct values,
+  the most common values and an equi-depth histogram of the other
+  values. Histograms are built only for number and time values. Text
+  values are identified by their hash values.
+
+  Statistics of an index column are built from the keys of its lexicon
+  and each key is weighted by the estimated size of its posting list.
+
+  Estimated sizes are scaled by the current number of records because
+  statistics aren't updated automatically.
+*/
+
+#define GRN_STATISTICS_MAX_N_MOST_COMMON_VALUES 16
+#define GRN_STATISTICS_MAX_N_BUCKETS            32
+
+grn_bool grn_statistics_is_supported(grn_ctx *ctx, grn_obj *column);
+grn_rc grn_statistics_update(grn_ctx *ctx, grn_obj *column);
+
+grn_bool grn_statistics_estimate_equal(grn_ctx *ctx,
+                                       grn_obj *column,
+                                       grn_obj *value,
+                                       int64_t *size);
+/* min and max may be NULL. */
+grn_bool grn_statistics_estimate_range(grn_ctx *ctx,
+                                       grn_obj *column,
+                                       grn_obj *min,
+                                       grn_bool min_include,
+                                       grn_obj *max,
+                                       grn_bool max_include,
+                                       int64_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GRN_STATISTICS_H */
@@ -41,10 +41,18 @@ struct _grn_ra {
 struct grn_ra_header {
   uint32_t element_size;
   uint32_t nrecords; /* nrecords is not maintained by default */
-  uint32_t reserved[10];
+  /* the range of the column. GRN_ID_NIL means no zone map. */
+  uint32_t zone_map_type;
+  uint32_t zone_map_segment;
+  uint32_t reserved[8];
 };
 
+void grn_ra_init_from_env(void);
+
 grn_ra *grn_ra_create(grn_ctx *ctx, const char *path, unsigned int element_size);
+grn_ra *grn_ra_create_with_zone_map(grn_ctx *ctx, const char *path,
+                                    unsigned int element_size,
+                                    grn_id value_type);
 grn_ra *grn_ra_open(grn_ctx *ctx, const char *path);
 grn_rc grn_ra_info(grn_ctx *ctx, grn_ra *ra, unsigned int *element_size);
 grn_rc grn_ra_close(grn_ctx *ctx, grn_ra *ra);
@@ -69,6 +77,32 @@ struct _grn_ra_cache {
 
 void *grn_ra_ref_cache(grn_ctx *ctx, grn_ra *ra, grn_id id, grn_ra_cache *cache);
 
+/*
+  A zone map keeps the min and max values of each block of
+  GRN_RA_ZONE_MAP_BLOCK_SIZE records. The range only grows on update,
+  so it may be wider than the current values but never narrower. It is
+  used to skip blocks that can't match a condition.
+*/
+
+#define GRN_RA_ZONE_MAP_W_BLOCK    10
+#define GRN_RA_ZONE_MAP_BLOCK_SIZE (1 << GRN_RA_ZONE_MAP_W_BLOCK)
+
+typedef union {
+  int64_t i;
+  uint64_t u;
+  double f;
+} grn_ra_zone_value;
+
+grn_bool grn_ra_have_zone_map(grn_ctx *ctx, grn_ra *ra);
+void grn_ra_zone_map_update(grn_ctx *ctx, grn_ra *ra, grn_id id,
+                            const void *value);
+grn_bool grn_ra_zone_map_value_from_bulk(grn_ctx *ctx, grn_ra *ra,
+                                         grn_obj *bulk,
+                                         grn_ra_zone_value *value);
+grn_bool grn_ra_zone_map_may_match(grn_ctx *ctx, grn_ra *ra, grn_id id,
+                                   grn_operator op,
+                                   grn_ra_zone_value *value);
+
 /**** variable sized elements ****/
 
 typedef struct _grn_ja grn_ja;
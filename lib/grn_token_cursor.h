@@ -43,6 +43,8 @@ struct _grn_token {
   grn_token_status status;
 };
 
+#define GRN_TOKEN_CURSOR_N_BATCH_TOKENS 64
+
 typedef struct {
   grn_obj *table;
   const unsigned char *orig;
@@ -60,6 +62,12 @@ typedef struct {
   grn_obj *token_filters;
   uint32_t variant;
   grn_obj *nstr;
+  struct {
+    grn_tokenizer_next_batch_func *next_batch;
+    unsigned int n_tokens;
+    unsigned int current;
+    grn_tokenizer_batch_token tokens[GRN_TOKEN_CURSOR_N_BATCH_TOKENS];
+  } batch;
 } grn_token_cursor;
 
 #define GRN_TOKEN_CURSOR_ENABLE_TOKENIZED_DELIMITER (0x01L<<0)
@@ -70,6 +78,11 @@ GRN_API grn_token_cursor *grn_token_cursor_open(grn_ctx *ctx, grn_obj *table,
                                                 unsigned int flags);
 
 GRN_API grn_id grn_token_cursor_next(grn_ctx *ctx, grn_token_cursor *token_cursor);
+GRN_API unsigned int grn_token_cursor_next_batch(grn_ctx *ctx,
+                                                 grn_token_cursor *token_cursor,
+                                                 grn_id *token_ids,
+                                                 int32_t *positions,
+                                                 unsigned int max_n_tokens);
 GRN_API grn_rc grn_token_cursor_close(grn_ctx *ctx, grn_token_cursor *token_cursor);
 
 #ifdef __cplusplus
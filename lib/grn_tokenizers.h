@@ -19,6 +19,8 @@
 
 #include "grn_ctx.h"
 
+#include <groonga/tokenizer.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -31,6 +33,12 @@ grn_rc grn_tokenizers_fin(void);
 grn_rc grn_db_init_mecab_tokenizer(grn_ctx *ctx);
 grn_rc grn_db_init_builtin_tokenizers(grn_ctx *ctx);
 
+const char *grn_tokenizer_tokenized_delimiter_next_token(grn_ctx *ctx,
+                                                         const char *str_ptr,
+                                                         unsigned int str_length,
+                                                         grn_encoding encoding,
+                                                         grn_tokenizer_batch_token *token);
+
 #ifdef __cplusplus
 }
 #endif
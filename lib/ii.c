@@ -5002,8 +5002,14 @@ grn_vector2updspecs(grn_ctx *ctx, grn_ii *ii, grn_id rid, unsigned int section,
       if (v->length &&
           (token_cursor = grn_token_cursor_open(ctx, lexicon, head + v->offset, v->length,
                                                 mode, token_flags))) {
-        while (!token_cursor->status) {
-          if ((tid = grn_token_cursor_next(ctx, token_cursor))) {
+        grn_id tids[GRN_TOKEN_CURSOR_N_BATCH_TOKENS];
+        int32_t positions[GRN_TOKEN_CURSOR_N_BATCH_TOKENS];
+        unsigned int i, n_tokens;
+        while ((n_tokens = grn_token_cursor_next_batch(ctx, token_cursor,
+                                                       tids, positions,
+                                                       GRN_TOKEN_CURSOR_N_BATCH_TOKENS))) {
+          for (i = 0; i < n_tokens; i++) {
+            tid = tids[i];
             if (posting) { GRN_RECORD_PUT(ctx, posting, tid); }
             if (!grn_hash_add(ctx, h, &tid, sizeof(grn_id), (void **) &u, NULL)) {
               break;
@@ -5015,12 +5021,15 @@ grn_vector2updspecs(grn_ctx *ctx, grn_ii *ii, grn_id rid, unsigned int section,
                 return GRN_NO_MEMORY_AVAILABLE;
               }
             }
-            if (grn_ii_updspec_add(ctx, *u, token_cursor->pos, v->weight)) {
+            if (grn_ii_updspec_add(ctx, *u, positions[i], v->weight)) {
               GRN_LOG(ctx, GRN_LOG_ALERT, "grn_ii_updspec_add on grn_ii_update failed!");
               grn_token_cursor_close(ctx, token_cursor);
               return GRN_NO_MEMORY_AVAILABLE;
             }
           }
+          if (i < n_tokens) {
+            break;
+          }
         }
         grn_token_cursor_close(ctx, token_cursor);
       }
@@ -7504,15 +7513,21 @@ grn_ii_buffer_tokenize_value(grn_ctx *ctx, grn_ii_buffer *ii_buffer,
     if ((token_cursor = grn_token_cursor_open(ctx, tmp_lexicon,
                                               value->p, value->len,
                                               GRN_TOKEN_ADD, token_flags))) {
-      while (!token_cursor->status) {
-        grn_id tid;
-        if ((tid = grn_token_cursor_next(ctx, token_cursor))) {
+      grn_id tids[GRN_TOKEN_CURSOR_N_BATCH_TOKENS];
+      int32_t positions[GRN_TOKEN_CURSOR_N_BATCH_TOKENS];
+      unsigned int i, n_tokens;
+      while ((n_tokens = grn_token_cursor_next_batch(ctx, token_cursor,
+                                                     tids, positions,
+                                                     GRN_TOKEN_CURSOR_N_BATCH_TOKENS))) {
+        for (i = 0; i < n_tokens; i++) {
+          grn_id tid = tids[i];
+          int32_t pos = positions[i];
           ii_buffer_counter *counter;
           counter = get_buffer_counter(ctx, ii_buffer, tmp_lexicon, tid);
           if (!counter) { return; }
           buffer[block_pos++] = tid;
           if (ii_flags & GRN_OBJ_WITH_POSITION) {
-            buffer[block_pos++] = token_cursor->pos;
+            buffer[block_pos++] = pos;
           }
           if (counter->last_rid != rid) {
             counter->offset_rid += GRN_B_ENC_SIZE(rid - counter->last_rid);
@@ -7542,8 +7557,8 @@ grn_ii_buffer_tokenize_value(grn_ctx *ctx, grn_ii_buffer *ii_buffer,
             counter->nrecs++;
           }
           counter->offset_pos +=
-            GRN_B_ENC_SIZE(token_cursor->pos - counter->last_pos);
-          counter->last_pos = token_cursor->pos;
+            GRN_B_ENC_SIZE(pos - counter->last_pos);
+          counter->last_pos = pos;
           counter->last_tf++;
           counter->last_weight += value->weight;
           counter->nposts++;
@@ -0,0 +1,280 @@
+/* -*- c-basic-offset: 2 -*- */
+/*
+  Copyright(C) 2015 Brazil
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License version 2.1 as published by the Free Software Foundation.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "grn_lexicon_cache.h"
+#include "grn_ctx_impl.h"
+#include "grn_db.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  grn_obj *lexicon;
+  uint32_t generation;
+  grn_id id;
+  uint32_t key_size;
+  char key[GRN_LEXICON_CACHE_MAX_KEY_SIZE];
+} grn_lexicon_cache_entry;
+
+struct _grn_lexicon_cache {
+  uint32_t mask;
+  /* statistics not merged into the global statistics yet */
+  uint32_t n_lookups;
+  uint32_t n_hits;
+  grn_lexicon_cache_entry entries[1];
+};
+
+#define GRN_LEXICON_CACHE_FLUSH_INTERVAL 1024
+
+static uint32_t grn_lexicon_cache_size = GRN_LEXICON_CACHE_DEFAULT_SIZE;
+static uint32_t grn_lexicon_cache_last_generation = 0;
+static grn_lexicon_cache_statistics grn_lexicon_cache_total;
+static grn_critical_section grn_lexicon_cache_lock;
+
+void
+grn_lexicon_cache_init_from_env(void)
+{
+  char grn_lexicon_cache_size_env[GRN_ENV_BUFFER_SIZE];
+  grn_getenv("GRN_LEXICON_CACHE_SIZE",
+             grn_lexicon_cache_size_env,
+             GRN_ENV_BUFFER_SIZE);
+  if (grn_lexicon_cache_size_env[0]) {
+    uint32_t size = (uint32_t)atoi(grn_lexicon_cache_size_env);
+    /* round up to a power of two. 0 disables the cache. */
+    if (size > 0) {
+      uint32_t power_of_two = 1;
+      while (power_of_two < size && power_of_two < (1U << 20)) {
+        power_of_two <<= 1;
+      }
+      size = power_of_two;
+    }
+    grn_lexicon_cache_size = size;
+  }
+}
+
+grn_rc
+grn_lexicon_cache_init(void)
+{
+  grn_lexicon_cache_total.n_lookups = 0;
+  grn_lexicon_cache_total.n_hits = 0;
+  CRITICAL_SECTION_INIT(grn_lexicon_cache_lock);
+  return GRN_SUCCESS;
+}
+
+grn_rc
+grn_lexicon_cache_fin(void)
+{
+  CRITICAL_SECTION_FIN(grn_lexicon_cache_lock);
+  return GRN_SUCCESS;
+}
+
+static void
+grn_lexicon_cache_flush_statistics(grn_lexicon_cache *cache)
+{
+  if (cache->n_lookups == 0) {
+    return;
+  }
+  CRITICAL_SECTION_ENTER(grn_lexicon_cache_lock);
+  grn_lexicon_cache_total.n_lookups += cache->n_lookups;
+  grn_lexicon_cache_total.n_hits += cache->n_hits;
+  CRITICAL_SECTION_LEAVE(grn_lexicon_cache_lock);
+  cache->n_lookups = 0;
+  cache->n_hits = 0;
+}
+
+static grn_lexicon_cache *
+grn_lexicon_cache_open(grn_ctx *ctx)
+{
+  grn_lexicon_cache *cache;
+  size_t size;
+
+  size = sizeof(grn_lexicon_cache) +
+    sizeof(grn_lexicon_cache_entry) * (grn_lexicon_cache_size - 1);
+  cache = GRN_CALLOC(size);
+  if (!cache) {
+    return NULL;
+  }
+  cache->mask = grn_lexicon_cache_size - 1;
+  return cache;
+}
+
+void
+grn_lexicon_cache_close(grn_ctx *ctx)
+{
+  grn_lexicon_cache *cache;
+
+  if (!ctx->impl || !ctx->impl->lexicon_cache) {
+    return;
+  }
+
+  cache = ctx->impl->lexicon_cache;
+  grn_lexicon_cache_flush_statistics(cache);
+  GRN_FREE(cache);
+  ctx->impl->lexicon_cache = NULL;
+}
+
+static uint32_t
+grn_lexicon_cache_next_generation(void)
+{
+  uint32_t generation;
+  do {
+    GRN_ATOMIC_ADD_EX(&grn_lexicon_cache_last_generation, 1, generation);
+    generation++;
+  } while (generation == 0);
+  return generation;
+}
+
+/* Returns 0 when lookups in the lexicon can't be cached. */
+uint32_t
+grn_lexicon_cache_generation(grn_ctx *ctx, grn_obj *lexicon)
+{
+  uint32_t generation;
+
+  if (grn_lexicon_cache_size == 0 || !ctx->impl) {
+    return 0;
+  }
+
+  switch (lexicon->header.type) {
+  case GRN_TABLE_PAT_KEY :
+  case GRN_TABLE_DAT_KEY :
+  case GRN_TABLE_HASH_KEY :
+    break;
+  default :
+    return 0;
+  }
+
+  generation = DB_OBJ(lexicon)->cache_generation;
+  if (generation == 0) {
+    /* Assigned lazily so that a lexicon allocated at the address of a
+       closed one never shares entries with it. */
+    generation = grn_lexicon_cache_next_generation();
+    DB_OBJ(lexicon)->cache_generation = generation;
+  }
+  return generation;
+}
+
+static inline grn_lexicon_cache_entry *
+grn_lexicon_cache_entry_at(grn_lexicon_cache *cache, grn_obj *lexicon,
+                           const unsigned char *key, unsigned int key_size)
+{
+  uint32_t hash_value = 2166136261U;
+  unsigned int i;
+
+  for (i = 0; i < key_size; i++) {
+    hash_value ^= key[i];
+    hash_value *= 16777619U;
+  }
+  hash_value ^= (uint32_t)((uintptr_t)lexicon >> 4);
+  hash_value ^= hash_value >> 16;
+  return cache->entries + (hash_value & cache->mask);
+}
+
+grn_id
+grn_lexicon_cache_get(grn_ctx *ctx, grn_obj *lexicon,
+                      const void *key, unsigned int key_size,
+                      uint32_t generation)
+{
+  grn_lexicon_cache *cache;
+  grn_lexicon_cache_entry *entry;
+  grn_id id = GRN_ID_NIL;
+
+  if (generation == 0 || key_size > GRN_LEXICON_CACHE_MAX_KEY_SIZE) {
+    return GRN_ID_NIL;
+  }
+
+  cache = ctx->impl->lexicon_cache;
+  if (!cache) {
+    cache = grn_lexicon_cache_open(ctx);
+    if (!cache) {
+      return GRN_ID_NIL;
+    }
+    ctx->impl->lexicon_cache = cache;
+  }
+
+  entry = grn_lexicon_cache_entry_at(cache, lexicon, key, key_size);
+  if (entry->lexicon == lexicon &&
+      entry->generation == generation &&
+      entry->key_size == key_size &&
+      memcmp(entry->key, key, key_size) == 0) {
+    id = entry->id;
+    cache->n_hits++;
+  }
+  cache->n_lookups++;
+  if (cache->n_lookups == GRN_LEXICON_CACHE_FLUSH_INTERVAL) {
+    grn_lexicon_cache_flush_statistics(cache);
+  }
+
+  return id;
+}
+
+/*
+  `generation' must be the value returned by
+  grn_lexicon_cache_generation() before `id' was looked up. If keys are
+  deleted after that, the entry is stale from the start.
+*/
+void
+grn_lexicon_cache_set(grn_ctx *ctx, grn_obj *lexicon,
+                      const void *key, unsigned int key_size,
+                      uint32_t generation, grn_id id)
+{
+  grn_lexicon_cache *cache;
+  grn_lexicon_cache_entry *entry;
+
+  if (generation == 0 || key_size > GRN_LEXICON_CACHE_MAX_KEY_SIZE) {
+    return;
+  }
+
+  cache = ctx->impl->lexicon_cache;
+  if (!cache) {
+    return;
+  }
+
+  entry = grn_lexicon_cache_entry_at(cache, lexicon, key, key_size);
+  entry->lexicon = lexicon;
+  entry->generation = generation;
+  entry->id = id;
+  entry->key_size = key_size;
+  grn_memcpy(entry->key, key, key_size);
+}
+
+/* Must be called after keys are deleted from `lexicon', not before. */
+void
+grn_lexicon_cache_expire(grn_ctx *ctx, grn_obj *lexicon)
+{
+  switch (lexicon->header.type) {
+  case GRN_TABLE_PAT_KEY :
+  case GRN_TABLE_DAT_KEY :
+  case GRN_TABLE_HASH_KEY :
+    DB_OBJ(lexicon)->cache_generation = grn_lexicon_cache_next_generation();
+    break;
+  default :
+    break;
+  }
+}
+
+void
+grn_lexicon_cache_get_statistics(grn_ctx *ctx,
+                                 grn_lexicon_cache_statistics *statistics)
+{
+  if (ctx->impl && ctx->impl->lexicon_cache) {
+    grn_lexicon_cache_flush_statistics(ctx->impl->lexicon_cache);
+  }
+  CRITICAL_SECTION_ENTER(grn_lexicon_cache_lock);
+  *statistics = grn_lexicon_cache_total;
+  CRITICAL_SECTION_LEAVE(grn_lexicon_cache_lock);
+}
@@ -17,6 +17,8 @@
 */
 
 #include "../grn_ctx_impl.h"
+#include "../grn_db.h"
+#include "../grn_parallel.h"
 
 #ifdef GRN_WITH_MRUBY
 #include <mruby.h>
@@ -157,6 +159,202 @@ mrb_grn_table_select(mrb_state *mrb, mrb_value self)
   return grn_mrb_value_from_grn_obj(mrb, result);
 }
 
+static mrb_value
+mrb_grn_table_s_select_parallel(mrb_state *mrb, mrb_value klass)
+{
+  grn_ctx *ctx = (grn_ctx *)mrb->ud;
+  mrb_value mrb_tables;
+  mrb_value mrb_expressions;
+  mrb_value mrb_options = mrb_nil_value();
+  mrb_value mrb_results;
+  int n_workers = 1;
+  int i, n_tasks;
+  grn_parallel_select_task *tasks;
+
+  mrb_get_args(mrb, "AA|H", &mrb_tables, &mrb_expressions, &mrb_options);
+
+  n_tasks = RARRAY_LEN(mrb_tables);
+  if (RARRAY_LEN(mrb_expressions) != n_tasks) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR,
+               "the number of tables and expressions must be the same: "
+               "%S: %S",
+               mrb_fixnum_value(n_tasks),
+               mrb_fixnum_value(RARRAY_LEN(mrb_expressions)));
+  }
+
+  if (!mrb_nil_p(mrb_options)) {
+    mrb_value mrb_n_workers;
+
+    mrb_n_workers = grn_mrb_options_get_lit(mrb, mrb_options, "n_workers");
+    if (!mrb_nil_p(mrb_n_workers)) {
+      n_workers = mrb_fixnum(mrb_n_workers);
+    }
+  }
+
+  mrb_results = mrb_ary_new_capa(mrb, n_tasks);
+  if (n_tasks == 0) {
+    return mrb_results;
+  }
+
+  tasks = GRN_MALLOCN(grn_parallel_select_task, n_tasks);
+  if (!tasks) {
+    grn_mrb_ctx_check(mrb);
+    return mrb_results;
+  }
+  for (i = 0; i < n_tasks; i++) {
+    grn_obj *table = DATA_PTR(RARRAY_PTR(mrb_tables)[i]);
+    tasks[i].table = table;
+    tasks[i].expression = DATA_PTR(RARRAY_PTR(mrb_expressions)[i]);
+    tasks[i].result = grn_table_create(ctx, NULL, 0, NULL,
+                                       GRN_TABLE_HASH_KEY|GRN_OBJ_WITH_SUBREC,
+                                       table, NULL);
+    if (!tasks[i].result) {
+      break;
+    }
+  }
+
+  if (i == n_tasks) {
+    grn_parallel_select(ctx, tasks, n_tasks, n_workers);
+  }
+
+  if (i < n_tasks || ctx->rc != GRN_SUCCESS) {
+    int n_created_results = i;
+    for (i = 0; i < n_created_results; i++) {
+      grn_obj_unlink(ctx, tasks[i].result);
+    }
+    GRN_FREE(tasks);
+    grn_mrb_ctx_check(mrb);
+    return mrb_results;
+  }
+
+  for (i = 0; i < n_tasks; i++) {
+    mrb_ary_push(mrb, mrb_results,
+                 grn_mrb_value_from_grn_obj(mrb, tasks[i].result));
+  }
+  GRN_FREE(tasks);
+
+  return mrb_results;
+}
+
+static mrb_value
+mrb_grn_table_s_merge_sorted(mrb_state *mrb, mrb_value klass)
+{
+  grn_ctx *ctx = (grn_ctx *)mrb->ud;
+  mrb_value mrb_sorted_tables;
+  char *keys;
+  mrb_int keys_size;
+  mrb_value mrb_options = mrb_nil_value();
+  mrb_value mrb_runs;
+  int offset = 0;
+  int limit = 10;
+  int i, n_tables, n_keys = 0;
+  grn_obj **sorted_tables;
+  grn_table_sort_key **keys_list;
+  grn_obj runs;
+
+  mrb_get_args(mrb, "As|H",
+               &mrb_sorted_tables, &keys, &keys_size, &mrb_options);
+
+  if (!mrb_nil_p(mrb_options)) {
+    mrb_value mrb_offset;
+    mrb_value mrb_limit;
+
+    mrb_offset = grn_mrb_options_get_lit(mrb, mrb_options, "offset");
+    if (!mrb_nil_p(mrb_offset)) {
+      offset = mrb_fixnum(mrb_offset);
+    }
+
+    mrb_limit = grn_mrb_options_get_lit(mrb, mrb_options, "limit");
+    if (!mrb_nil_p(mrb_limit)) {
+      limit = mrb_fixnum(mrb_limit);
+    }
+  }
+
+  mrb_runs = mrb_ary_new(mrb);
+  n_tables = RARRAY_LEN(mrb_sorted_tables);
+  if (n_tables == 0) {
+    return mrb_runs;
+  }
+
+  sorted_tables = GRN_MALLOCN(grn_obj *, n_tables);
+  keys_list = GRN_CALLOC(sizeof(grn_table_sort_key *) * n_tables);
+  if (!sorted_tables || !keys_list) {
+    if (sorted_tables) {
+      GRN_FREE(sorted_tables);
+    }
+    grn_mrb_ctx_check(mrb);
+    return mrb_runs;
+  }
+
+  GRN_UINT32_INIT(&runs, GRN_OBJ_VECTOR);
+  for (i = 0; i < n_tables; i++) {
+    grn_obj *sorted_table;
+    grn_obj *table;
+    unsigned int n_table_keys;
+
+    sorted_table = DATA_PTR(RARRAY_PTR(mrb_sorted_tables)[i]);
+    sorted_tables[i] = sorted_table;
+    table = grn_ctx_at(ctx, grn_obj_get_range(ctx, sorted_table));
+    if (!table) {
+      ERR(GRN_INVALID_ARGUMENT,
+          "[table][merge-sorted] sorted table must refer a table: <%d>", i);
+      break;
+    }
+    keys_list[i] = grn_table_sort_key_from_str(ctx, keys, keys_size,
+                                               table, &n_table_keys);
+    if (!keys_list[i]) {
+      if (ctx->rc == GRN_SUCCESS) {
+        ERR(GRN_INVALID_ARGUMENT,
+            "[table][merge-sorted] invalid sort keys: <%.*s>",
+            (int)keys_size, keys);
+      }
+      break;
+    }
+    if (i == 0) {
+      n_keys = n_table_keys;
+    } else if ((int)n_table_keys != n_keys) {
+      ERR(GRN_INVALID_ARGUMENT,
+          "[table][merge-sorted] sort keys aren't resolved in all tables: "
+          "<%.*s>",
+          (int)keys_size, keys);
+      grn_table_sort_key_close(ctx, keys_list[i], n_table_keys);
+      keys_list[i] = NULL;
+      break;
+    }
+  }
+
+  if (i == n_tables) {
+    grn_table_sort_merge(ctx, sorted_tables, keys_list, n_tables, n_keys,
+                         offset, limit, &runs);
+  }
+
+  for (i = 0; i < n_tables; i++) {
+    if (keys_list[i]) {
+      grn_table_sort_key_close(ctx, keys_list[i], n_keys);
+    }
+  }
+  GRN_FREE(keys_list);
+  GRN_FREE(sorted_tables);
+
+  if (ctx->rc == GRN_SUCCESS) {
+    int n_runs = GRN_BULK_VSIZE(&runs) / (sizeof(uint32_t) * 3);
+    for (i = 0; i < n_runs; i++) {
+      mrb_value mrb_run = mrb_ary_new_capa(mrb, 3);
+      mrb_ary_push(mrb, mrb_run,
+                   mrb_fixnum_value(GRN_UINT32_VALUE_AT(&runs, i * 3)));
+      mrb_ary_push(mrb, mrb_run,
+                   mrb_fixnum_value(GRN_UINT32_VALUE_AT(&runs, i * 3 + 1)));
+      mrb_ary_push(mrb, mrb_run,
+                   mrb_fixnum_value(GRN_UINT32_VALUE_AT(&runs, i * 3 + 2)));
+      mrb_ary_push(mrb, mrb_runs, mrb_run);
+    }
+  }
+  GRN_OBJ_FIN(ctx, &runs);
+  grn_mrb_ctx_check(mrb);
+
+  return mrb_runs;
+}
+
 static mrb_value
 mrb_grn_table_sort_raw(mrb_state *mrb, mrb_value self)
 {
@@ -321,8 +519,14 @@ grn_mrb_table_init(grn_ctx *ctx)
 
   mrb_define_method(mrb, klass, "select",
                     mrb_grn_table_select, MRB_ARGS_ARG(1, 1));
+  mrb_define_class_method(mrb, klass, "select_parallel",
+                          mrb_grn_table_s_select_parallel,
+                          MRB_ARGS_ARG(2, 1));
   mrb_define_method(mrb, klass, "sort_raw",
                     mrb_grn_table_sort_raw, MRB_ARGS_REQ(4));
+  mrb_define_class_method(mrb, klass, "merge_sorted",
+                          mrb_grn_table_s_merge_sorted,
+                          MRB_ARGS_ARG(2, 1));
   mrb_define_method(mrb, klass, "group_raw",
                     mrb_grn_table_group_raw, MRB_ARGS_REQ(2));
 
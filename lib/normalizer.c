@@ -22,6 +22,12 @@
 #include "grn_string.h"
 #include <groonga/normalizer.h>
 #include <groonga/tokenizer.h>
+#include <groonga/nfkc.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+# define GRN_NORMALIZER_USE_SSE2
+# include <emmintrin.h>
+#endif
 
 grn_rc
 grn_normalizer_register(grn_ctx *ctx,
@@ -57,9 +63,25 @@ grn_normalizer_register(grn_ctx *ctx,
   return GRN_SUCCESS;
 }
 
+#ifdef GRN_WITH_NFKC
+/*
+ * Character types of ASCII characters. They are copied from
+ * grn_nfkc_char_type() on initialization so that the ASCII fast path
+ * in utf8_normalize() doesn't need to walk the generated switch
+ * statements in nfkc.c.
+ */
+static uint_least8_t utf8_ascii_char_types[0x80];
+#endif /* GRN_WITH_NFKC */
+
 grn_rc
 grn_normalizer_init(void)
 {
+#ifdef GRN_WITH_NFKC
+  unsigned char c;
+  for (c = 0; c < 0x80; c++) {
+    utf8_ascii_char_types[c] = grn_nfkc_char_type(&c);
+  }
+#endif /* GRN_WITH_NFKC */
   return GRN_SUCCESS;
 }
 
@@ -612,6 +634,112 @@ grn_str_charlen_utf8(grn_ctx *ctx, const unsigned char *str, const unsigned char
   return 0;
 }
 
+static grn_bool
+utf8_normalize_expand(grn_ctx *ctx, grn_string *nstr, size_t *ds,
+                      size_t required,
+                      unsigned char **d, unsigned char **de,
+                      int16_t **ch, uint_least8_t **cp)
+{
+  unsigned char *normalized;
+  *ds += (*ds >> 1) + required;
+  if (!(normalized = GRN_REALLOC(nstr->normalized, *ds + 1))) {
+    if (nstr->ctypes) { GRN_FREE(nstr->ctypes); nstr->ctypes = NULL; }
+    if (nstr->checks) { GRN_FREE(nstr->checks); nstr->checks = NULL; }
+    GRN_FREE(nstr->normalized); nstr->normalized = NULL;
+    ERR(GRN_NO_MEMORY_AVAILABLE,
+        "[string][utf8] failed to expand normalized text space");
+    return GRN_FALSE;
+  }
+  *de = normalized + *ds;
+  *d = normalized + (*d - (unsigned char *)nstr->normalized);
+  nstr->normalized = (char *)normalized;
+  if (*ch) {
+    int16_t *checks;
+    if (!(checks = GRN_REALLOC(nstr->checks, *ds * sizeof(int16_t) + 1))) {
+      if (nstr->ctypes) { GRN_FREE(nstr->ctypes); nstr->ctypes = NULL; }
+      GRN_FREE(nstr->checks); nstr->checks = NULL;
+      GRN_FREE(nstr->normalized); nstr->normalized = NULL;
+      ERR(GRN_NO_MEMORY_AVAILABLE,
+          "[string][utf8] failed to expand checks space");
+      return GRN_FALSE;
+    }
+    *ch = checks + (*ch - nstr->checks);
+    nstr->checks = checks;
+  }
+  if (*cp) {
+    uint_least8_t *ctypes;
+    if (!(ctypes = GRN_REALLOC(nstr->ctypes, *ds + 1))) {
+      GRN_FREE(nstr->ctypes); nstr->ctypes = NULL;
+      if (nstr->checks) { GRN_FREE(nstr->checks); nstr->checks = NULL; }
+      GRN_FREE(nstr->normalized); nstr->normalized = NULL;
+      ERR(GRN_NO_MEMORY_AVAILABLE,
+          "[string][utf8] failed to expand character types space");
+      return GRN_FALSE;
+    }
+    *cp = ctypes + (*cp - nstr->ctypes);
+    nstr->ctypes = ctypes;
+  }
+  return GRN_TRUE;
+}
+
+/*
+ * Returns the number of leading bytes in [s, e) that are ASCII and
+ * greater than `threshold'. They can be normalized without NFKC
+ * mapping: grn_nfkc_map1() maps only 'A'..'Z' in ASCII and
+ * grn_nfkc_map2() never composes an ASCII suffix.
+ */
+static inline size_t
+utf8_normalize_ascii_run_length(const unsigned char *s,
+                                const unsigned char *e,
+                                unsigned char threshold)
+{
+  const unsigned char *p = s;
+#ifdef GRN_NORMALIZER_USE_SSE2
+  const __m128i thresholds = _mm_set1_epi8((char)threshold);
+  while (p + 16 <= e) {
+    /* Signed comparison: bytes >= 0x80 are negative and never match. */
+    __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+    int mask = _mm_movemask_epi8(_mm_cmpgt_epi8(chunk, thresholds));
+    if (mask != 0xffff) {
+      int i;
+      for (i = 0; mask & (1 << i); i++) {}
+      return (size_t)(p + i - s);
+    }
+    p += 16;
+  }
+#endif /* GRN_NORMALIZER_USE_SSE2 */
+  while (p < e && *p < 0x80 && *p > threshold) {
+    p++;
+  }
+  return (size_t)(p - s);
+}
+
+static inline void
+utf8_normalize_ascii_downcase(unsigned char *d, const unsigned char *s,
+                              size_t n)
+{
+  size_t i = 0;
+#ifdef GRN_NORMALIZER_USE_SSE2
+  const __m128i upper_min = _mm_set1_epi8('A' - 1);
+  const __m128i upper_max = _mm_set1_epi8('Z' + 1);
+  const __m128i case_bit = _mm_set1_epi8('a' - 'A');
+  for (; i + 16 <= n; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(s + i));
+    __m128i upper_p = _mm_and_si128(_mm_cmpgt_epi8(chunk, upper_min),
+                                    _mm_cmplt_epi8(chunk, upper_max));
+    _mm_storeu_si128((__m128i *)(d + i),
+                     _mm_or_si128(chunk, _mm_and_si128(upper_p, case_bit)));
+  }
+#endif /* GRN_NORMALIZER_USE_SSE2 */
+  for (; i < n; i++) {
+    unsigned char c = s[i];
+    if ('A' <= c && c <= 'Z') {
+      c += 'a' - 'A';
+    }
+    d[i] = c;
+  }
+}
+
 inline static grn_obj *
 utf8_normalize(grn_ctx *ctx, grn_string *nstr)
 {
@@ -623,6 +751,8 @@ utf8_normalize(grn_ctx *ctx, grn_string *nstr)
   int removeblankp = nstr->flags & GRN_STRING_REMOVE_BLANK;
   grn_bool remove_tokenized_delimiter_p =
     nstr->flags & GRN_STRING_REMOVE_TOKENIZED_DELIMITER;
+  /* ASCII characters greater than this are copied as-is (or downcased). */
+  unsigned char ascii_threshold = removeblankp ? ' ' : ' ' - 1;
   if (!(nstr->normalized = GRN_MALLOC(ds + 1))) {
     ERR(GRN_NO_MEMORY_AVAILABLE,
         "[string][utf8] failed to allocate normalized text space");
@@ -653,6 +783,42 @@ utf8_normalize(grn_ctx *ctx, grn_string *nstr)
   d_ = NULL;
   e = (unsigned char *)nstr->original + size;
   for (s = s_ = (unsigned char *)nstr->original; ; s += ls) {
+    if (s < e && *s < 0x80 && *s > ascii_threshold) {
+      size_t i, n;
+      n = utf8_normalize_ascii_run_length(s, e, ascii_threshold);
+      if (de <= d + n) {
+        if (!utf8_normalize_expand(ctx, nstr, &ds, n, &d, &de, &ch, &cp)) {
+          return NULL;
+        }
+      }
+      utf8_normalize_ascii_downcase(d, s, n);
+      if (cp) {
+        for (i = 0; i < n; i++) {
+          *cp++ = utf8_ascii_char_types[s[i]];
+        }
+      }
+      if (ch) {
+        if (s_ == s + 1) {
+          *ch++ = -1;
+        } else {
+          *ch++ = (int16_t)(s + 1 - s_);
+          s__ = s_;
+          s_ = s + 1;
+        }
+        for (i = 1; i < n; i++) {
+          *ch++ = 1;
+        }
+        if (n > 1) {
+          s__ = s + n - 1;
+          s_ = s + n;
+        }
+      }
+      d_ = d + n - 1;
+      d += n;
+      length += n;
+      ls = n;
+      continue;
+    }
     if (!(ls = grn_str_charlen_utf8(ctx, s, e))) {
       break;
     }
@@ -688,45 +854,9 @@ utf8_normalize(grn_ctx *ctx, grn_string *nstr)
         if (cp > nstr->ctypes) { *(cp - 1) |= GRN_CHAR_BLANK; }
       } else {
         if (de <= d + lp) {
-          unsigned char *normalized;
-          ds += (ds >> 1) + lp;
-          if (!(normalized = GRN_REALLOC(nstr->normalized, ds + 1))) {
-            if (nstr->ctypes) { GRN_FREE(nstr->ctypes); nstr->ctypes = NULL; }
-            if (nstr->checks) { GRN_FREE(nstr->checks); nstr->checks = NULL; }
-            GRN_FREE(nstr->normalized); nstr->normalized = NULL;
-            ERR(GRN_NO_MEMORY_AVAILABLE,
-                "[string][utf8] failed to expand normalized text space");
+          if (!utf8_normalize_expand(ctx, nstr, &ds, lp, &d, &de, &ch, &cp)) {
             return NULL;
           }
-          de = normalized + ds;
-          d = normalized + (d - (unsigned char *)nstr->normalized);
-          nstr->normalized = (char *)normalized;
-          if (ch) {
-            int16_t *checks;
-            if (!(checks = GRN_REALLOC(nstr->checks, ds * sizeof(int16_t) + 1))) {
-              if (nstr->ctypes) { GRN_FREE(nstr->ctypes); nstr->ctypes = NULL; }
-              GRN_FREE(nstr->checks); nstr->checks = NULL;
-              GRN_FREE(nstr->normalized); nstr->normalized = NULL;
-              ERR(GRN_NO_MEMORY_AVAILABLE,
-                  "[string][utf8] failed to expand checks space");
-              return NULL;
-            }
-            ch = checks + (ch - nstr->checks);
-            nstr->checks = checks;
-          }
-          if (cp) {
-            uint_least8_t *ctypes;
-            if (!(ctypes = GRN_REALLOC(nstr->ctypes, ds + 1))) {
-              GRN_FREE(nstr->ctypes); nstr->ctypes = NULL;
-              if (nstr->checks) { GRN_FREE(nstr->checks); nstr->checks = NULL; }
-              GRN_FREE(nstr->normalized); nstr->normalized = NULL;
-              ERR(GRN_NO_MEMORY_AVAILABLE,
-                  "[string][utf8] failed to expand character types space");
-              return NULL;
-            }
-            cp = ctypes + (cp - nstr->ctypes);
-            nstr->ctypes = ctypes;
-          }
         }
         grn_memcpy(d, p, lp);
         d_ = d;
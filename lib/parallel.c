@@ -0,0 +1,305 @@
+/* -*- c-basic-offset: 2 -*- */
+/*
+  Copyright(C) 2015 Brazil
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License version 2.1 as published by the Free Software Foundation.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "grn_parallel.h"
+#include "grn_ctx_impl.h"
+#include "grn_db.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _grn_parallel_batch grn_parallel_batch;
+struct _grn_parallel_batch {
+  grn_obj *db;
+  grn_parallel_select_task *tasks;
+  int n_tasks;
+  int next_task;
+  int n_done_tasks;
+  int n_joined_workers;
+  int max_n_joined_workers;
+  grn_parallel_batch *next;
+};
+
+typedef struct {
+  grn_mutex mutex;
+  /* signaled when a batch is queued or the pool is shut down */
+  grn_cond wake_cond;
+  /* signaled when a worker leaves a batch */
+  grn_cond done_cond;
+  grn_thread *threads;
+  int n_threads;
+  grn_bool shutdown;
+  grn_parallel_batch *batches;
+} grn_parallel_pool;
+
+static int grn_parallel_max_n_workers = GRN_PARALLEL_DEFAULT_MAX_N_WORKERS;
+static grn_parallel_pool grn_the_parallel_pool;
+
+void
+grn_parallel_init_from_env(void)
+{
+  char grn_parallel_max_n_workers_env[GRN_ENV_BUFFER_SIZE];
+  grn_getenv("GRN_PARALLEL_MAX_N_WORKERS",
+             grn_parallel_max_n_workers_env,
+             GRN_ENV_BUFFER_SIZE);
+  if (grn_parallel_max_n_workers_env[0]) {
+    int max_n_workers = atoi(grn_parallel_max_n_workers_env);
+    if (max_n_workers >= 1) {
+      grn_parallel_max_n_workers = max_n_workers;
+    }
+  }
+}
+
+grn_rc
+grn_parallel_init(void)
+{
+  grn_parallel_pool *pool = &grn_the_parallel_pool;
+
+  MUTEX_INIT(pool->mutex);
+  COND_INIT(pool->wake_cond);
+  COND_INIT(pool->done_cond);
+  pool->threads = NULL;
+  pool->n_threads = 0;
+  pool->shutdown = GRN_FALSE;
+  pool->batches = NULL;
+  return GRN_SUCCESS;
+}
+
+grn_rc
+grn_parallel_fin(void)
+{
+  grn_ctx *ctx = &grn_gctx;
+  grn_parallel_pool *pool = &grn_the_parallel_pool;
+  int i;
+
+  MUTEX_LOCK(pool->mutex);
+  pool->shutdown = GRN_TRUE;
+  COND_BROADCAST(pool->wake_cond);
+  MUTEX_UNLOCK(pool->mutex);
+
+  for (i = 0; i < pool->n_threads; i++) {
+    THREAD_JOIN(pool->threads[i]);
+  }
+  if (pool->threads) {
+    GRN_FREE(pool->threads);
+    pool->threads = NULL;
+  }
+  pool->n_threads = 0;
+  MUTEX_FIN(pool->mutex);
+  return GRN_SUCCESS;
+}
+
+int
+grn_parallel_get_max_n_workers(void)
+{
+  return grn_parallel_max_n_workers;
+}
+
+static void
+grn_parallel_select_task_run(grn_ctx *ctx, grn_parallel_select_task *task,
+                             grn_bool borrow_vars)
+{
+  grn_id expression_id = DB_OBJ(task->expression)->id;
+
+  if (borrow_vars) {
+    grn_hash **vars;
+    if (grn_hash_add(ctx, ctx->impl->expr_vars,
+                     &expression_id, sizeof(grn_id),
+                     (void **)&vars, NULL)) {
+      *vars = task->vars;
+    }
+  }
+  grn_table_select(ctx, task->table, task->expression, task->result,
+                   GRN_OP_OR);
+  if (borrow_vars) {
+    grn_hash_delete(ctx, ctx->impl->expr_vars,
+                    &expression_id, sizeof(grn_id), NULL);
+  }
+  task->rc = ctx->rc;
+  if (task->rc != GRN_SUCCESS) {
+    grn_strcpy(task->message, GRN_CTX_MSGSIZE, ctx->errbuf);
+    ERRCLR(ctx);
+  }
+}
+
+/* Must be called with the pool mutex locked. */
+static void
+grn_parallel_batch_run(grn_ctx *ctx, grn_parallel_pool *pool,
+                       grn_parallel_batch *batch, grn_bool borrow_vars)
+{
+  while (batch->next_task < batch->n_tasks) {
+    grn_parallel_select_task *task = batch->tasks + batch->next_task;
+    batch->next_task++;
+    MUTEX_UNLOCK(pool->mutex);
+    grn_parallel_select_task_run(ctx, task, borrow_vars);
+    MUTEX_LOCK(pool->mutex);
+    batch->n_done_tasks++;
+  }
+}
+
+/* Must be called with the pool mutex locked. */
+static grn_parallel_batch *
+grn_parallel_pool_find_batch(grn_parallel_pool *pool)
+{
+  grn_parallel_batch *batch;
+
+  for (batch = pool->batches; batch; batch = batch->next) {
+    if (batch->next_task < batch->n_tasks &&
+        batch->n_joined_workers < batch->max_n_joined_workers) {
+      return batch;
+    }
+  }
+  return NULL;
+}
+
+static grn_thread_func_result CALLBACK
+grn_parallel_worker(void *data)
+{
+  grn_parallel_pool *pool = data;
+  grn_ctx ctx_, *ctx = &ctx_;
+
+  grn_ctx_init(ctx, 0);
+
+  MUTEX_LOCK(pool->mutex);
+  while (!pool->shutdown) {
+    grn_parallel_batch *batch;
+
+    batch = grn_parallel_pool_find_batch(pool);
+    if (!batch) {
+      COND_WAIT(pool->wake_cond, pool->mutex);
+      continue;
+    }
+
+    batch->n_joined_workers++;
+    MUTEX_UNLOCK(pool->mutex);
+    grn_ctx_use(ctx, batch->db);
+    MUTEX_LOCK(pool->mutex);
+    grn_parallel_batch_run(ctx, pool, batch, GRN_TRUE);
+    MUTEX_UNLOCK(pool->mutex);
+    /* The database may be closed after the batch is done. */
+    grn_ctx_use(ctx, NULL);
+    MUTEX_LOCK(pool->mutex);
+    batch->n_joined_workers--;
+    COND_BROADCAST(pool->done_cond);
+  }
+  MUTEX_UNLOCK(pool->mutex);
+
+  grn_ctx_fin(ctx);
+
+  return GRN_THREAD_FUNC_RETURN_VALUE;
+}
+
+/* Must be called with the pool mutex locked. */
+static void
+grn_parallel_pool_spawn(grn_ctx *ctx, grn_parallel_pool *pool,
+                        int n_threads)
+{
+  if (n_threads > grn_parallel_max_n_workers - 1) {
+    n_threads = grn_parallel_max_n_workers - 1;
+  }
+  if (n_threads <= pool->n_threads) {
+    return;
+  }
+
+  if (!pool->threads) {
+    pool->threads = GRN_MALLOCN(grn_thread, grn_parallel_max_n_workers);
+    if (!pool->threads) {
+      GRN_LOG(ctx, GRN_LOG_WARNING,
+              "[parallel] failed to allocate worker threads");
+      return;
+    }
+  }
+
+  while (pool->n_threads < n_threads) {
+    if (THREAD_CREATE(pool->threads[pool->n_threads],
+                      grn_parallel_worker, pool)) {
+      GRN_LOG(ctx, GRN_LOG_WARNING,
+              "[parallel] failed to create a worker thread: <%d>",
+              pool->n_threads);
+      break;
+    }
+    pool->n_threads++;
+  }
+}
+
+grn_rc
+grn_parallel_select(grn_ctx *ctx,
+                    grn_parallel_select_task *tasks,
+                    int n_tasks,
+                    int n_workers)
+{
+  grn_parallel_pool *pool = &grn_the_parallel_pool;
+  grn_parallel_batch batch;
+  grn_parallel_batch **previous;
+  int i;
+
+  GRN_API_ENTER;
+
+  for (i = 0; i < n_tasks; i++) {
+    unsigned int n_vars;
+    tasks[i].rc = GRN_SUCCESS;
+    tasks[i].message[0] = '\0';
+    tasks[i].vars = grn_expr_get_vars(ctx, tasks[i].expression, &n_vars);
+  }
+
+  if (n_workers > n_tasks) {
+    n_workers = n_tasks;
+  }
+  if (n_workers > grn_parallel_max_n_workers) {
+    n_workers = grn_parallel_max_n_workers;
+  }
+
+  batch.db = grn_ctx_db(ctx);
+  batch.tasks = tasks;
+  batch.n_tasks = n_tasks;
+  batch.next_task = 0;
+  batch.n_done_tasks = 0;
+  batch.n_joined_workers = 0;
+  batch.max_n_joined_workers = n_workers - 1;
+  batch.next = NULL;
+
+  MUTEX_LOCK(pool->mutex);
+  if (batch.max_n_joined_workers > 0) {
+    grn_parallel_pool_spawn(ctx, pool, batch.max_n_joined_workers);
+    batch.next = pool->batches;
+    pool->batches = &batch;
+    COND_BROADCAST(pool->wake_cond);
+  }
+  grn_parallel_batch_run(ctx, pool, &batch, GRN_FALSE);
+  while (batch.n_done_tasks < batch.n_tasks || batch.n_joined_workers > 0) {
+    COND_WAIT(pool->done_cond, pool->mutex);
+  }
+  for (previous = &(pool->batches);
+       *previous;
+       previous = &((*previous)->next)) {
+    if (*previous == &batch) {
+      *previous = batch.next;
+      break;
+    }
+  }
+  MUTEX_UNLOCK(pool->mutex);
+
+  for (i = 0; i < n_tasks; i++) {
+    if (tasks[i].rc != GRN_SUCCESS) {
+      ERR(tasks[i].rc, "%s", tasks[i].message);
+      break;
+    }
+  }
+
+  GRN_API_RETURN(ctx->rc);
+}
@@ -1340,6 +1340,31 @@ grn_pat_get_key2(grn_ctx *ctx, grn_pat *pat, grn_id id, grn_obj *bulk)
   return len;
 }
 
+grn_id
+grn_pat_root_node(grn_ctx *ctx, grn_pat *pat)
+{
+  pat_node *node;
+  PAT_AT(pat, GRN_ID_NIL, node);
+  if (!node) { return GRN_ID_NIL; }
+  return node->lr[1];
+}
+
+grn_rc
+grn_pat_node_get_info(grn_ctx *ctx, grn_pat *pat, grn_id id,
+                      grn_pat_node_info *info)
+{
+  pat_node *node;
+  PAT_AT(pat, id, node);
+  if (!node) { return GRN_INVALID_ARGUMENT; }
+  info->check = PAT_CHK(node);
+  info->children[0] = node->lr[0];
+  info->children[1] = node->lr[1];
+  info->key = pat_node_get_key(ctx, pat, node);
+  info->key_size = PAT_LEN(node);
+  if (!info->key) { return GRN_FILE_CORRUPT; }
+  return GRN_SUCCESS;
+}
+
 int
 grn_pat_get_value(grn_ctx *ctx, grn_pat *pat, grn_id id, void *valuebuf)
 {
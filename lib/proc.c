@@ -24,7 +24,10 @@
 #include "grn_pat.h"
 #include "grn_geo.h"
 #include "grn_token_cursor.h"
+#include "grn_lexicon_cache.h"
 #include "grn_expr.h"
+#include "grn_expr_cache.h"
+#include "grn_statistics.h"
 
 #ifdef GRN_WITH_TS
 # include "grn_ts.h"
@@ -61,6 +64,7 @@ const char *grn_document_root = NULL;
 
 #define GRN_SELECT_INTERNAL_VAR_CONDITION     "$condition"
 #define GRN_SELECT_INTERNAL_VAR_MATCH_COLUMNS "$match_columns"
+#define GRN_SELECT_INTERNAL_VAR_SNIPPET_HTML  "$snippet_html"
 
 
 static double grn_between_too_many_index_match_ratio = 0.01;
@@ -905,7 +909,10 @@ grn_select(grn_ctx *ctx, const char *table, unsigned int table_len,
   uint32_t cache_key_size;
   long long int threshold, original_threshold = 0;
   grn_cache *cache_obj = grn_cache_current_get(ctx);
+  grn_bool cond_is_cached = GRN_FALSE;
+  grn_obj filter_literals;
 
+  GRN_TEXT_INIT(&filter_literals, 0);
   {
     const char *query_end = query + query_len;
     int space_len;
@@ -1026,8 +1033,27 @@ grn_select(grn_ctx *ctx, const char *table, unsigned int table_len,
 #endif /* GRN_WITH_TS */
     if (query_len || filter_len) {
       grn_obj *v;
-      GRN_EXPR_CREATE_FOR_QUERY(ctx, table_, cond, v);
-      if (cond) {
+      grn_expr_cache_key expr_cache_key;
+      /* The expanded query depends on the content of the expander. */
+      grn_bool use_expr_cache =
+        (query_expander_len == 0 && grn_expr_cache_is_enabled(ctx));
+      if (use_expr_cache) {
+        expr_cache_key.table = table_;
+        expr_cache_key.match_columns = match_columns;
+        expr_cache_key.match_columns_len = match_columns_len;
+        expr_cache_key.query = query;
+        expr_cache_key.query_len = query_len;
+        expr_cache_key.query_flags = query_flags;
+        expr_cache_key.query_flags_len = query_flags_len;
+        expr_cache_key.filter = filter;
+        expr_cache_key.filter_len = filter_len;
+        cond_is_cached = grn_expr_cache_fetch(ctx, &expr_cache_key,
+                                              &cond, &match_columns_);
+      }
+      if (!cond_is_cached) {
+        GRN_EXPR_CREATE_FOR_QUERY(ctx, table_, cond, v);
+      }
+      if (cond && !cond_is_cached) {
         if (match_columns_len) {
           GRN_EXPR_CREATE_FOR_QUERY(ctx, table_, match_columns_, v);
           if (match_columns_) {
@@ -1069,16 +1095,27 @@ grn_select(grn_ctx *ctx, const char *table, unsigned int table_len,
                          match_columns_, GRN_OP_MATCH, GRN_OP_AND, flags);
           GRN_OBJ_FIN(ctx, &query_expander_buf);
           if (!ctx->rc && filter_len) {
-            grn_expr_parse(ctx, cond, filter, filter_len,
-                           match_columns_, GRN_OP_MATCH, GRN_OP_AND,
-                           GRN_EXPR_SYNTAX_SCRIPT);
+            grn_expr_parse_with_literals(ctx, cond, filter, filter_len,
+                                         match_columns_,
+                                         GRN_OP_MATCH, GRN_OP_AND,
+                                         GRN_EXPR_SYNTAX_SCRIPT,
+                                         &filter_literals);
             if (!ctx->rc) { grn_expr_append_op(ctx, cond, GRN_OP_AND, 2); }
           }
         } else {
-          grn_expr_parse(ctx, cond, filter, filter_len,
-                         match_columns_, GRN_OP_MATCH, GRN_OP_AND,
-                         GRN_EXPR_SYNTAX_SCRIPT);
+          grn_expr_parse_with_literals(ctx, cond, filter, filter_len,
+                                       match_columns_,
+                                       GRN_OP_MATCH, GRN_OP_AND,
+                                       GRN_EXPR_SYNTAX_SCRIPT,
+                                       &filter_literals);
+        }
+        if (!ctx->rc && use_expr_cache) {
+          cond_is_cached = grn_expr_cache_add(ctx, &expr_cache_key,
+                                              cond, match_columns_,
+                                              &filter_literals);
         }
+      }
+      if (cond) {
         cacheable *= ((grn_expr *)cond)->cacheable;
         taintable += ((grn_expr *)cond)->taintable;
         /*
@@ -1220,12 +1257,17 @@ exit :
   if (match_escalation_threshold_len) {
     grn_ctx_set_match_escalation_threshold(ctx, original_threshold);
   }
-  if (match_columns_) {
-    grn_obj_unlink(ctx, match_columns_);
-  }
-  if (cond) {
-    grn_obj_unlink(ctx, cond);
+  if (cond_is_cached) {
+    grn_expr_cache_release(ctx, cond);
+  } else {
+    if (match_columns_) {
+      grn_obj_unlink(ctx, match_columns_);
+    }
+    if (cond) {
+      grn_obj_unlink(ctx, cond);
+    }
   }
+  GRN_OBJ_FIN(ctx, &filter_literals);
   /* GRN_LOG(ctx, GRN_LOG_NONE, "%d", ctx->seqno); */
   return ctx->rc;
 }
@@ -1412,11 +1454,15 @@ proc_status(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
   grn_timeval now;
   grn_cache *cache;
   grn_cache_statistics statistics;
+  grn_lexicon_cache_statistics lexicon_cache_statistics;
+  grn_expr_cache_statistics expr_cache_statistics;
 
   grn_timeval_now(ctx, &now);
   cache = grn_cache_current_get(ctx);
   grn_cache_get_statistics(ctx, cache, &statistics);
-  GRN_OUTPUT_MAP_OPEN("RESULT", 9);
+  grn_lexicon_cache_get_statistics(ctx, &lexicon_cache_statistics);
+  grn_expr_cache_get_statistics(ctx, &expr_cache_statistics);
+  GRN_OUTPUT_MAP_OPEN("RESULT", 13);
   GRN_OUTPUT_CSTR("alloc_count");
   GRN_OUTPUT_INT32(grn_alloc_count());
   GRN_OUTPUT_CSTR("starttime");
@@ -1441,6 +1487,30 @@ proc_status(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
   GRN_OUTPUT_INT32(grn_get_default_command_version());
   GRN_OUTPUT_CSTR("max_command_version");
   GRN_OUTPUT_INT32(GRN_COMMAND_VERSION_MAX);
+  GRN_OUTPUT_CSTR("n_lexicon_cache_lookups");
+  GRN_OUTPUT_INT64(lexicon_cache_statistics.n_lookups);
+  GRN_OUTPUT_CSTR("lexicon_cache_hit_rate");
+  if (lexicon_cache_statistics.n_lookups == 0) {
+    GRN_OUTPUT_FLOAT(0.0);
+  } else {
+    double lexicon_cache_hit_rate;
+    lexicon_cache_hit_rate =
+      (double)lexicon_cache_statistics.n_hits /
+      (double)lexicon_cache_statistics.n_lookups;
+    GRN_OUTPUT_FLOAT(lexicon_cache_hit_rate * 100.0);
+  }
+  GRN_OUTPUT_CSTR("n_expression_cache_fetches");
+  GRN_OUTPUT_INT64(expr_cache_statistics.n_fetches);
+  GRN_OUTPUT_CSTR("expression_cache_hit_rate");
+  if (expr_cache_statistics.n_fetches == 0) {
+    GRN_OUTPUT_FLOAT(0.0);
+  } else {
+    double expr_cache_hit_rate;
+    expr_cache_hit_rate =
+      (double)expr_cache_statistics.n_hits /
+      (double)expr_cache_statistics.n_fetches;
+    GRN_OUTPUT_FLOAT(expr_cache_hit_rate * 100.0);
+  }
   GRN_OUTPUT_MAP_CLOSE();
   return NULL;
 }
@@ -5004,6 +5074,7 @@ func_snippet_html(grn_ctx *ctx, int nargs, grn_obj **args,
     grn_obj *expression = NULL;
     grn_obj *condition_ptr = NULL;
     grn_obj *condition = NULL;
+    grn_obj *snip_ptr = NULL;
     grn_obj *snip = NULL;
     int flags = GRN_SNIP_SKIP_LEADING_SPACES;
     unsigned int width = 200;
@@ -5013,11 +5084,22 @@ func_snippet_html(grn_ctx *ctx, int nargs, grn_obj **args,
     grn_snip_mapping *mapping = GRN_SNIP_MAPPING_HTML_ESCAPE;
 
     grn_proc_get_info(ctx, user_data, NULL, NULL, &expression);
-    condition_ptr = grn_expr_get_var(ctx, expression,
-                                     GRN_SELECT_INTERNAL_VAR_CONDITION,
-                                     strlen(GRN_SELECT_INTERNAL_VAR_CONDITION));
-    if (condition_ptr) {
-      condition = GRN_PTR_VALUE(condition_ptr);
+
+    /* The snip is shared by all records in the same output. */
+    snip_ptr = grn_expr_get_or_add_var(ctx, expression,
+                                       GRN_SELECT_INTERNAL_VAR_SNIPPET_HTML,
+                                       strlen(GRN_SELECT_INTERNAL_VAR_SNIPPET_HTML));
+    if (snip_ptr && snip_ptr->header.type == GRN_PTR) {
+      snip = GRN_PTR_VALUE(snip_ptr);
+    }
+
+    if (!snip) {
+      condition_ptr = grn_expr_get_var(ctx, expression,
+                                       GRN_SELECT_INTERNAL_VAR_CONDITION,
+                                       strlen(GRN_SELECT_INTERNAL_VAR_CONDITION));
+      if (condition_ptr) {
+        condition = GRN_PTR_VALUE(condition_ptr);
+      }
     }
 
     if (condition) {
@@ -5029,12 +5111,19 @@ func_snippet_html(grn_ctx *ctx, int nargs, grn_obj **args,
         grn_snip_set_normalizer(ctx, snip, GRN_NORMALIZER_AUTO);
         grn_expr_snip_add_conditions(ctx, condition, snip,
                                      0, NULL, NULL, NULL, NULL);
+        if (snip_ptr) {
+          GRN_PTR_INIT(snip_ptr, 0, GRN_DB_OBJECT);
+          GRN_PTR_SET(ctx, snip_ptr, snip);
+          grn_expr_take_obj(ctx, expression, snip);
+        }
       }
     }
 
     if (snip) {
       snippets = snippet_exec(ctx, snip, text, user_data);
-      grn_obj_close(ctx, snip);
+      if (!snip_ptr) {
+        grn_obj_close(ctx, snip);
+      }
     }
   }
 
@@ -7228,6 +7317,101 @@ exit :
   return NULL;
 }
 
+static grn_rc
+proc_statistics_update_column(grn_ctx *ctx, grn_obj *table,
+                              const char *name, int name_size)
+{
+  grn_obj *column;
+
+  column = grn_obj_column(ctx, table, name, name_size);
+  if (!column) {
+    char table_name[GRN_TABLE_MAX_KEY_SIZE];
+    int table_name_size;
+    table_name_size = grn_obj_name(ctx, table,
+                                   table_name, GRN_TABLE_MAX_KEY_SIZE);
+    ERR(GRN_INVALID_ARGUMENT,
+        "[statistics][update] column doesn't exist: <%.*s.%.*s>",
+        table_name_size, table_name,
+        name_size, name);
+    return ctx->rc;
+  }
+  grn_statistics_update(ctx, column);
+  grn_obj_unlink(ctx, column);
+  return ctx->rc;
+}
+
+static grn_obj *
+proc_statistics_update(grn_ctx *ctx, int nargs, grn_obj **args,
+                       grn_user_data *user_data)
+{
+  grn_obj *table_name = VAR(0);
+  grn_obj *column_names = VAR(1);
+  grn_obj *table;
+
+  if (GRN_TEXT_LEN(table_name) == 0) {
+    ERR(GRN_INVALID_ARGUMENT, "[statistics][update] table name is missing");
+    GRN_OUTPUT_BOOL(GRN_FALSE);
+    return NULL;
+  }
+  table = grn_ctx_get(ctx, GRN_TEXT_VALUE(table_name), GRN_TEXT_LEN(table_name));
+  if (!table) {
+    ERR(GRN_INVALID_ARGUMENT,
+        "[statistics][update] table doesn't exist: <%.*s>",
+        (int)GRN_TEXT_LEN(table_name), GRN_TEXT_VALUE(table_name));
+    GRN_OUTPUT_BOOL(GRN_FALSE);
+    return NULL;
+  }
+
+  if (GRN_TEXT_LEN(column_names) == 0) {
+    grn_hash *columns;
+    columns = grn_hash_create(ctx, NULL, sizeof(grn_id), 0,
+                              GRN_OBJ_TABLE_HASH_KEY|GRN_HASH_TINY);
+    if (columns) {
+      if (grn_table_columns(ctx, table, NULL, 0, (grn_obj *)columns) >= 0) {
+        grn_id *key;
+        GRN_HASH_EACH(ctx, columns, id, &key, NULL, NULL, {
+          grn_obj *column;
+          if (ctx->rc != GRN_SUCCESS) {
+            break;
+          }
+          if ((column = grn_ctx_at(ctx, *key))) {
+            if (grn_statistics_is_supported(ctx, column)) {
+              grn_statistics_update(ctx, column);
+            }
+            grn_obj_unlink(ctx, column);
+          }
+        });
+      }
+      grn_hash_close(ctx, columns);
+    }
+  } else {
+    const char *current = GRN_TEXT_VALUE(column_names);
+    const char *end = current + GRN_TEXT_LEN(column_names);
+    while (current < end && ctx->rc == GRN_SUCCESS) {
+      const char *name_start, *name_end;
+      while (current < end && (*current == ' ' || *current == ',')) {
+        current++;
+      }
+      name_start = current;
+      while (current < end && *current != ',') {
+        current++;
+      }
+      name_end = current;
+      while (name_end > name_start && name_end[-1] == ' ') {
+        name_end--;
+      }
+      if (name_end > name_start) {
+        proc_statistics_update_column(ctx, table,
+                                      name_start, name_end - name_start);
+      }
+    }
+  }
+
+  grn_obj_unlink(ctx, table);
+  GRN_OUTPUT_BOOL(ctx->rc == GRN_SUCCESS);
+  return NULL;
+}
+
 #define DEF_VAR(v,name_str) do {\
   (v).name = (name_str);\
   (v).name_size = GRN_STRLEN(name_str);\
@@ -7525,4 +7709,8 @@ grn_db_init_builtin_query(grn_ctx *ctx)
   DEF_VAR(vars[2], "to_table");
   DEF_VAR(vars[3], "to_name");
   DEF_COMMAND("column_copy", proc_column_copy, 4, vars);
+
+  DEF_VAR(vars[0], "table");
+  DEF_VAR(vars[1], "columns");
+  DEF_COMMAND("statistics_update", proc_statistics_update, 2, vars);
 }
@@ -218,6 +218,290 @@ grn_bm_tunedbm(grn_ctx *ctx, snip_cond *cond, grn_obj *string, int flags)
   cond->stopflag = SNIPCOND_STOP;
 }
 
+/*
+  grn_snip_matcher is an Aho-Corasick automaton over the normalized
+  keywords of all conditions. grn_bm_tunedbm() scans the text once per
+  condition but the matcher scans it only once for all conditions. The
+  text is scanned lazily: scanning stops when the requested condition
+  is found and found positions of the other conditions are kept for
+  later requests. The matcher has no transition table when keywords
+  are too long. grn_bm_tunedbm() is used in the case.
+
+  Bytes are mapped to classes that appear in keywords to keep the
+  transition table small. Outputs are stored as bit flags of condition
+  indexes. It works because MAX_SNIP_COND_COUNT is 32.
+*/
+
+#define GRN_SNIP_MATCHER_MIN_N_CONDS 2
+#define GRN_SNIP_MATCHER_MAX_N_TRANSITIONS (1024 * 1024)
+
+struct _grn_snip_matcher {
+  unsigned int n_conds;
+  unsigned int n_classes;
+  uint16_t classes[ASIZE];
+  uint32_t *transitions;
+  uint32_t *outputs;
+  unsigned int keyword_lengths[MAX_SNIP_COND_COUNT];
+
+  /* scan status */
+  uint32_t state;
+  size_t scanned;
+  grn_obj positions[MAX_SNIP_COND_COUNT];
+  size_t cursors[MAX_SNIP_COND_COUNT];
+};
+
+static void
+grn_snip_matcher_close(grn_ctx *ctx, grn_snip_matcher *matcher)
+{
+  unsigned int i;
+
+  if (!matcher) {
+    return;
+  }
+  for (i = 0; i < matcher->n_conds; i++) {
+    GRN_OBJ_FIN(ctx, &(matcher->positions[i]));
+  }
+  if (matcher->transitions) {
+    GRN_FREE(matcher->transitions);
+  }
+  if (matcher->outputs) {
+    GRN_FREE(matcher->outputs);
+  }
+  GRN_FREE(matcher);
+}
+
+static grn_snip_matcher *
+grn_snip_matcher_open(grn_ctx *ctx, snip_cond *conds, unsigned int n_conds)
+{
+  grn_snip_matcher *matcher;
+  unsigned int i, c, n_classes;
+  size_t n_states, max_n_states;
+  uint32_t *transitions, *fails = NULL, *queue = NULL;
+  size_t queue_head, queue_tail;
+
+  matcher = GRN_MALLOC(sizeof(grn_snip_matcher));
+  if (!matcher) {
+    return NULL;
+  }
+  matcher->n_conds = n_conds;
+  matcher->transitions = NULL;
+  matcher->outputs = NULL;
+  for (i = 0; i < n_conds; i++) {
+    GRN_UINT32_INIT(&(matcher->positions[i]), 0);
+  }
+
+  memset(matcher->classes, 0, sizeof(matcher->classes));
+  n_classes = 1;
+  max_n_states = 1;
+  for (i = 0; i < n_conds; i++) {
+    const char *keyword;
+    unsigned int j, keyword_length;
+    grn_string_get_normalized(ctx, conds[i].keyword,
+                              &keyword, &keyword_length, NULL);
+    for (j = 0; j < keyword_length; j++) {
+      unsigned char byte = (unsigned char)keyword[j];
+      if (matcher->classes[byte] == 0) {
+        matcher->classes[byte] = n_classes++;
+      }
+    }
+    matcher->keyword_lengths[i] = keyword_length;
+    max_n_states += keyword_length;
+  }
+  matcher->n_classes = n_classes;
+  if (max_n_states * n_classes > GRN_SNIP_MATCHER_MAX_N_TRANSITIONS) {
+    /* too many long keywords. grn_bm_tunedbm() is used instead. */
+    return matcher;
+  }
+
+  transitions = GRN_CALLOC(sizeof(uint32_t) * max_n_states * n_classes);
+  matcher->transitions = transitions;
+  matcher->outputs = GRN_CALLOC(sizeof(uint32_t) * max_n_states);
+  fails = GRN_MALLOC(sizeof(uint32_t) * max_n_states);
+  queue = GRN_MALLOC(sizeof(uint32_t) * max_n_states);
+  if (!transitions || !matcher->outputs || !fails || !queue) {
+    goto exit;
+  }
+
+  /* build trie. 0 is the root and also means "no transition". */
+  n_states = 1;
+  for (i = 0; i < n_conds; i++) {
+    const char *keyword;
+    unsigned int j, keyword_length;
+    uint32_t state = 0;
+    grn_string_get_normalized(ctx, conds[i].keyword,
+                              &keyword, &keyword_length, NULL);
+    for (j = 0; j < keyword_length; j++) {
+      uint32_t *next;
+      c = matcher->classes[(unsigned char)keyword[j]];
+      next = transitions + state * n_classes + c;
+      if (*next == 0) {
+        *next = n_states++;
+      }
+      state = *next;
+    }
+    matcher->outputs[state] |= (1U << i);
+  }
+
+  /* compute failure transitions in breadth first order and complete
+     the transition table with them */
+  queue_head = queue_tail = 0;
+  for (c = 0; c < n_classes; c++) {
+    uint32_t state = transitions[c];
+    if (state) {
+      fails[state] = 0;
+      queue[queue_tail++] = state;
+    }
+  }
+  while (queue_head < queue_tail) {
+    uint32_t state = queue[queue_head++];
+    uint32_t *row = transitions + state * n_classes;
+    uint32_t *fail_row = transitions + fails[state] * n_classes;
+    for (c = 0; c < n_classes; c++) {
+      uint32_t next = row[c];
+      if (next) {
+        fails[next] = fail_row[c];
+        matcher->outputs[next] |= matcher->outputs[fails[next]];
+        queue[queue_tail++] = next;
+      } else {
+        row[c] = fail_row[c];
+      }
+    }
+  }
+
+  GRN_FREE(fails);
+  GRN_FREE(queue);
+  return matcher;
+
+exit :
+  if (fails) {
+    GRN_FREE(fails);
+  }
+  if (queue) {
+    GRN_FREE(queue);
+  }
+  grn_snip_matcher_close(ctx, matcher);
+  return NULL;
+}
+
+static void
+grn_snip_matcher_reinit(grn_snip_matcher *matcher)
+{
+  unsigned int i;
+
+  matcher->state = 0;
+  matcher->scanned = 0;
+  for (i = 0; i < matcher->n_conds; i++) {
+    GRN_BULK_REWIND(&(matcher->positions[i]));
+    matcher->cursors[i] = 0;
+  }
+}
+
+/* Scans until the cond_index-th condition is found or the text ends. */
+static void
+grn_snip_matcher_scan(grn_ctx *ctx, grn_snip_matcher *matcher,
+                      const unsigned char *text, size_t text_length,
+                      unsigned int cond_index)
+{
+  const uint32_t *transitions = matcher->transitions;
+  const uint16_t *classes = matcher->classes;
+  unsigned int n_classes = matcher->n_classes;
+  uint32_t state = matcher->state;
+  size_t i = matcher->scanned;
+
+  while (i < text_length) {
+    uint32_t outputs;
+    state = transitions[state * n_classes + classes[text[i++]]];
+    outputs = matcher->outputs[state];
+    if (outputs) {
+      unsigned int j;
+      for (j = 0; outputs; j++, outputs >>= 1) {
+        if (outputs & 1) {
+          GRN_UINT32_PUT(ctx, &(matcher->positions[j]),
+                         i - matcher->keyword_lengths[j]);
+        }
+      }
+      if (matcher->outputs[state] & (1U << cond_index)) {
+        break;
+      }
+    }
+  }
+  matcher->state = state;
+  matcher->scanned = i;
+}
+
+static grn_bool
+grn_snip_matcher_next(grn_ctx *ctx, grn_snip_matcher *matcher,
+                      const unsigned char *text, size_t text_length,
+                      unsigned int cond_index, size_t from, size_t *found)
+{
+  grn_obj *positions = &(matcher->positions[cond_index]);
+  size_t *cursor = &(matcher->cursors[cond_index]);
+
+  while (GRN_TRUE) {
+    size_t n_positions = GRN_BULK_VSIZE(positions) / sizeof(uint32_t);
+    while (*cursor < n_positions) {
+      size_t position = GRN_UINT32_VALUE_AT(positions, *cursor);
+      if (position >= from) {
+        *found = position;
+        return GRN_TRUE;
+      }
+      (*cursor)++;
+    }
+    if (matcher->scanned >= text_length) {
+      return GRN_FALSE;
+    }
+    grn_snip_matcher_scan(ctx, matcher, text, text_length, cond_index);
+  }
+}
+
+/* The same as grn_bm_tunedbm() but uses found positions by the matcher. */
+static void
+grn_snip_matcher_search(grn_ctx *ctx, grn_snip_matcher *matcher,
+                        snip_cond *cond, unsigned int cond_index,
+                        grn_obj *string, int flags)
+{
+  size_t i, shift, found, from;
+
+  const char *string_original;
+  unsigned int string_original_length_in_bytes;
+  const short *string_checks;
+  grn_encoding string_encoding;
+  const char *string_norm;
+  unsigned int n, m;
+
+  grn_string_get_original(ctx, string,
+                          &string_original, &string_original_length_in_bytes);
+  string_checks = grn_string_get_checks(ctx, string);
+  string_encoding = grn_string_get_encoding(ctx, string);
+  grn_string_get_normalized(ctx, string, &string_norm, &n, NULL);
+  m = matcher->keyword_lengths[cond_index];
+  shift = (m == 1) ? 1 : cond->shift;
+
+  from = cond->found;
+  while (grn_snip_matcher_next(ctx, matcher,
+                               (const unsigned char *)string_norm, n,
+                               cond_index, from, &found)) {
+    GRN_BM_COMPARE;
+    if (m == 1) {
+      /* grn_bm_tunedbm() doesn't search more for a one byte keyword. */
+      break;
+    }
+    from = found + 1;
+  }
+  cond->stopflag = SNIPCOND_STOP;
+}
+
+static void
+grn_snip_cond_search(grn_ctx *ctx, grn_snip *snip, snip_cond *cond)
+{
+  if (snip->matcher && snip->matcher->transitions) {
+    grn_snip_matcher_search(ctx, snip->matcher, cond, cond - snip->cond,
+                            snip->nstr, snip->flags);
+  } else {
+    grn_bm_tunedbm(ctx, cond, snip->nstr, snip->flags);
+  }
+}
+
 static size_t
 count_mapped_chars(const char *str, const char *end)
 {
@@ -417,6 +701,10 @@ grn_snip_add_cond(grn_ctx *ctx, grn_obj *snip,
   }
 
   snip_->cond_len++;
+  if (snip_->matcher) {
+    grn_snip_matcher_close(ctx, snip_->matcher);
+    snip_->matcher = NULL;
+  }
   return GRN_SUCCESS;
 }
 
@@ -516,6 +804,7 @@ grn_snip_open(grn_ctx *ctx, int flags, unsigned int width,
   ret->nstr = NULL;
   ret->tag_count = 0;
   ret->snip_count = 0;
+  ret->matcher = NULL;
   if (ret->flags & GRN_SNIP_NORMALIZE) {
     ret->normalizer = GRN_NORMALIZER_AUTO;
   } else {
@@ -577,6 +866,7 @@ grn_snip_close(grn_ctx *ctx, grn_snip *snip)
        cond < cond_end; cond++) {
     grn_snip_cond_close(ctx, cond);
   }
+  grn_snip_matcher_close(ctx, snip->matcher);
   GRN_FREE(snip);
   GRN_API_RETURN(GRN_SUCCESS);
 }
@@ -601,8 +891,14 @@ grn_snip_exec(grn_ctx *ctx, grn_obj *snip, const char *string, unsigned int stri
     GRN_LOG(ctx, GRN_LOG_ALERT, "grn_string_open on grn_snip_exec failed !");
     GRN_API_RETURN(ctx->rc);
   }
+  if (!snip_->matcher && snip_->cond_len >= GRN_SNIP_MATCHER_MIN_N_CONDS) {
+    snip_->matcher = grn_snip_matcher_open(ctx, snip_->cond, snip_->cond_len);
+  }
+  if (snip_->matcher && snip_->matcher->transitions) {
+    grn_snip_matcher_reinit(snip_->matcher);
+  }
   for (i = 0; i < snip_->cond_len; i++) {
-    grn_bm_tunedbm(ctx, snip_->cond + i, snip_->nstr, snip_->flags);
+    grn_snip_cond_search(ctx, snip_, snip_->cond + i);
   }
 
   {
@@ -650,7 +946,7 @@ grn_snip_exec(grn_ctx *ctx, grn_obj *snip, const char *string, unsigned int stri
               }
             }
             if (exclude_other_cond) {
-              grn_bm_tunedbm(ctx, cond, snip_->nstr, snip_->flags);
+              grn_snip_cond_search(ctx, snip_, cond);
               continue;
             }
           }
@@ -663,7 +959,7 @@ grn_snip_exec(grn_ctx *ctx, grn_obj *snip, const char *string, unsigned int stri
           /* check nesting to make valid HTML */
           /* ToDo: allow <test><te>te</te><st>st</st></test> */
           if (cond->start_offset < last_tag_end) {
-            grn_bm_tunedbm(ctx, cond, snip_->nstr, snip_->flags);
+            grn_snip_cond_search(ctx, snip_, cond);
             continue;
           }
         }
@@ -671,7 +967,7 @@ grn_snip_exec(grn_ctx *ctx, grn_obj *snip, const char *string, unsigned int stri
           /* If a keyword gets across a snippet, */
           /* it was skipped and never to be tagged. */
           cond->stopflag = SNIPCOND_ACROSS;
-          grn_bm_tunedbm(ctx, cond, snip_->nstr, snip_->flags);
+          grn_snip_cond_search(ctx, snip_, cond);
         } else {
           found_cond = 1;
           if (cond->count == 0) {
@@ -690,7 +986,7 @@ grn_snip_exec(grn_ctx *ctx, grn_obj *snip, const char *string, unsigned int stri
           if (++snip_->tag_count >= MAX_SNIP_TAG_COUNT) {
             break;
           }
-          grn_bm_tunedbm(ctx, cond, snip_->nstr, snip_->flags);
+          grn_snip_cond_search(ctx, snip_, cond);
         }
       }
       if (!found_cond) {
@@ -0,0 +1,812 @@
+/* -*- c-basic-offset: 2 -*- */
+/*
+  Copyright(C) 2015 Brazil
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License version 2.1 as published by the Free Software Foundation.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "grn_statistics.h"
+#include "grn_db.h"
+#include "grn_ii.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define GRN_STATISTICS_VERSION 1
+
+typedef enum {
+  GRN_STATISTICS_VALUE_NUMBER = 1,
+  GRN_STATISTICS_VALUE_TEXT
+} grn_statistics_value_type;
+
+/*
+  The serialized statistics:
+
+  grn_statistics_header
+  grn_statistics_most_common_value[n_most_common_values]
+  double bounds[n_buckets + 1]
+  uint64_t counts[n_buckets]
+
+  Bucket i has values in (bounds[i], bounds[i + 1]]. The first bucket
+  also has bounds[0]. The most common values aren't in the histogram.
+*/
+typedef struct {
+  uint32_t version;
+  uint32_t value_type;
+  grn_id value_domain;
+  uint32_t n_most_common_values;
+  uint32_t n_buckets;
+  uint32_t reserved;
+  /* the number of records when the statistics are built */
+  uint64_t n_records;
+  uint64_t n_values;
+  uint64_t n_distinct_values;
+  /* for number values */
+  double min;
+  double max;
+} grn_statistics_header;
+
+typedef struct {
+  /* the bits of the number or the hash value of the text */
+  uint64_t key;
+  uint64_t count;
+} grn_statistics_most_common_value;
+
+typedef struct {
+  grn_statistics_header *header;
+  grn_statistics_most_common_value *most_common_values;
+  uint64_t n_most_common_values_total;
+  double *bounds;
+  uint64_t *counts;
+  uint64_t histogram_total;
+} grn_statistics;
+
+typedef struct {
+  /* the records that are counted by n_records */
+  grn_obj *table;
+  /* the lexicon of an index column */
+  grn_obj *lexicon;
+  grn_id value_domain;
+  grn_statistics_value_type value_type;
+} grn_statistics_target;
+
+typedef struct {
+  uint64_t key;
+  double number;
+  uint64_t weight;
+} grn_statistics_entry;
+
+static grn_bool
+grn_statistics_target_init(grn_ctx *ctx, grn_statistics_target *target,
+                           grn_obj *column)
+{
+  target->table = NULL;
+  target->lexicon = NULL;
+
+  switch (column->header.type) {
+  case GRN_COLUMN_FIX_SIZE :
+  case GRN_COLUMN_VAR_SIZE :
+    if ((column->header.flags & GRN_OBJ_COLUMN_TYPE_MASK) !=
+        GRN_OBJ_COLUMN_SCALAR) {
+      return GRN_FALSE;
+    }
+    target->table = grn_ctx_at(ctx, column->header.domain);
+    target->value_domain = grn_obj_get_range(ctx, column);
+    break;
+  case GRN_COLUMN_INDEX :
+    target->lexicon = grn_ctx_at(ctx, column->header.domain);
+    if (!target->lexicon ||
+        target->lexicon->header.type == GRN_TABLE_NO_KEY) {
+      return GRN_FALSE;
+    }
+    target->table = grn_ctx_at(ctx, grn_obj_get_range(ctx, column));
+    target->value_domain = target->lexicon->header.domain;
+    break;
+  default :
+    return GRN_FALSE;
+  }
+  if (!target->table) {
+    return GRN_FALSE;
+  }
+
+  switch (target->value_domain) {
+  case GRN_DB_BOOL :
+  case GRN_DB_INT8 :
+  case GRN_DB_UINT8 :
+  case GRN_DB_INT16 :
+  case GRN_DB_UINT16 :
+  case GRN_DB_INT32 :
+  case GRN_DB_UINT32 :
+  case GRN_DB_INT64 :
+  case GRN_DB_UINT64 :
+  case GRN_DB_FLOAT :
+  case GRN_DB_TIME :
+    target->value_type = GRN_STATISTICS_VALUE_NUMBER;
+    break;
+  case GRN_DB_SHORT_TEXT :
+  case GRN_DB_TEXT :
+  case GRN_DB_LONG_TEXT :
+    target->value_type = GRN_STATISTICS_VALUE_TEXT;
+    break;
+  default :
+    return GRN_FALSE;
+  }
+
+  return GRN_TRUE;
+}
+
+static grn_bool
+grn_statistics_number(grn_id domain, const char *raw, unsigned int size,
+                      double *number)
+{
+  switch (domain) {
+  case GRN_DB_BOOL :
+    if (size < sizeof(unsigned char)) { return GRN_FALSE; }
+    *number = *((unsigned char *)raw) ? 1.0 : 0.0;
+    break;
+  case GRN_DB_INT8 :
+    if (size < sizeof(int8_t)) { return GRN_FALSE; }
+    *number = *((int8_t *)raw);
+    break;
+  case GRN_DB_UINT8 :
+    if (size < sizeof(uint8_t)) { return GRN_FALSE; }
+    *number = *((uint8_t *)raw);
+    break;
+  case GRN_DB_INT16 :
+    if (size < sizeof(int16_t)) { return GRN_FALSE; }
+    *number = *((int16_t *)raw);
+    break;
+  case GRN_DB_UINT16 :
+    if (size < sizeof(uint16_t)) { return GRN_FALSE; }
+    *number = *((uint16_t *)raw);
+    break;
+  case GRN_DB_INT32 :
+    if (size < sizeof(int32_t)) { return GRN_FALSE; }
+    *number = *((int32_t *)raw);
+    break;
+  case GRN_DB_UINT32 :
+    if (size < sizeof(uint32_t)) { return GRN_FALSE; }
+    *number = *((uint32_t *)raw);
+    break;
+  case GRN_DB_INT64 :
+  case GRN_DB_TIME :
+    if (size < sizeof(int64_t)) { return GRN_FALSE; }
+    *number = (double)(*((int64_t *)raw));
+    break;
+  case GRN_DB_UINT64 :
+    if (size < sizeof(uint64_t)) { return GRN_FALSE; }
+    *number = (double)(*((uint64_t *)raw));
+    break;
+  case GRN_DB_FLOAT :
+    if (size < sizeof(double)) { return GRN_FALSE; }
+    *number = *((double *)raw);
+    if (*number != *number) {
+      /* NaN can't be ordered. */
+      return GRN_FALSE;
+    }
+    break;
+  default :
+    return GRN_FALSE;
+  }
+  return GRN_TRUE;
+}
+
+static uint64_t
+grn_statistics_number_key(double number)
+{
+  uint64_t key;
+  if (number == 0.0) {
+    /* -0.0 */
+    number = 0.0;
+  }
+  grn_memcpy(&key, &number, sizeof(uint64_t));
+  return key;
+}
+
+static double
+grn_statistics_key_number(uint64_t key)
+{
+  double number;
+  grn_memcpy(&number, &key, sizeof(double));
+  return number;
+}
+
+/* FNV-1a */
+static uint64_t
+grn_statistics_text_key(const char *text, unsigned int size)
+{
+  uint64_t key = 14695981039346656037ULL;
+  unsigned int i;
+  for (i = 0; i < size; i++) {
+    key ^= (unsigned char)text[i];
+    key *= 1099511628211ULL;
+  }
+  return key;
+}
+
+static void
+grn_statistics_add_entry(grn_ctx *ctx, grn_statistics_target *target,
+                         grn_obj *entries,
+                         const char *raw, unsigned int size,
+                         uint64_t weight)
+{
+  grn_statistics_entry entry;
+
+  if (target->value_type == GRN_STATISTICS_VALUE_NUMBER) {
+    if (!grn_statistics_number(target->value_domain, raw, size,
+                               &(entry.number))) {
+      return;
+    }
+    entry.key = grn_statistics_number_key(entry.number);
+  } else {
+    entry.number = 0.0;
+    entry.key = grn_statistics_text_key(raw, size);
+  }
+  entry.weight = weight;
+  grn_bulk_write(ctx, entries, (const char *)&entry, sizeof(entry));
+}
+
+static void
+grn_statistics_collect(grn_ctx *ctx, grn_statistics_target *target,
+                       grn_obj *column, grn_obj *entries)
+{
+  grn_table_cursor *cursor;
+  grn_id id;
+
+  if (target->lexicon) {
+    cursor = grn_table_cursor_open(ctx, target->lexicon,
+                                   NULL, 0, NULL, 0, 0, -1, 0);
+    if (!cursor) {
+      return;
+    }
+    while ((id = grn_table_cursor_next(ctx, cursor)) != GRN_ID_NIL) {
+      void *key;
+      int key_size;
+      uint64_t weight;
+      weight = grn_ii_estimate_size(ctx, (grn_ii *)column, id);
+      if (weight == 0) {
+        continue;
+      }
+      key_size = grn_table_cursor_get_key(ctx, cursor, &key);
+      grn_statistics_add_entry(ctx, target, entries, key, key_size, weight);
+    }
+    grn_table_cursor_close(ctx, cursor);
+  } else {
+    grn_obj value;
+    cursor = grn_table_cursor_open(ctx, target->table,
+                                   NULL, 0, NULL, 0, 0, -1, 0);
+    if (!cursor) {
+      return;
+    }
+    GRN_OBJ_INIT(&value, GRN_BULK, 0, target->value_domain);
+    while ((id = grn_table_cursor_next(ctx, cursor)) != GRN_ID_NIL) {
+      GRN_BULK_REWIND(&value);
+      grn_obj_get_value(ctx, column, id, &value);
+      grn_statistics_add_entry(ctx, target, entries,
+                               GRN_BULK_HEAD(&value),
+                               GRN_BULK_VSIZE(&value),
+                               1);
+    }
+    GRN_OBJ_FIN(ctx, &value);
+    grn_table_cursor_close(ctx, cursor);
+  }
+}
+
+static int
+grn_statistics_entry_compare_number(const void *data1, const void *data2)
+{
+  const grn_statistics_entry *entry1 = data1;
+  const grn_statistics_entry *entry2 = data2;
+  if (entry1->number < entry2->number) {
+    return -1;
+  } else if (entry1->number > entry2->number) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+static int
+grn_statistics_entry_compare_key(const void *data1, const void *data2)
+{
+  const grn_statistics_entry *entry1 = data1;
+  const grn_statistics_entry *entry2 = data2;
+  if (entry1->key < entry2->key) {
+    return -1;
+  } else if (entry1->key > entry2->key) {
+    return 1;
+  } else {
+    return 0;
+  }
+}
+
+static void
+grn_statistics_build(grn_ctx *ctx, grn_statistics_target *target,
+                     grn_obj *entries, grn_obj *statistics)
+{
+  grn_statistics_header header;
+  grn_statistics_entry *entry_array;
+  int n_entries, n_runs, i;
+  int most_common_indexes[GRN_STATISTICS_MAX_N_MOST_COMMON_VALUES];
+  int n_most_common_values = 0;
+  double bounds[GRN_STATISTICS_MAX_N_BUCKETS + 1];
+  uint64_t counts[GRN_STATISTICS_MAX_N_BUCKETS];
+  uint64_t n_values = 0;
+
+  entry_array = (grn_statistics_entry *)GRN_BULK_HEAD(entries);
+  n_entries = GRN_BULK_VSIZE(entries) / sizeof(grn_statistics_entry);
+  if (target->value_type == GRN_STATISTICS_VALUE_NUMBER) {
+    qsort(entry_array, n_entries, sizeof(grn_statistics_entry),
+          grn_statistics_entry_compare_number);
+  } else {
+    qsort(entry_array, n_entries, sizeof(grn_statistics_entry),
+          grn_statistics_entry_compare_key);
+  }
+
+  /* Merges the same values. */
+  n_runs = 0;
+  for (i = 0; i < n_entries; i++) {
+    n_values += entry_array[i].weight;
+    if (n_runs > 0 && entry_array[n_runs - 1].key == entry_array[i].key) {
+      entry_array[n_runs - 1].weight += entry_array[i].weight;
+    } else {
+      entry_array[n_runs++] = entry_array[i];
+    }
+  }
+
+  memset(&header, 0, sizeof(header));
+  header.version = GRN_STATISTICS_VERSION;
+  header.value_type = target->value_type;
+  header.value_domain = target->value_domain;
+  header.n_records = grn_table_size(ctx, target->table);
+  header.n_values = n_values;
+  header.n_distinct_values = n_runs;
+  if (target->value_type == GRN_STATISTICS_VALUE_NUMBER && n_runs > 0) {
+    header.min = entry_array[0].number;
+    header.max = entry_array[n_runs - 1].number;
+  }
+
+  /* Values that are more common than the average are the most common
+     values. All values are the most common values when there are only
+     a few distinct values. */
+  if (n_runs <= GRN_STATISTICS_MAX_N_MOST_COMMON_VALUES) {
+    for (i = 0; i < n_runs; i++) {
+      most_common_indexes[n_most_common_values++] = i;
+    }
+  } else {
+    uint64_t average = n_values / n_runs;
+    for (i = 0; i < n_runs; i++) {
+      uint64_t weight = entry_array[i].weight;
+      int j;
+      if (weight < 2 || weight <= average) {
+        continue;
+      }
+      if (n_most_common_values == GRN_STATISTICS_MAX_N_MOST_COMMON_VALUES) {
+        int last = most_common_indexes[n_most_common_values - 1];
+        if (weight <= entry_array[last].weight) {
+          continue;
+        }
+        n_most_common_values--;
+      }
+      for (j = n_most_common_values;
+           j > 0 && entry_array[most_common_indexes[j - 1]].weight < weight;
+           j--) {
+        most_common_indexes[j] = most_common_indexes[j - 1];
+      }
+      most_common_indexes[j] = i;
+      n_most_common_values++;
+    }
+  }
+  header.n_most_common_values = n_most_common_values;
+
+  if (target->value_type == GRN_STATISTICS_VALUE_NUMBER) {
+    uint64_t histogram_total = n_values;
+    int n_rest_runs = n_runs - n_most_common_values;
+    int n_buckets = n_rest_runs;
+
+    for (i = 0; i < n_most_common_values; i++) {
+      histogram_total -= entry_array[most_common_indexes[i]].weight;
+    }
+    if (n_buckets > GRN_STATISTICS_MAX_N_BUCKETS) {
+      n_buckets = GRN_STATISTICS_MAX_N_BUCKETS;
+    }
+    if (n_buckets > 0) {
+      uint64_t cumulative = 0;
+      double last = 0.0;
+      int bucket = 0;
+      grn_bool is_first = GRN_TRUE;
+      int next_most_common_value = 0;
+
+      /* The most common values are sorted by weight. Sort them by
+         position to skip them in the following loop. */
+      for (i = 1; i < n_most_common_values; i++) {
+        int index = most_common_indexes[i];
+        int j = i;
+        while (j > 0 && most_common_indexes[j - 1] > index) {
+          most_common_indexes[j] = most_common_indexes[j - 1];
+          j--;
+        }
+        most_common_indexes[j] = index;
+      }
+
+      memset(counts, 0, sizeof(counts));
+      for (i = 0; i < n_runs; i++) {
+        grn_statistics_entry *entry = entry_array + i;
+        if (next_most_common_value < n_most_common_values &&
+            most_common_indexes[next_most_common_value] == i) {
+          next_most_common_value++;
+          continue;
+        }
+        if (is_first) {
+          bounds[0] = entry->number;
+          is_first = GRN_FALSE;
+        }
+        counts[bucket] += entry->weight;
+        cumulative += entry->weight;
+        last = entry->number;
+        if (bucket < n_buckets - 1 &&
+            cumulative * n_buckets >= (bucket + 1) * histogram_total) {
+          bounds[bucket + 1] = entry->number;
+          bucket++;
+        }
+      }
+      if (counts[bucket] == 0 && bucket > 0) {
+        bucket--;
+      }
+      n_buckets = bucket + 1;
+      bounds[n_buckets] = last;
+    }
+    header.n_buckets = n_buckets;
+  }
+
+  grn_bulk_write(ctx, statistics, (const char *)&header, sizeof(header));
+  for (i = 0; i < n_most_common_values; i++) {
+    grn_statistics_most_common_value most_common_value;
+    grn_statistics_entry *entry = entry_array + most_common_indexes[i];
+    most_common_value.key = entry->key;
+    most_common_value.count = entry->weight;
+    grn_bulk_write(ctx, statistics,
+                   (const char *)&most_common_value,
+                   sizeof(most_common_value));
+  }
+  if (header.n_buckets > 0) {
+    grn_bulk_write(ctx, statistics,
+                   (const char *)bounds,
+                   sizeof(double) * (header.n_buckets + 1));
+    grn_bulk_write(ctx, statistics,
+                   (const char *)counts,
+                   sizeof(uint64_t) * header.n_buckets);
+  }
+}
+
+grn_bool
+grn_statistics_is_supported(grn_ctx *ctx, grn_obj *column)
+{
+  grn_statistics_target target;
+  return grn_statistics_target_init(ctx, &target, column);
+}
+
+grn_rc
+grn_statistics_update(grn_ctx *ctx, grn_obj *column)
+{
+  grn_statistics_target target;
+  grn_obj entries;
+  grn_obj statistics;
+
+  if (!grn_statistics_target_init(ctx, &target, column)) {
+    char name[GRN_TABLE_MAX_KEY_SIZE];
+    int name_size;
+    name_size = grn_obj_name(ctx, column, name, GRN_TABLE_MAX_KEY_SIZE);
+    ERR(GRN_INVALID_ARGUMENT,
+        "[statistics][update] unsupported column: <%.*s>",
+        name_size, name);
+    return ctx->rc;
+  }
+
+  GRN_TEXT_INIT(&entries, 0);
+  GRN_TEXT_INIT(&statistics, 0);
+  grn_statistics_collect(ctx, &target, column, &entries);
+  if (ctx->rc == GRN_SUCCESS) {
+    grn_statistics_build(ctx, &target, &entries, &statistics);
+  }
+  if (ctx->rc == GRN_SUCCESS) {
+    grn_obj_set_statistics(ctx, column, &statistics);
+  }
+  GRN_OBJ_FIN(ctx, &statistics);
+  GRN_OBJ_FIN(ctx, &entries);
+
+  return ctx->rc;
+}
+
+static grn_bool
+grn_statistics_open(grn_ctx *ctx, grn_obj *column, grn_obj *buffer,
+                    grn_statistics *statistics)
+{
+  grn_statistics_header *header;
+  size_t size, required_size;
+  const char *current;
+  uint32_t i;
+
+  if (grn_obj_get_statistics(ctx, column, buffer) != GRN_SUCCESS) {
+    return GRN_FALSE;
+  }
+  size = GRN_BULK_VSIZE(buffer);
+  if (size < sizeof(grn_statistics_header)) {
+    return GRN_FALSE;
+  }
+  header = (grn_statistics_header *)GRN_BULK_HEAD(buffer);
+  if (header->version != GRN_STATISTICS_VERSION) {
+    return GRN_FALSE;
+  }
+  if (header->n_most_common_values > GRN_STATISTICS_MAX_N_MOST_COMMON_VALUES ||
+      header->n_buckets > GRN_STATISTICS_MAX_N_BUCKETS) {
+    return GRN_FALSE;
+  }
+  required_size =
+    sizeof(grn_statistics_header) +
+    sizeof(grn_statistics_most_common_value) * header->n_most_common_values;
+  if (header->n_buckets > 0) {
+    required_size +=
+      sizeof(double) * (header->n_buckets + 1) +
+      sizeof(uint64_t) * header->n_buckets;
+  }
+  if (size < required_size) {
+    return GRN_FALSE;
+  }
+
+  current = GRN_BULK_HEAD(buffer) + sizeof(grn_statistics_header);
+  statistics->header = header;
+  statistics->most_common_values = (grn_statistics_most_common_value *)current;
+  statistics->n_most_common_values_total = 0;
+  for (i = 0; i < header->n_most_common_values; i++) {
+    statistics->n_most_common_values_total +=
+      statistics->most_common_values[i].count;
+  }
+  current +=
+    sizeof(grn_statistics_most_common_value) * header->n_most_common_values;
+  statistics->histogram_total = 0;
+  if (header->n_buckets > 0) {
+    statistics->bounds = (double *)current;
+    current += sizeof(double) * (header->n_buckets + 1);
+    statistics->counts = (uint64_t *)current;
+    for (i = 0; i < header->n_buckets; i++) {
+      statistics->histogram_total += statistics->counts[i];
+    }
+  } else {
+    statistics->bounds = NULL;
+    statistics->counts = NULL;
+  }
+
+  return GRN_TRUE;
+}
+
+static grn_bool
+grn_statistics_value_key(grn_ctx *ctx, grn_statistics *statistics,
+                         grn_obj *value, uint64_t *key, double *number)
+{
+  grn_id domain = statistics->header->value_domain;
+  grn_obj casted;
+  const char *raw;
+  unsigned int size;
+  grn_bool succeeded = GRN_TRUE;
+
+  if (value->header.type != GRN_BULK) {
+    return GRN_FALSE;
+  }
+
+  GRN_OBJ_INIT(&casted, GRN_BULK, 0, domain);
+  if (value->header.domain == domain) {
+    raw = GRN_BULK_HEAD(value);
+    size = GRN_BULK_VSIZE(value);
+  } else {
+    if (grn_obj_cast(ctx, value, &casted, GRN_FALSE) != GRN_SUCCESS) {
+      ERRCLR(ctx);
+      GRN_OBJ_FIN(ctx, &casted);
+      return GRN_FALSE;
+    }
+    raw = GRN_BULK_HEAD(&casted);
+    size = GRN_BULK_VSIZE(&casted);
+  }
+
+  if (statistics->header->value_type == GRN_STATISTICS_VALUE_NUMBER) {
+    succeeded = grn_statistics_number(domain, raw, size, number);
+    if (succeeded) {
+      *key = grn_statistics_number_key(*number);
+    }
+  } else {
+    *number = 0.0;
+    *key = grn_statistics_text_key(raw, size);
+  }
+  GRN_OBJ_FIN(ctx, &casted);
+
+  return succeeded;
+}
+
+static grn_bool
+grn_statistics_scale(grn_ctx *ctx, grn_statistics *statistics,
+                     grn_obj *column, double count, int64_t *size)
+{
+  grn_statistics_target target;
+  double n_values = statistics->header->n_values;
+  unsigned int n_records;
+
+  if (statistics->header->n_records == 0) {
+    return GRN_FALSE;
+  }
+  if (!grn_statistics_target_init(ctx, &target, column)) {
+    return GRN_FALSE;
+  }
+
+  if (count < 0.0) {
+    count = 0.0;
+  } else if (count > n_values) {
+    count = n_values;
+  }
+  n_records = grn_table_size(ctx, target.table);
+  *size = (int64_t)(count * n_records / statistics->header->n_records + 0.5);
+  return GRN_TRUE;
+}
+
+grn_bool
+grn_statistics_estimate_equal(grn_ctx *ctx,
+                              grn_obj *column,
+                              grn_obj *value,
+                              int64_t *size)
+{
+  grn_obj buffer;
+  grn_statistics statistics;
+  grn_statistics_header *header;
+  uint64_t key;
+  double number;
+  double count;
+  uint32_t i;
+  grn_bool estimated = GRN_FALSE;
+
+  GRN_TEXT_INIT(&buffer, 0);
+  if (!grn_statistics_open(ctx, column, &buffer, &statistics)) {
+    goto exit;
+  }
+  if (!grn_statistics_value_key(ctx, &statistics, value, &key, &number)) {
+    goto exit;
+  }
+
+  header = statistics.header;
+  for (i = 0; i < header->n_most_common_values; i++) {
+    if (statistics.most_common_values[i].key == key) {
+      break;
+    }
+  }
+  if (i < header->n_most_common_values) {
+    count = statistics.most_common_values[i].count;
+  } else if (header->value_type == GRN_STATISTICS_VALUE_NUMBER &&
+             (number < header->min || header->max < number)) {
+    count = 0.0;
+  } else if (header->n_distinct_values > header->n_most_common_values) {
+    count =
+      (double)(header->n_values - statistics.n_most_common_values_total) /
+      (header->n_distinct_values - header->n_most_common_values);
+  } else {
+    count = 0.0;
+  }
+  estimated = grn_statistics_scale(ctx, &statistics, column, count, size);
+
+exit :
+  GRN_OBJ_FIN(ctx, &buffer);
+  return estimated;
+}
+
+/* The number of values that are less than number in the histogram. */
+static double
+grn_statistics_histogram_below(grn_statistics *statistics, double number)
+{
+  uint32_t i, n_buckets = statistics->header->n_buckets;
+  double *bounds = statistics->bounds;
+  double count = 0.0;
+
+  if (n_buckets == 0 || number <= bounds[0]) {
+    return 0.0;
+  }
+  if (number > bounds[n_buckets]) {
+    return statistics->histogram_total;
+  }
+
+  for (i = 0; i < n_buckets; i++) {
+    double width;
+    if (number > bounds[i + 1]) {
+      count += statistics->counts[i];
+      continue;
+    }
+    width = bounds[i + 1] - bounds[i];
+    if (width > 0.0) {
+      count += statistics->counts[i] * (number - bounds[i]) / width;
+    }
+    break;
+  }
+
+  return count;
+}
+
+grn_bool
+grn_statistics_estimate_range(grn_ctx *ctx,
+                              grn_obj *column,
+                              grn_obj *min,
+                              grn_bool min_include,
+                              grn_obj *max,
+                              grn_bool max_include,
+                              int64_t *size)
+{
+  grn_obj buffer;
+  grn_statistics statistics;
+  grn_statistics_header *header;
+  uint64_t key;
+  double min_number = 0.0, max_number = 0.0;
+  double count = 0.0;
+  uint32_t i;
+  grn_bool estimated = GRN_FALSE;
+
+  GRN_TEXT_INIT(&buffer, 0);
+  if (!grn_statistics_open(ctx, column, &buffer, &statistics)) {
+    goto exit;
+  }
+  header = statistics.header;
+  if (header->value_type != GRN_STATISTICS_VALUE_NUMBER) {
+    goto exit;
+  }
+  if (min &&
+      !grn_statistics_value_key(ctx, &statistics, min, &key, &min_number)) {
+    goto exit;
+  }
+  if (max &&
+      !grn_statistics_value_key(ctx, &statistics, max, &key, &max_number)) {
+    goto exit;
+  }
+
+  for (i = 0; i < header->n_most_common_values; i++) {
+    double number;
+    number = grn_statistics_key_number(statistics.most_common_values[i].key);
+    if (min) {
+      if (number < min_number || (number == min_number && !min_include)) {
+        continue;
+      }
+    }
+    if (max) {
+      if (number > max_number || (number == max_number && !max_include)) {
+        continue;
+      }
+    }
+    count += statistics.most_common_values[i].count;
+  }
+
+  if (header->n_buckets > 0) {
+    double below_max, below_min;
+    if (max) {
+      below_max = grn_statistics_histogram_below(&statistics, max_number);
+    } else {
+      below_max = statistics.histogram_total;
+    }
+    if (min) {
+      below_min = grn_statistics_histogram_below(&statistics, min_number);
+    } else {
+      below_min = 0.0;
+    }
+    if (below_max > below_min) {
+      count += below_max - below_min;
+    }
+  }
+  estimated = grn_statistics_scale(ctx, &statistics, column, count, size);
+
+exit :
+  GRN_OBJ_FIN(ctx, &buffer);
+  return estimated;
+}
@@ -18,6 +18,7 @@
 #include "grn_str.h"
 #include "grn_store.h"
 #include "grn_ctx_impl.h"
+#include "grn_db.h"
 #include "grn_output.h"
 #include <string.h>
 
@@ -26,11 +27,71 @@
 #define GRN_RA_W_SEGMENT    22
 #define GRN_RA_SEGMENT_SIZE (1 << GRN_RA_W_SEGMENT)
 
+/* Zones are stored in the segments after the ones for values. */
+typedef struct {
+  grn_ra_zone_value min;
+  grn_ra_zone_value max;
+  uint32_t n_set_ids;
+  uint32_t reserved[27];
+  uint8_t set_ids[GRN_RA_ZONE_MAP_BLOCK_SIZE / 8];
+} grn_ra_zone;
+
+#define GRN_RA_ZONE_MAP_W_ZONES_PER_SEGMENT (GRN_RA_W_SEGMENT - 8)
+#define GRN_RA_ZONE_MAP_N_SEGMENTS\
+  ((GRN_ID_MAX + 1) >>\
+   (GRN_RA_ZONE_MAP_W_BLOCK + GRN_RA_ZONE_MAP_W_ZONES_PER_SEGMENT))
+
+typedef enum {
+  GRN_RA_ZONE_MAP_KIND_NONE,
+  GRN_RA_ZONE_MAP_KIND_INT,
+  GRN_RA_ZONE_MAP_KIND_UINT,
+  GRN_RA_ZONE_MAP_KIND_FLOAT
+} grn_ra_zone_map_kind;
+
+static grn_bool grn_ra_zone_map_enable = GRN_FALSE;
+
+void
+grn_ra_init_from_env(void)
+{
+  char grn_ra_zone_map_enable_env[GRN_ENV_BUFFER_SIZE];
+  grn_getenv("GRN_RA_ZONE_MAP_ENABLE",
+             grn_ra_zone_map_enable_env,
+             GRN_ENV_BUFFER_SIZE);
+  if (grn_ra_zone_map_enable_env[0]) {
+    grn_ra_zone_map_enable = GRN_TRUE;
+  } else {
+    grn_ra_zone_map_enable = GRN_FALSE;
+  }
+}
+
+static grn_ra_zone_map_kind
+grn_ra_zone_map_kind_from_type(grn_id type)
+{
+  switch (type) {
+  case GRN_DB_INT8 :
+  case GRN_DB_INT16 :
+  case GRN_DB_INT32 :
+  case GRN_DB_INT64 :
+  case GRN_DB_TIME :
+    return GRN_RA_ZONE_MAP_KIND_INT;
+  case GRN_DB_UINT8 :
+  case GRN_DB_UINT16 :
+  case GRN_DB_UINT32 :
+  case GRN_DB_UINT64 :
+    return GRN_RA_ZONE_MAP_KIND_UINT;
+  case GRN_DB_FLOAT :
+    return GRN_RA_ZONE_MAP_KIND_FLOAT;
+  default :
+    return GRN_RA_ZONE_MAP_KIND_NONE;
+  }
+}
+
 static grn_ra *
-_grn_ra_create(grn_ctx *ctx, grn_ra *ra, const char *path, unsigned int element_size)
+_grn_ra_create(grn_ctx *ctx, grn_ra *ra, const char *path,
+               unsigned int element_size, grn_id zone_map_type)
 {
   grn_io *io;
-  int max_segments, n_elm, w_elm;
+  int max_segments, n_value_segments, n_elm, w_elm;
   struct grn_ra_header *header;
   unsigned int actual_size;
   if (element_size > GRN_RA_SEGMENT_SIZE) {
@@ -38,7 +99,11 @@ _grn_ra_create(grn_ctx *ctx, grn_ra *ra, const char *path, unsigned int element_
     return NULL;
   }
   for (actual_size = 1; actual_size < element_size; actual_size *= 2) ;
-  max_segments = ((GRN_ID_MAX + 1) / GRN_RA_SEGMENT_SIZE) * actual_size;
+  n_value_segments = ((GRN_ID_MAX + 1) / GRN_RA_SEGMENT_SIZE) * actual_size;
+  max_segments = n_value_segments;
+  if (zone_map_type != GRN_ID_NIL) {
+    max_segments += GRN_RA_ZONE_MAP_N_SEGMENTS;
+  }
   io = grn_io_create(ctx, path, sizeof(struct grn_ra_header),
                      GRN_RA_SEGMENT_SIZE, max_segments, grn_io_auto,
                      GRN_IO_EXPIRE_SEGMENT);
@@ -46,6 +111,8 @@ _grn_ra_create(grn_ctx *ctx, grn_ra *ra, const char *path, unsigned int element_
   header = grn_io_header(io);
   grn_io_set_type(io, GRN_COLUMN_FIX_SIZE);
   header->element_size = actual_size;
+  header->zone_map_type = zone_map_type;
+  header->zone_map_segment = n_value_segments;
   n_elm = GRN_RA_SEGMENT_SIZE / header->element_size;
   for (w_elm = GRN_RA_W_SEGMENT; (1 << w_elm) > n_elm; w_elm--);
   ra->io = io;
@@ -63,7 +130,34 @@ grn_ra_create(grn_ctx *ctx, const char *path, unsigned int element_size)
     return NULL;
   }
   GRN_DB_OBJ_SET_TYPE(ra, GRN_COLUMN_FIX_SIZE);
-  if (!_grn_ra_create(ctx, ra, path, element_size)) {
+  if (!_grn_ra_create(ctx, ra, path, element_size, GRN_ID_NIL)) {
+    GRN_FREE(ra);
+    return NULL;
+  }
+  return ra;
+}
+
+/*
+  It creates a zone map only when GRN_RA_ZONE_MAP_ENABLE is set and
+  `value_type' is a numeric type or Time. Otherwise, it's the same as
+  grn_ra_create().
+*/
+grn_ra *
+grn_ra_create_with_zone_map(grn_ctx *ctx, const char *path,
+                            unsigned int element_size, grn_id value_type)
+{
+  grn_ra *ra = NULL;
+  grn_id zone_map_type = GRN_ID_NIL;
+  if (grn_ra_zone_map_enable &&
+      grn_ra_zone_map_kind_from_type(value_type) !=
+      GRN_RA_ZONE_MAP_KIND_NONE) {
+    zone_map_type = value_type;
+  }
+  if (!(ra = GRN_GMALLOC(sizeof(grn_ra)))) {
+    return NULL;
+  }
+  GRN_DB_OBJ_SET_TYPE(ra, GRN_COLUMN_FIX_SIZE);
+  if (!_grn_ra_create(ctx, ra, path, element_size, zone_map_type)) {
     GRN_FREE(ra);
     return NULL;
   }
@@ -131,6 +225,7 @@ grn_ra_truncate(grn_ctx *ctx, grn_ra *ra)
   const char *io_path;
   char *path;
   unsigned int element_size;
+  grn_id zone_map_type;
   if ((io_path = grn_io_path(ra->io)) && *io_path != '\0') {
     if (!(path = GRN_STRDUP(io_path))) {
       ERR(GRN_NO_MEMORY_AVAILABLE, "cannot duplicate path: <%s>", io_path);
@@ -140,10 +235,11 @@ grn_ra_truncate(grn_ctx *ctx, grn_ra *ra)
     path = NULL;
   }
   element_size = ra->header->element_size;
+  zone_map_type = ra->header->zone_map_type;
   if ((rc = grn_io_close(ctx, ra->io))) { goto exit; }
   ra->io = NULL;
   if (path && (rc = grn_io_remove(ctx, path))) { goto exit; }
-  if (!_grn_ra_create(ctx, ra, path, element_size)) {
+  if (!_grn_ra_create(ctx, ra, path, element_size, zone_map_type)) {
     rc = GRN_UNKNOWN_ERROR;
   }
 exit:
@@ -202,6 +298,292 @@ grn_ra_cache_fin(grn_ctx *ctx, grn_ra *ra, grn_id id)
   return GRN_SUCCESS;
 }
 
+grn_bool
+grn_ra_have_zone_map(grn_ctx *ctx, grn_ra *ra)
+{
+  return ra->header->zone_map_type != GRN_ID_NIL;
+}
+
+static grn_ra_zone *
+grn_ra_zone_map_ref(grn_ctx *ctx, grn_ra *ra, grn_id id, uint32_t *seg)
+{
+  void *p = NULL;
+  uint32_t block = id >> GRN_RA_ZONE_MAP_W_BLOCK;
+  *seg = ra->header->zone_map_segment +
+    (block >> GRN_RA_ZONE_MAP_W_ZONES_PER_SEGMENT);
+  GRN_IO_SEG_REF(ra->io, *seg, p);
+  if (!p) { return NULL; }
+  block &= (1 << GRN_RA_ZONE_MAP_W_ZONES_PER_SEGMENT) - 1;
+  return ((grn_ra_zone *)p) + block;
+}
+
+static void
+grn_ra_zone_value_read(grn_ra *ra, const void *raw_value,
+                       grn_ra_zone_value *value)
+{
+  switch (ra->header->zone_map_type) {
+  case GRN_DB_INT8 :
+    value->i = *((const int8_t *)raw_value);
+    break;
+  case GRN_DB_INT16 :
+    value->i = *((const int16_t *)raw_value);
+    break;
+  case GRN_DB_INT32 :
+    value->i = *((const int32_t *)raw_value);
+    break;
+  case GRN_DB_INT64 :
+  case GRN_DB_TIME :
+    value->i = *((const int64_t *)raw_value);
+    break;
+  case GRN_DB_UINT8 :
+    value->u = *((const uint8_t *)raw_value);
+    break;
+  case GRN_DB_UINT16 :
+    value->u = *((const uint16_t *)raw_value);
+    break;
+  case GRN_DB_UINT32 :
+    value->u = *((const uint32_t *)raw_value);
+    break;
+  case GRN_DB_UINT64 :
+    value->u = *((const uint64_t *)raw_value);
+    break;
+  case GRN_DB_FLOAT :
+    value->f = *((const double *)raw_value);
+    break;
+  default :
+    value->u = 0;
+    break;
+  }
+}
+
+/* Returns -1, 0 or 1 like strcmp(). */
+static int
+grn_ra_zone_value_compare(grn_ra_zone_map_kind kind,
+                          grn_ra_zone_value *a, grn_ra_zone_value *b)
+{
+  switch (kind) {
+  case GRN_RA_ZONE_MAP_KIND_INT :
+    return (a->i > b->i) - (a->i < b->i);
+  case GRN_RA_ZONE_MAP_KIND_UINT :
+    return (a->u > b->u) - (a->u < b->u);
+  case GRN_RA_ZONE_MAP_KIND_FLOAT :
+    return (a->f > b->f) - (a->f < b->f);
+  default :
+    return 0;
+  }
+}
+
+/* `value' is the new value that has been stored for `id'. */
+void
+grn_ra_zone_map_update(grn_ctx *ctx, grn_ra *ra, grn_id id,
+                       const void *value)
+{
+  grn_ra_zone_map_kind kind;
+  grn_ra_zone *zone;
+  grn_ra_zone_value zone_value;
+  uint32_t seg, offset;
+  uint8_t mask;
+
+  if (ra->header->zone_map_type == GRN_ID_NIL) {
+    return;
+  }
+  if (id > GRN_ID_MAX) {
+    return;
+  }
+
+  kind = grn_ra_zone_map_kind_from_type(ra->header->zone_map_type);
+  zone = grn_ra_zone_map_ref(ctx, ra, id, &seg);
+  if (!zone) {
+    return;
+  }
+  grn_ra_zone_value_read(ra, value, &zone_value);
+  offset = id & (GRN_RA_ZONE_MAP_BLOCK_SIZE - 1);
+  mask = 1 << (offset & 7);
+  if (zone->n_set_ids == 0) {
+    zone->min = zone_value;
+    zone->max = zone_value;
+  } else {
+    if (grn_ra_zone_value_compare(kind, &zone_value, &(zone->min)) < 0) {
+      zone->min = zone_value;
+    }
+    if (grn_ra_zone_value_compare(kind, &zone_value, &(zone->max)) > 0) {
+      zone->max = zone_value;
+    }
+  }
+  if (!(zone->set_ids[offset >> 3] & mask)) {
+    zone->set_ids[offset >> 3] |= mask;
+    zone->n_set_ids++;
+  }
+  GRN_IO_SEG_UNREF(ra->io, seg);
+}
+
+/*
+  Converts `bulk' to a value that can be compared with zones. It fails
+  when the conversion may change the result of the comparison. For
+  example, 2.5 isn't converted for an Int32 column.
+*/
+grn_bool
+grn_ra_zone_map_value_from_bulk(grn_ctx *ctx, grn_ra *ra, grn_obj *bulk,
+                                grn_ra_zone_value *value)
+{
+  grn_id type = ra->header->zone_map_type;
+  grn_id domain;
+  grn_obj casted;
+  grn_bool succeeded = GRN_FALSE;
+
+  if (type == GRN_ID_NIL) {
+    return GRN_FALSE;
+  }
+  if (bulk->header.type != GRN_BULK) {
+    return GRN_FALSE;
+  }
+
+  domain = bulk->header.domain;
+  switch (domain) {
+  case GRN_DB_INT8 :
+  case GRN_DB_INT16 :
+  case GRN_DB_INT32 :
+  case GRN_DB_INT64 :
+  case GRN_DB_UINT8 :
+  case GRN_DB_UINT16 :
+    if (type == GRN_DB_TIME) {
+      return GRN_FALSE;
+    }
+    break;
+  case GRN_DB_UINT32 :
+  case GRN_DB_UINT64 :
+    /* Signed values are compared as unsigned values with them. */
+    if (grn_ra_zone_map_kind_from_type(type) == GRN_RA_ZONE_MAP_KIND_INT) {
+      return GRN_FALSE;
+    }
+    break;
+  case GRN_DB_FLOAT :
+    if (type != GRN_DB_FLOAT) {
+      return GRN_FALSE;
+    }
+    break;
+  case GRN_DB_TIME :
+    if (type != GRN_DB_TIME) {
+      return GRN_FALSE;
+    }
+    break;
+  case GRN_DB_SHORT_TEXT :
+  case GRN_DB_TEXT :
+  case GRN_DB_LONG_TEXT :
+    if (type != GRN_DB_TIME) {
+      return GRN_FALSE;
+    }
+    break;
+  default :
+    return GRN_FALSE;
+  }
+
+  if (domain == type) {
+    grn_ra_zone_value_read(ra, GRN_BULK_HEAD(bulk), value);
+    return GRN_TRUE;
+  }
+
+  GRN_OBJ_INIT(&casted, GRN_BULK, 0, type);
+  if (grn_obj_cast(ctx, bulk, &casted, GRN_FALSE) == GRN_SUCCESS &&
+      GRN_BULK_VSIZE(&casted) > 0) {
+    succeeded = GRN_TRUE;
+    if (domain != GRN_DB_SHORT_TEXT &&
+        domain != GRN_DB_TEXT &&
+        domain != GRN_DB_LONG_TEXT) {
+      /* Values that can't be represented by the column, e.g. 300 for
+         an Int8 column, change the result of the comparison. */
+      grn_obj restored;
+      GRN_OBJ_INIT(&restored, GRN_BULK, 0, domain);
+      if (grn_obj_cast(ctx, &casted, &restored, GRN_FALSE) != GRN_SUCCESS ||
+          GRN_BULK_VSIZE(&restored) != GRN_BULK_VSIZE(bulk) ||
+          memcmp(GRN_BULK_HEAD(&restored), GRN_BULK_HEAD(bulk),
+                 GRN_BULK_VSIZE(bulk)) != 0) {
+        succeeded = GRN_FALSE;
+      }
+      GRN_OBJ_FIN(ctx, &restored);
+    }
+    if (succeeded) {
+      grn_ra_zone_value_read(ra, GRN_BULK_HEAD(&casted), value);
+    }
+  }
+  GRN_OBJ_FIN(ctx, &casted);
+  ERRCLR(ctx);
+  return succeeded;
+}
+
+/*
+  Returns GRN_FALSE only when no record in the block of `id' can satisfy
+  `column op value'. Records that have never been set have 0.
+*/
+grn_bool
+grn_ra_zone_map_may_match(grn_ctx *ctx, grn_ra *ra, grn_id id,
+                          grn_operator op, grn_ra_zone_value *value)
+{
+  grn_ra_zone_map_kind kind;
+  grn_ra_zone *zone;
+  grn_ra_zone_value min, max;
+  uint32_t seg, n_ids;
+  grn_bool may_match = GRN_TRUE;
+
+  if (ra->header->zone_map_type == GRN_ID_NIL) {
+    return GRN_TRUE;
+  }
+  if (id > GRN_ID_MAX) {
+    return GRN_TRUE;
+  }
+
+  kind = grn_ra_zone_map_kind_from_type(ra->header->zone_map_type);
+  zone = grn_ra_zone_map_ref(ctx, ra, id, &seg);
+  if (!zone) {
+    return GRN_TRUE;
+  }
+  min = zone->min;
+  max = zone->max;
+  n_ids = GRN_RA_ZONE_MAP_BLOCK_SIZE;
+  if ((id >> GRN_RA_ZONE_MAP_W_BLOCK) == 0) {
+    /* GRN_ID_NIL isn't a record. */
+    n_ids--;
+  }
+  if (zone->n_set_ids < n_ids) {
+    grn_ra_zone_value zero;
+    zero.u = 0;
+    if (zone->n_set_ids == 0) {
+      min = zero;
+      max = zero;
+    } else {
+      if (grn_ra_zone_value_compare(kind, &zero, &min) < 0) {
+        min = zero;
+      }
+      if (grn_ra_zone_value_compare(kind, &zero, &max) > 0) {
+        max = zero;
+      }
+    }
+  }
+  GRN_IO_SEG_UNREF(ra->io, seg);
+
+  switch (op) {
+  case GRN_OP_EQUAL :
+    may_match = (grn_ra_zone_value_compare(kind, &min, value) <= 0 &&
+                 grn_ra_zone_value_compare(kind, value, &max) <= 0);
+    break;
+  case GRN_OP_LESS :
+    may_match = grn_ra_zone_value_compare(kind, &min, value) < 0;
+    break;
+  case GRN_OP_LESS_EQUAL :
+    may_match = grn_ra_zone_value_compare(kind, &min, value) <= 0;
+    break;
+  case GRN_OP_GREATER :
+    may_match = grn_ra_zone_value_compare(kind, &max, value) > 0;
+    break;
+  case GRN_OP_GREATER_EQUAL :
+    may_match = grn_ra_zone_value_compare(kind, &max, value) >= 0;
+    break;
+  default :
+    break;
+  }
+  return may_match;
+}
+
 /**** jagged arrays ****/
 
 #define GRN_JA_W_SEGREGATE_THRESH_V1   7
@@ -19,6 +19,7 @@
 #include "grn_string.h"
 #include "grn_pat.h"
 #include "grn_dat.h"
+#include "grn_lexicon_cache.h"
 
 static void
 grn_token_cursor_open_initialize_token_filters(grn_ctx *ctx,
@@ -73,6 +74,9 @@ grn_token_cursor_open(grn_ctx *ctx, grn_obj *table,
   token_cursor->pos = -1;
   token_cursor->status = GRN_TOKEN_CURSOR_DOING;
   token_cursor->force_prefix = GRN_FALSE;
+  token_cursor->batch.next_batch = NULL;
+  token_cursor->batch.n_tokens = 0;
+  token_cursor->batch.current = 0;
   if (tokenizer) {
     grn_obj str_, flags_, mode_;
     GRN_TEXT_INIT(&str_, GRN_OBJ_DO_SHALLOW_COPY);
@@ -94,6 +98,8 @@ grn_token_cursor_open(grn_ctx *ctx, grn_obj *table,
     grn_obj_close(ctx, &flags_);
     grn_obj_close(ctx, &str_);
     grn_obj_close(ctx, &mode_);
+    token_cursor->batch.next_batch =
+      ((grn_proc *)tokenizer)->callbacks.tokenizer.next_batch;
   } else {
     int nflags = 0;
     token_cursor->nstr = grn_string_open_(ctx, str, str_len,
@@ -123,8 +129,7 @@ grn_token_cursor_open(grn_ctx *ctx, grn_obj *table,
 static int
 grn_token_cursor_next_apply_token_filters(grn_ctx *ctx,
                                           grn_token_cursor *token_cursor,
-                                          grn_obj *current_token_data,
-                                          grn_obj *status)
+                                          grn_tokenizer_batch_token *token)
 {
   grn_obj *token_filters = token_cursor->token_filters;
   unsigned int i, n_token_filters;
@@ -137,11 +142,16 @@ grn_token_cursor_next_apply_token_filters(grn_ctx *ctx,
     n_token_filters = 0;
   }
 
+  if (n_token_filters == 0) {
+    token_cursor->curr = (const unsigned char *)token->str_ptr;
+    token_cursor->curr_size = token->str_length;
+    return token->status;
+  }
+
   GRN_TEXT_INIT(&(current_token.data), GRN_OBJ_DO_SHALLOW_COPY);
   GRN_TEXT_SET(ctx, &(current_token.data),
-               GRN_TEXT_VALUE(current_token_data),
-               GRN_TEXT_LEN(current_token_data));
-  current_token.status = GRN_INT32_VALUE(status);
+               token->str_ptr, token->str_length);
+  current_token.status = token->status;
   GRN_TEXT_INIT(&(next_token.data), GRN_OBJ_DO_SHALLOW_COPY);
   GRN_TEXT_SET(ctx, &(next_token.data),
                GRN_TEXT_VALUE(&(current_token.data)),
@@ -177,6 +187,110 @@ grn_token_cursor_next_apply_token_filters(grn_ctx *ctx,
   return current_token.status;
 }
 
+static void
+grn_token_cursor_next_token(grn_ctx *ctx, grn_token_cursor *token_cursor,
+                            grn_tokenizer_batch_token *token)
+{
+  grn_obj *table = token_cursor->table;
+  grn_obj *tokenizer = token_cursor->tokenizer;
+
+  if (token_cursor->batch.next_batch) {
+    if (token_cursor->batch.current == token_cursor->batch.n_tokens) {
+      token_cursor->batch.n_tokens =
+        token_cursor->batch.next_batch(ctx,
+                                       &(token_cursor->pctx.user_data),
+                                       token_cursor->batch.tokens,
+                                       GRN_TOKEN_CURSOR_N_BATCH_TOKENS);
+      token_cursor->batch.current = 0;
+      if (token_cursor->batch.n_tokens == 0) {
+        token->str_ptr = "";
+        token->str_length = 0;
+        token->status = GRN_TOKEN_LAST;
+        return;
+      }
+    }
+    *token = token_cursor->batch.tokens[token_cursor->batch.current++];
+  } else {
+    grn_obj *curr_, *stat_;
+    ((grn_proc *)tokenizer)->funcs[PROC_NEXT](ctx, 1, &table, &token_cursor->pctx.user_data);
+    stat_ = grn_ctx_pop(ctx);
+    curr_ = grn_ctx_pop(ctx);
+    token->str_ptr = GRN_TEXT_VALUE(curr_);
+    token->str_length = GRN_TEXT_LEN(curr_);
+    token->status = GRN_UINT32_VALUE(stat_);
+  }
+}
+
+static grn_id
+grn_token_cursor_add_token(grn_ctx *ctx, grn_token_cursor *token_cursor)
+{
+  grn_id tid = GRN_ID_NIL;
+  grn_obj *table = token_cursor->table;
+  switch (table->header.type) {
+  case GRN_TABLE_PAT_KEY :
+    if (grn_io_lock(ctx, ((grn_pat *)table)->io, grn_lock_timeout)) {
+      tid = GRN_ID_NIL;
+    } else {
+      tid = grn_pat_add(ctx, (grn_pat *)table, token_cursor->curr, token_cursor->curr_size,
+                        NULL, NULL);
+      grn_io_unlock(((grn_pat *)table)->io);
+    }
+    break;
+  case GRN_TABLE_DAT_KEY :
+    if (grn_io_lock(ctx, ((grn_dat *)table)->io, grn_lock_timeout)) {
+      tid = GRN_ID_NIL;
+    } else {
+      tid = grn_dat_add(ctx, (grn_dat *)table, token_cursor->curr, token_cursor->curr_size,
+                        NULL, NULL);
+      grn_io_unlock(((grn_dat *)table)->io);
+    }
+    break;
+  case GRN_TABLE_HASH_KEY :
+    if (grn_io_lock(ctx, ((grn_hash *)table)->io, grn_lock_timeout)) {
+      tid = GRN_ID_NIL;
+    } else {
+      tid = grn_hash_add(ctx, (grn_hash *)table, token_cursor->curr, token_cursor->curr_size,
+                         NULL, NULL);
+      grn_io_unlock(((grn_hash *)table)->io);
+    }
+    break;
+  case GRN_TABLE_NO_KEY :
+    if (token_cursor->curr_size == sizeof(grn_id)) {
+      tid = *((grn_id *)token_cursor->curr);
+    } else {
+      tid = GRN_ID_NIL;
+    }
+    break;
+  }
+  return tid;
+}
+
+static grn_id
+grn_token_cursor_get_token(grn_ctx *ctx, grn_token_cursor *token_cursor)
+{
+  grn_id tid = GRN_ID_NIL;
+  grn_obj *table = token_cursor->table;
+  switch (table->header.type) {
+  case GRN_TABLE_PAT_KEY :
+    tid = grn_pat_get(ctx, (grn_pat *)table, token_cursor->curr, token_cursor->curr_size, NULL);
+    break;
+  case GRN_TABLE_DAT_KEY :
+    tid = grn_dat_get(ctx, (grn_dat *)table, token_cursor->curr, token_cursor->curr_size, NULL);
+    break;
+  case GRN_TABLE_HASH_KEY :
+    tid = grn_hash_get(ctx, (grn_hash *)table, token_cursor->curr, token_cursor->curr_size, NULL);
+    break;
+  case GRN_TABLE_NO_KEY :
+    if (token_cursor->curr_size == sizeof(grn_id)) {
+      tid = *((grn_id *)token_cursor->curr);
+    } else {
+      tid = GRN_ID_NIL;
+    }
+    break;
+  }
+  return tid;
+}
+
 grn_id
 grn_token_cursor_next(grn_ctx *ctx, grn_token_cursor *token_cursor)
 {
@@ -186,12 +300,10 @@ grn_token_cursor_next(grn_ctx *ctx, grn_token_cursor *token_cursor)
   grn_obj *tokenizer = token_cursor->tokenizer;
   while (token_cursor->status != GRN_TOKEN_CURSOR_DONE) {
     if (tokenizer) {
-      grn_obj *curr_, *stat_;
-      ((grn_proc *)tokenizer)->funcs[PROC_NEXT](ctx, 1, &table, &token_cursor->pctx.user_data);
-      stat_ = grn_ctx_pop(ctx);
-      curr_ = grn_ctx_pop(ctx);
+      grn_tokenizer_batch_token token;
+      grn_token_cursor_next_token(ctx, token_cursor, &token);
       status = grn_token_cursor_next_apply_token_filters(ctx, token_cursor,
-                                                         curr_, stat_);
+                                                         &token);
       token_cursor->status =
         ((status & GRN_TOKEN_LAST) ||
          (token_cursor->mode == GRN_TOKENIZE_GET &&
@@ -253,61 +365,23 @@ grn_token_cursor_next(grn_ctx *ctx, grn_token_cursor *token_cursor)
     } else {
       token_cursor->status = GRN_TOKEN_CURSOR_DONE;
     }
-    if (token_cursor->mode == GRN_TOKENIZE_ADD) {
-      switch (table->header.type) {
-      case GRN_TABLE_PAT_KEY :
-        if (grn_io_lock(ctx, ((grn_pat *)table)->io, grn_lock_timeout)) {
-          tid = GRN_ID_NIL;
+    {
+      uint32_t generation;
+      generation = grn_lexicon_cache_generation(ctx, table);
+      tid = grn_lexicon_cache_get(ctx, table,
+                                  token_cursor->curr, token_cursor->curr_size,
+                                  generation);
+      if (tid == GRN_ID_NIL) {
+        if (token_cursor->mode == GRN_TOKENIZE_ADD) {
+          tid = grn_token_cursor_add_token(ctx, token_cursor);
         } else {
-          tid = grn_pat_add(ctx, (grn_pat *)table, token_cursor->curr, token_cursor->curr_size,
-                            NULL, NULL);
-          grn_io_unlock(((grn_pat *)table)->io);
+          tid = grn_token_cursor_get_token(ctx, token_cursor);
         }
-        break;
-      case GRN_TABLE_DAT_KEY :
-        if (grn_io_lock(ctx, ((grn_dat *)table)->io, grn_lock_timeout)) {
-          tid = GRN_ID_NIL;
-        } else {
-          tid = grn_dat_add(ctx, (grn_dat *)table, token_cursor->curr, token_cursor->curr_size,
-                            NULL, NULL);
-          grn_io_unlock(((grn_dat *)table)->io);
+        if (tid != GRN_ID_NIL) {
+          grn_lexicon_cache_set(ctx, table,
+                                token_cursor->curr, token_cursor->curr_size,
+                                generation, tid);
         }
-        break;
-      case GRN_TABLE_HASH_KEY :
-        if (grn_io_lock(ctx, ((grn_hash *)table)->io, grn_lock_timeout)) {
-          tid = GRN_ID_NIL;
-        } else {
-          tid = grn_hash_add(ctx, (grn_hash *)table, token_cursor->curr, token_cursor->curr_size,
-                             NULL, NULL);
-          grn_io_unlock(((grn_hash *)table)->io);
-        }
-        break;
-      case GRN_TABLE_NO_KEY :
-        if (token_cursor->curr_size == sizeof(grn_id)) {
-          tid = *((grn_id *)token_cursor->curr);
-        } else {
-          tid = GRN_ID_NIL;
-        }
-        break;
-      }
-    } else {
-      switch (table->header.type) {
-      case GRN_TABLE_PAT_KEY :
-        tid = grn_pat_get(ctx, (grn_pat *)table, token_cursor->curr, token_cursor->curr_size, NULL);
-        break;
-      case GRN_TABLE_DAT_KEY :
-        tid = grn_dat_get(ctx, (grn_dat *)table, token_cursor->curr, token_cursor->curr_size, NULL);
-        break;
-      case GRN_TABLE_HASH_KEY :
-        tid = grn_hash_get(ctx, (grn_hash *)table, token_cursor->curr, token_cursor->curr_size, NULL);
-        break;
-      case GRN_TABLE_NO_KEY :
-        if (token_cursor->curr_size == sizeof(grn_id)) {
-          tid = *((grn_id *)token_cursor->curr);
-        } else {
-          tid = GRN_ID_NIL;
-        }
-        break;
       }
     }
     if (tid == GRN_ID_NIL && token_cursor->status != GRN_TOKEN_CURSOR_DONE) {
@@ -319,6 +393,30 @@ grn_token_cursor_next(grn_ctx *ctx, grn_token_cursor *token_cursor)
   return tid;
 }
 
+unsigned int
+grn_token_cursor_next_batch(grn_ctx *ctx, grn_token_cursor *token_cursor,
+                            grn_id *token_ids, int32_t *positions,
+                            unsigned int max_n_tokens)
+{
+  unsigned int n_tokens = 0;
+
+  while (n_tokens < max_n_tokens &&
+         token_cursor->status == GRN_TOKEN_CURSOR_DOING) {
+    grn_id token_id;
+    token_id = grn_token_cursor_next(ctx, token_cursor);
+    if (token_id == GRN_ID_NIL) {
+      continue;
+    }
+    token_ids[n_tokens] = token_id;
+    if (positions) {
+      positions[n_tokens] = token_cursor->pos;
+    }
+    n_tokens++;
+  }
+
+  return n_tokens;
+}
+
 static void
 grn_token_cursor_close_token_filters(grn_ctx *ctx,
                                      grn_token_cursor *token_cursor)
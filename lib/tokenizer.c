@@ -25,6 +25,7 @@
 #include "grn_str.h"
 #include "grn_string.h"
 #include "grn_token_cursor.h"
+#include "grn_tokenizers.h"
 
 /*
   Just for backward compatibility. See grn_plugin_charlen() instead.
@@ -249,19 +250,17 @@ grn_tokenizer_token_push(grn_ctx *ctx, grn_tokenizer_token *token,
 }
 
 const char *
-grn_tokenizer_tokenized_delimiter_next(grn_ctx *ctx,
-                                       grn_tokenizer_token *token,
-                                       const char *str_ptr,
-                                       unsigned int str_length,
-                                       grn_encoding encoding)
+grn_tokenizer_tokenized_delimiter_next_token(grn_ctx *ctx,
+                                             const char *str_ptr,
+                                             unsigned int str_length,
+                                             grn_encoding encoding,
+                                             grn_tokenizer_batch_token *token)
 {
   size_t char_length = 0;
   const char *start = str_ptr;
   const char *current;
   const char *end = str_ptr + str_length;
   const char *next_start = NULL;
-  unsigned int token_length;
-  grn_token_status status;
 
   for (current = start; current < end; current += char_length) {
     char_length = grn_charlen_(ctx, current, end, encoding);
@@ -275,13 +274,35 @@ grn_tokenizer_tokenized_delimiter_next(grn_ctx *ctx,
     }
   }
 
-  token_length = current - start;
+  token->str_ptr = start;
+  token->str_length = current - start;
   if (current == end) {
-    status = GRN_TOKENIZER_LAST;
+    token->status = GRN_TOKENIZER_LAST;
   } else {
-    status = GRN_TOKENIZER_CONTINUE;
+    token->status = GRN_TOKENIZER_CONTINUE;
   }
-  grn_tokenizer_token_push(ctx, token, start, token_length, status);
+
+  return next_start;
+}
+
+const char *
+grn_tokenizer_tokenized_delimiter_next(grn_ctx *ctx,
+                                       grn_tokenizer_token *token,
+                                       const char *str_ptr,
+                                       unsigned int str_length,
+                                       grn_encoding encoding)
+{
+  grn_tokenizer_batch_token next_token;
+  const char *next_start;
+
+  next_start = grn_tokenizer_tokenized_delimiter_next_token(ctx,
+                                                            str_ptr,
+                                                            str_length,
+                                                            encoding,
+                                                            &next_token);
+  grn_tokenizer_token_push(ctx, token,
+                           next_token.str_ptr, next_token.str_length,
+                           next_token.status);
 
   return next_start;
 }
@@ -318,6 +339,22 @@ grn_tokenizer_register(grn_ctx *ctx, const char *plugin_name_ptr,
   return GRN_SUCCESS;
 }
 
+grn_rc
+grn_tokenizer_set_next_batch_func(grn_ctx *ctx,
+                                  grn_obj *tokenizer,
+                                  grn_tokenizer_next_batch_func *next_batch)
+{
+  if (!tokenizer ||
+      tokenizer->header.type != GRN_PROC ||
+      ((grn_proc *)tokenizer)->type != GRN_PROC_TOKENIZER) {
+    GRN_PLUGIN_ERROR(ctx, GRN_INVALID_ARGUMENT,
+                     "[tokenizer][next-batch] must be a tokenizer");
+    return ctx->rc;
+  }
+  ((grn_proc *)tokenizer)->callbacks.tokenizer.next_batch = next_batch;
+  return GRN_SUCCESS;
+}
+
 grn_obj *
 grn_token_get_data(grn_ctx *ctx, grn_token *token)
 {
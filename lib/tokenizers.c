@@ -17,12 +17,60 @@
 */
 #include <string.h>
 #include "grn_token_cursor.h"
+#include "grn_tokenizers.h"
 #include "grn_string.h"
 #include "grn_plugin.h"
 #include <groonga/tokenizer.h>
 
 grn_obj *grn_tokenizer_uvector = NULL;
 
+/*
+ * Built-in tokenizers extract a token by `*_next_token()'. The
+ * `*_next()' functions push it to grn_ctx stack for the old per token
+ * interface and the `*_next_batch()' functions extract many tokens at
+ * once for grn_tokenizer_next_batch_func.
+ */
+typedef void grn_tokenizer_next_token_func(grn_ctx *ctx,
+                                           void *tokenizer,
+                                           grn_tokenizer_batch_token *token);
+
+static unsigned int
+tokenizer_next_batch(grn_ctx *ctx,
+                     grn_tokenizer_next_token_func *next_token,
+                     void *tokenizer,
+                     grn_tokenizer_batch_token *tokens,
+                     unsigned int max_n_tokens)
+{
+  unsigned int n_tokens = 0;
+
+  while (n_tokens < max_n_tokens) {
+    grn_tokenizer_batch_token *token = tokens + n_tokens;
+    next_token(ctx, tokenizer, token);
+    n_tokens++;
+    if (token->status & GRN_TOKEN_LAST) {
+      break;
+    }
+    if (ctx->rc != GRN_SUCCESS) {
+      break;
+    }
+  }
+
+  return n_tokens;
+}
+
+static void
+tokenizer_next_push(grn_ctx *ctx,
+                    grn_tokenizer_next_token_func *next_token,
+                    void *tokenizer,
+                    grn_tokenizer_token *token_buffer)
+{
+  grn_tokenizer_batch_token token;
+
+  next_token(ctx, tokenizer, &token);
+  grn_tokenizer_token_push(ctx, token_buffer,
+                           token.str_ptr, token.str_length, token.status);
+}
+
 typedef struct {
   grn_tokenizer_token token;
   byte *curr;
@@ -62,30 +110,45 @@ uvector_init(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
   return NULL;
 }
 
-static grn_obj *
-uvector_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
+static void
+uvector_next_token(grn_ctx *ctx, void *user_tokenizer,
+                   grn_tokenizer_batch_token *token)
 {
-  grn_uvector_tokenizer *tokenizer = user_data->ptr;
+  grn_uvector_tokenizer *tokenizer = user_tokenizer;
   byte *p = tokenizer->curr + tokenizer->unit;
   if (tokenizer->tail < p) {
-    grn_tokenizer_token_push(ctx, &(tokenizer->token),
-                             (const char *)tokenizer->curr, 0,
-                             GRN_TOKEN_LAST);
+    token->str_ptr = (const char *)tokenizer->curr;
+    token->str_length = 0;
+    token->status = GRN_TOKEN_LAST;
   } else {
-    grn_token_status status;
     if (tokenizer->tail == p) {
-      status = GRN_TOKEN_LAST;
+      token->status = GRN_TOKEN_LAST;
     } else {
-      status = GRN_TOKEN_CONTINUE;
+      token->status = GRN_TOKEN_CONTINUE;
     }
-    grn_tokenizer_token_push(ctx, &(tokenizer->token),
-                             (const char *)tokenizer->curr, tokenizer->unit,
-                             status);
+    token->str_ptr = (const char *)tokenizer->curr;
+    token->str_length = tokenizer->unit;
     tokenizer->curr = p;
   }
+}
+
+static grn_obj *
+uvector_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
+{
+  grn_uvector_tokenizer *tokenizer = user_data->ptr;
+  tokenizer_next_push(ctx, uvector_next_token, tokenizer, &(tokenizer->token));
   return NULL;
 }
 
+static unsigned int
+uvector_next_batch(grn_ctx *ctx, grn_user_data *user_data,
+                   grn_tokenizer_batch_token *tokens,
+                   unsigned int max_n_tokens)
+{
+  return tokenizer_next_batch(ctx, uvector_next_token, user_data->ptr,
+                              tokens, max_n_tokens);
+}
+
 static grn_obj *
 uvector_fin(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
 {
@@ -152,26 +215,26 @@ delimited_init(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data
   return NULL;
 }
 
-static grn_obj *
-delimited_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
+static void
+delimited_next_token(grn_ctx *ctx, void *user_tokenizer,
+                     grn_tokenizer_batch_token *token)
 {
-  grn_delimited_tokenizer *tokenizer = user_data->ptr;
+  grn_delimited_tokenizer *tokenizer = user_tokenizer;
 
   if (tokenizer->have_tokenized_delimiter) {
     unsigned int rest_length;
     rest_length = tokenizer->end - tokenizer->next;
     tokenizer->next =
-      (unsigned char *)grn_tokenizer_tokenized_delimiter_next(
+      (unsigned char *)grn_tokenizer_tokenized_delimiter_next_token(
         ctx,
-        &(tokenizer->token),
         (const char *)tokenizer->next,
         rest_length,
-        tokenizer->query->encoding);
+        tokenizer->query->encoding,
+        token);
   } else {
     size_t cl;
     const unsigned char *p = tokenizer->next, *r;
     const unsigned char *e = tokenizer->end;
-    grn_token_status status;
     for (r = p; r < e; r += cl) {
       if (!(cl = grn_charlen_(ctx, (char *)r, (char *)e,
                               tokenizer->query->encoding))) {
@@ -194,20 +257,33 @@ delimited_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data
       }
     }
     if (r == e) {
-      status = GRN_TOKEN_LAST;
+      token->status = GRN_TOKEN_LAST;
     } else {
-      status = GRN_TOKEN_CONTINUE;
+      token->status = GRN_TOKEN_CONTINUE;
     }
-    grn_tokenizer_token_push(ctx,
-                             &(tokenizer->token),
-                             (const char *)p,
-                             r - p,
-                             status);
+    token->str_ptr = (const char *)p;
+    token->str_length = r - p;
   }
+}
 
+static grn_obj *
+delimited_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
+{
+  grn_delimited_tokenizer *tokenizer = user_data->ptr;
+  tokenizer_next_push(ctx, delimited_next_token, tokenizer,
+                      &(tokenizer->token));
   return NULL;
 }
 
+static unsigned int
+delimited_next_batch(grn_ctx *ctx, grn_user_data *user_data,
+                     grn_tokenizer_batch_token *tokens,
+                     unsigned int max_n_tokens)
+{
+  return tokenizer_next_batch(ctx, delimited_next_token, user_data->ptr,
+                              tokens, max_n_tokens);
+}
+
 static grn_obj *
 delimited_fin(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
 {
@@ -344,11 +420,12 @@ static grn_obj *
 bigramisad_init(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
 { return ngram_init(ctx, nargs, args, user_data, 2, 0, 0, 0, 1); }
 
-static grn_obj *
-ngram_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
+static void
+ngram_next_token(grn_ctx *ctx, void *user_tokenizer,
+                 grn_tokenizer_batch_token *token)
 {
   size_t cl;
-  grn_ngram_tokenizer *tokenizer = user_data->ptr;
+  grn_ngram_tokenizer *tokenizer = user_tokenizer;
   const unsigned char *p = tokenizer->next, *r = p, *e = tokenizer->end;
   int32_t len = 0, pos = tokenizer->pos + tokenizer->skip;
   grn_token_status status = 0;
@@ -394,7 +471,7 @@ ngram_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
     if ((tid = grn_sym_common_prefix_search(sym, p))) {
       if (!(key = _grn_sym_key(sym, tid))) {
         tokenizer->status = GRN_TOKEN_CURSOR_NOT_FOUND;
-        return NULL;
+        return;
       }
       len = grn_str_len(key, tokenizer->query->encoding, NULL);
     }
@@ -446,14 +523,28 @@ ngram_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
     tokenizer->skip = tokenizer->overlap ? 1 : len;
   }
   if (r == e) { status |= GRN_TOKEN_REACH_END; }
-  grn_tokenizer_token_push(ctx,
-                           &(tokenizer->token),
-                           (const char *)p,
-                           r - p,
-                           status);
+  token->str_ptr = (const char *)p;
+  token->str_length = r - p;
+  token->status = status;
+}
+
+static grn_obj *
+ngram_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
+{
+  grn_ngram_tokenizer *tokenizer = user_data->ptr;
+  tokenizer_next_push(ctx, ngram_next_token, tokenizer, &(tokenizer->token));
   return NULL;
 }
 
+static unsigned int
+ngram_next_batch(grn_ctx *ctx, grn_user_data *user_data,
+                 grn_tokenizer_batch_token *tokens,
+                 unsigned int max_n_tokens)
+{
+  return tokenizer_next_batch(ctx, ngram_next_token, user_data->ptr,
+                              tokens, max_n_tokens);
+}
+
 static grn_obj *
 ngram_fin(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
 {
@@ -483,7 +574,6 @@ typedef struct {
   const char *end;
   unsigned int nth_char;
   const uint_least8_t *char_types;
-  grn_obj buffer;
 } grn_regexp_tokenizer;
 
 static grn_obj *
@@ -528,20 +618,19 @@ regexp_init(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
   tokenizer->char_types =
     grn_string_get_types(ctx, tokenizer->query->normalized_query);
 
-  GRN_TEXT_INIT(&(tokenizer->buffer), 0);
-
   return NULL;
 }
 
-static grn_obj *
-regexp_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
+static void
+regexp_next_token(grn_ctx *ctx, void *user_tokenizer,
+                  grn_tokenizer_batch_token *token)
 {
   int char_len;
   grn_token_status status = 0;
-  grn_regexp_tokenizer *tokenizer = user_data->ptr;
+  grn_regexp_tokenizer *tokenizer = user_tokenizer;
   unsigned int n_characters = 0;
   int ngram_unit = 2;
-  grn_obj *buffer = &(tokenizer->buffer);
+  const char *start = tokenizer->next;
   const char *current = tokenizer->next;
   const char *end = tokenizer->end;
   const uint_least8_t *char_types = tokenizer->char_types;
@@ -551,7 +640,6 @@ regexp_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
   grn_bool break_by_blank = GRN_FALSE;
   grn_bool break_by_end_mark = GRN_FALSE;
 
-  GRN_BULK_REWIND(buffer);
   tokenizer->is_begin = GRN_FALSE;
   tokenizer->is_start_token = GRN_FALSE;
 
@@ -561,28 +649,26 @@ regexp_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
 
   if (mode != GRN_TOKEN_GET) {
     if (is_begin) {
-      grn_tokenizer_token_push(ctx,
-                               &(tokenizer->token),
-                               GRN_TOKENIZER_BEGIN_MARK_UTF8,
-                               GRN_TOKENIZER_BEGIN_MARK_UTF8_LEN,
-                               status);
-      return NULL;
+      token->str_ptr = GRN_TOKENIZER_BEGIN_MARK_UTF8;
+      token->str_length = GRN_TOKENIZER_BEGIN_MARK_UTF8_LEN;
+      token->status = status;
+      return;
     }
 
     if (tokenizer->is_end) {
       status |= GRN_TOKEN_LAST | GRN_TOKEN_REACH_END;
-      grn_tokenizer_token_push(ctx,
-                               &(tokenizer->token),
-                               GRN_TOKENIZER_END_MARK_UTF8,
-                               GRN_TOKENIZER_END_MARK_UTF8_LEN,
-                               status);
-      return NULL;
+      token->str_ptr = GRN_TOKENIZER_END_MARK_UTF8;
+      token->str_length = GRN_TOKENIZER_END_MARK_UTF8_LEN;
+      token->status = status;
+      return;
     }
     if (is_start_token) {
       if (char_types && GRN_STR_ISBLANK(char_types[-1])) {
         status |= GRN_TOKEN_SKIP;
-        grn_tokenizer_token_push(ctx, &(tokenizer->token), "", 0, status);
-        return NULL;
+        token->str_ptr = "";
+        token->str_length = 0;
+        token->status = status;
+        return;
       }
     }
   }
@@ -590,8 +676,10 @@ regexp_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
   char_len = grn_charlen_(ctx, current, end, tokenizer->query->encoding);
   if (char_len == 0) {
     status |= GRN_TOKEN_LAST | GRN_TOKEN_REACH_END;
-    grn_tokenizer_token_push(ctx, &(tokenizer->token), "", 0, status);
-    return NULL;
+    token->str_ptr = "";
+    token->str_length = 0;
+    token->status = status;
+    return;
   }
 
   if (mode == GRN_TOKEN_GET) {
@@ -599,37 +687,31 @@ regexp_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
         char_len == GRN_TOKENIZER_BEGIN_MARK_UTF8_LEN &&
         memcmp(current, GRN_TOKENIZER_BEGIN_MARK_UTF8, char_len) == 0) {
       n_characters++;
-      GRN_TEXT_PUT(ctx, buffer, current, char_len);
       current += char_len;
       tokenizer->next = current;
       tokenizer->nth_char++;
       if (current == end) {
         status |= GRN_TOKEN_LAST | GRN_TOKEN_REACH_END;
       }
-      grn_tokenizer_token_push(ctx,
-                               &(tokenizer->token),
-                               GRN_TOKENIZER_BEGIN_MARK_UTF8,
-                               GRN_TOKENIZER_BEGIN_MARK_UTF8_LEN,
-                               status);
-      return NULL;
+      token->str_ptr = GRN_TOKENIZER_BEGIN_MARK_UTF8;
+      token->str_length = GRN_TOKENIZER_BEGIN_MARK_UTF8_LEN;
+      token->status = status;
+      return;
     }
 
     if (current + char_len == end &&
         char_len == GRN_TOKENIZER_END_MARK_UTF8_LEN &&
         memcmp(current, GRN_TOKENIZER_END_MARK_UTF8, char_len) == 0) {
       status |= GRN_TOKEN_LAST | GRN_TOKEN_REACH_END;
-      grn_tokenizer_token_push(ctx,
-                               &(tokenizer->token),
-                               GRN_TOKENIZER_END_MARK_UTF8,
-                               GRN_TOKENIZER_END_MARK_UTF8_LEN,
-                               status);
-      return NULL;
+      token->str_ptr = GRN_TOKENIZER_END_MARK_UTF8;
+      token->str_length = GRN_TOKENIZER_END_MARK_UTF8_LEN;
+      token->status = status;
+      return;
     }
   }
 
   while (GRN_TRUE) {
     n_characters++;
-    GRN_TEXT_PUT(ctx, buffer, current, char_len);
     current += char_len;
     if (n_characters == 1) {
       tokenizer->next = current;
@@ -706,15 +788,28 @@ regexp_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
     }
   }
 
-  grn_tokenizer_token_push(ctx,
-                           &(tokenizer->token),
-                           GRN_TEXT_VALUE(buffer),
-                           GRN_TEXT_LEN(buffer),
-                           status);
+  token->str_ptr = start;
+  token->str_length = current - start;
+  token->status = status;
+}
 
+static grn_obj *
+regexp_next(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
+{
+  grn_regexp_tokenizer *tokenizer = user_data->ptr;
+  tokenizer_next_push(ctx, regexp_next_token, tokenizer, &(tokenizer->token));
   return NULL;
 }
 
+static unsigned int
+regexp_next_batch(grn_ctx *ctx, grn_user_data *user_data,
+                  grn_tokenizer_batch_token *tokens,
+                  unsigned int max_n_tokens)
+{
+  return tokenizer_next_batch(ctx, regexp_next_token, user_data->ptr,
+                              tokens, max_n_tokens);
+}
+
 static grn_obj *
 regexp_fin(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
 {
@@ -724,7 +819,6 @@ regexp_fin(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
   }
   grn_tokenizer_token_fin(ctx, &(tokenizer->token));
   grn_tokenizer_query_close(ctx, tokenizer->query);
-  GRN_OBJ_FIN(ctx, &(tokenizer->buffer));
   GRN_FREE(tokenizer);
   return NULL;
 }
@@ -742,6 +836,7 @@ grn_tokenizers_init(void)
   _grn_tokenizer_uvector.funcs[PROC_INIT] = uvector_init;
   _grn_tokenizer_uvector.funcs[PROC_NEXT] = uvector_next;
   _grn_tokenizer_uvector.funcs[PROC_FIN] = uvector_fin;
+  _grn_tokenizer_uvector.callbacks.tokenizer.next_batch = uvector_next_batch;
   grn_tokenizer_uvector = (grn_obj *)&_grn_tokenizer_uvector;
   return GRN_SUCCESS;
 }
@@ -791,9 +886,24 @@ grn_db_init_mecab_tokenizer(grn_ctx *ctx)
   }
 }
 
+static grn_obj *
+def_tokenizer(grn_ctx *ctx, const char *name, int name_size,
+              grn_proc_func *init, grn_proc_func *next,
+              grn_tokenizer_next_batch_func *next_batch, grn_proc_func *fin,
+              grn_expr_var *vars)
+{
+  grn_obj *tokenizer;
+  tokenizer = grn_proc_create(ctx, name, name_size,
+                              GRN_PROC_TOKENIZER, init, next, fin, 3, vars);
+  if (tokenizer) {
+    ((grn_proc *)tokenizer)->callbacks.tokenizer.next_batch = next_batch;
+  }
+  return tokenizer;
+}
+
 #define DEF_TOKENIZER(name, init, next, fin, vars)\
-  (grn_proc_create(ctx, (name), (sizeof(name) - 1),\
-                   GRN_PROC_TOKENIZER, (init), (next), (fin), 3, (vars)))
+  (def_tokenizer(ctx, (name), (sizeof(name) - 1),\
+                 (init), (next), next ## _batch, (fin), (vars)))
 
 grn_rc
 grn_db_init_builtin_tokenizers(grn_ctx *ctx)
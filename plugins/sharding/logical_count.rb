@@ -10,16 +10,32 @@ module Groonga
                  "max",
                  "max_border",
                  "filter",
+                 "n_workers",
                ])
 
       def run_body(input)
         enumerator = LogicalEnumerator.new("logical_count", input)
         filter = input[:filter]
+        n_workers = (input[:n_workers] || 1).to_i
 
         total = 0
-        enumerator.each do |shard, shard_range|
-          total += count_n_records(filter, shard, shard_range,
-                                   enumerator.target_range)
+        if n_workers > 1
+          # Shards that need select are counted in parallel at the end.
+          @pending_selects = []
+        end
+        begin
+          enumerator.each do |shard, shard_range|
+            total += count_n_records(filter, shard, shard_range,
+                                     enumerator.target_range)
+          end
+          total += count_pending_selects(n_workers) if @pending_selects
+        ensure
+          if @pending_selects
+            @pending_selects.each do |_, expression|
+              expression.close
+            end
+            @pending_selects = nil
+          end
         end
         writer.write(total)
       end
@@ -128,6 +144,18 @@ module Groonga
         expression = nil
         filtered_table = nil
 
+        if @pending_selects
+          expression = Expression.create(table)
+          begin
+            yield(expression)
+          rescue
+            expression.close
+            raise
+          end
+          @pending_selects << [table, expression]
+          return 0
+        end
+
         begin
           expression = Expression.create(table)
           yield(expression)
@@ -139,6 +167,21 @@ module Groonga
         end
       end
 
+      def count_pending_selects(n_workers)
+        return 0 if @pending_selects.empty?
+
+        tables = @pending_selects.collect(&:first)
+        expressions = @pending_selects.collect(&:last)
+        result_sets = Table.select_parallel(tables, expressions,
+                                            :n_workers => n_workers)
+        total = 0
+        result_sets.each do |result_set|
+          total += result_set.size
+          result_set.close
+        end
+        total
+      end
+
       def count_n_records_in_range(range_index,
                                    min, min_border, max, max_border)
         flags = TableCursorFlags::BY_KEY
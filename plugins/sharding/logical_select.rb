@@ -21,6 +21,7 @@ module Groonga
                  "drilldown_limit",
                  "drilldown_calc_types",
                  "drilldown_calc_target",
+                 "n_workers",
                ])
 
       def run_body(input)
@@ -91,10 +92,16 @@ module Groonga
 
       def write_records(writer, context)
         result_sets = context.result_sets
+        if context.sort_keys.empty?
+          hit_result_sets = result_sets
+        else
+          # Sorted result sets may have only the top records.
+          hit_result_sets = context.unsorted_result_sets
+        end
 
         n_hits = 0
         n_elements = 2 # for N hits and columns
-        result_sets.each do |result_set|
+        hit_result_sets.each do |result_set|
           n_hits += result_set.size
           n_elements += result_set.size
         end
@@ -114,25 +121,51 @@ module Groonga
           current_offset += n_hits if current_offset < 0
           current_limit = context.limit
           current_limit += n_hits + 1 if current_limit < 0
-          options = {
-            :offset => current_offset,
-            :limit => current_limit,
-          }
-          result_sets.each do |result_set|
-            if result_set.size > current_offset
-              writer.write_table_records(result_set, output_columns, options)
-            end
-            if current_offset > 0
-              current_offset = [current_offset - result_set.size, 0].max
-            end
-            current_limit -= result_set.size
-            break if current_limit <= 0
-            options[:offset] = current_offset
-            options[:limit] = current_limit
+          if result_sets.size > 1 and not context.sort_keys.empty?
+            write_merged_records(writer, context,
+                                 current_offset, current_limit)
+          else
+            write_concatenated_records(writer, context,
+                                       current_offset, current_limit)
           end
         end
       end
 
+      def write_concatenated_records(writer, context,
+                                     current_offset, current_limit)
+        output_columns = context.output_columns
+        options = {
+          :offset => current_offset,
+          :limit => current_limit,
+        }
+        context.result_sets.each do |result_set|
+          if result_set.size > current_offset
+            writer.write_table_records(result_set, output_columns, options)
+          end
+          if current_offset > 0
+            current_offset = [current_offset - result_set.size, 0].max
+          end
+          current_limit -= result_set.size
+          break if current_limit <= 0
+          options[:offset] = current_offset
+          options[:limit] = current_limit
+        end
+      end
+
+      def write_merged_records(writer, context, offset, limit)
+        result_sets = context.result_sets
+        runs = Table.merge_sorted(result_sets,
+                                  context.sort_keys.join(","),
+                                  :offset => [offset, 0].max,
+                                  :limit => [limit, 0].max)
+        runs.each do |index, run_offset, run_limit|
+          writer.write_table_records(result_sets[index],
+                                     context.output_columns,
+                                     :offset => run_offset,
+                                     :limit => run_limit)
+        end
+      end
+
       def write_plain_drilldowns(writer, execute_context)
         plain_drilldown = execute_context.plain_drilldown
 
@@ -248,6 +281,8 @@ module Groonga
         attr_reader :unsorted_result_sets
         attr_reader :plain_drilldown
         attr_reader :labeled_drilldowns
+        attr_reader :n_workers
+        attr_reader :pending_selects
         def initialize(input)
           @input = input
           @enumerator = LogicalEnumerator.new("logical_select", @input)
@@ -256,9 +291,11 @@ module Groonga
           @limit = (@input[:limit] || 10).to_i
           @sort_keys = parse_keys(@input[:sortby])
           @output_columns = @input[:output_columns] || "_id, _key, *"
+          @n_workers = (@input[:n_workers] || 1).to_i
 
           @result_sets = []
           @unsorted_result_sets = []
+          @pending_selects = []
 
           @plain_drilldown = PlainDrilldownExecuteContext.new(@input)
           @labeled_drilldowns = LabeledDrilldowns.parse(@input)
@@ -271,10 +308,28 @@ module Groonga
           @unsorted_result_sets.each do |result_set|
             result_set.close if result_set.temporary?
           end
+          @pending_selects.each do |_, _, expression|
+            expression.close if expression
+          end
 
           @plain_drilldown.close
           @labeled_drilldowns.close
         end
+
+        def parallel?
+          @n_workers > 1
+        end
+
+        # Sorted shards are merged at output, so each shard needs only
+        # its first offset + limit records. nil means all records.
+        def sort_limit
+          return nil if @sort_keys.empty?
+          return nil if @offset < 0 or @limit < 0
+          # Drilldowns group the sorted result sets.
+          return nil if @plain_drilldown.have_keys?
+          return nil if @labeled_drilldowns.have_keys?
+          @offset + @limit
+        end
       end
 
       class PlainDrilldownExecuteContext
@@ -454,6 +509,7 @@ module Groonga
             shard_executor = ShardExecutor.new(@context, shard, shard_range)
             shard_executor.execute
           end
+          execute_pending_selects
           if first_shard.nil?
             message =
               "[logical_select] no shard exists: " +
@@ -468,6 +524,41 @@ module Groonga
           end
         end
 
+        def execute_pending_selects
+          pending_selects = @context.pending_selects
+          return if pending_selects.empty?
+
+          tables = []
+          expressions = []
+          pending_selects.each do |_, table, expression|
+            next if expression.nil?
+            tables << table
+            expressions << expression
+          end
+          result_sets = Table.select_parallel(tables, expressions,
+                                              :n_workers => @context.n_workers)
+          begin
+            # Keep shard order so that the output is the same as the
+            # sequential execution.
+            pending_selects.each do |shard_executor, table, expression|
+              if expression.nil?
+                shard_executor.add_result_set(table)
+              else
+                result_set = result_sets.shift
+                if result_set.empty?
+                  result_set.close
+                else
+                  shard_executor.add_result_set(result_set)
+                end
+              end
+            end
+          ensure
+            result_sets.each do |result_set|
+              result_set.close
+            end
+          end
+        end
+
         def execute_plain_drilldown
           drilldown = @context.plain_drilldown
           group_result = TableGroupResult.new
@@ -590,10 +681,29 @@ module Groonga
           end
         end
 
+        def add_result_set(result_set)
+          return if result_set.empty?
+
+          if @sort_keys.empty?
+            @result_sets << result_set
+          else
+            @unsorted_result_sets << result_set
+            sort_options = {}
+            sort_limit = @context.sort_limit
+            sort_options[:limit] = sort_limit if sort_limit
+            sorted_result_set = result_set.sort(@sort_keys, sort_options)
+            @result_sets << sorted_result_set
+          end
+        end
+
         private
         def filter_shard_all(expression_builder)
           if @filter.nil?
-            add_result_set(@shard.table)
+            if @context.parallel?
+              @context.pending_selects << [self, @shard.table, nil]
+            else
+              add_result_set(@shard.table)
+            end
           else
             filter_table do |expression|
               expression_builder.build_all(expression)
@@ -612,21 +722,20 @@ module Groonga
 
         def filter_table
           table = @shard.table
-          create_expression(table) do |expression|
-            yield(expression)
-            add_result_set(table.select(expression))
-          end
-        end
-
-        def add_result_set(result_set)
-          return if result_set.empty?
-
-          if @sort_keys.empty?
-            @result_sets << result_set
+          if @context.parallel?
+            expression = Expression.create(table)
+            begin
+              yield(expression)
+            rescue
+              expression.close
+              raise
+            end
+            @context.pending_selects << [self, table, expression]
           else
-            @unsorted_result_sets << result_set
-            sorted_result_set = result_set.sort(@sort_keys)
-            @result_sets << sorted_result_set
+            create_expression(table) do |expression|
+              yield(expression)
+              add_result_set(table.select(expression))
+            end
           end
         end
       end
@@ -24,37 +24,214 @@
 #include <kytea/kytea.h>
 #include <kytea/string-util.h>
 
+#include <stdlib.h>
 #include <string.h>
 
+#include <list>
+#include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace {
 
-grn_plugin_mutex *kytea_mutex = NULL;
+/*
+  KyTea taggers are pooled so that tokenizers in different threads don't
+  serialize on a single tagger. A tagger is created on first use and a
+  context always uses the same tagger. Each tagger has its own copy of
+  the model, so the pool size is 1 by default. Use GRN_KYTEA_POOL_SIZE
+  to use more taggers.
+ */
+struct grn_kytea_tagger {
+  grn_plugin_mutex *mutex;
+  kytea::Kytea *tagger;
+  kytea::StringUtil *util;
+};
+
 kytea::KyteaConfig *kytea_config = NULL;
-kytea::Kytea *kytea_tagger = NULL;
-kytea::StringUtil *kytea_util = NULL;
+grn_kytea_tagger *kytea_taggers = NULL;
+int kytea_n_taggers = 1;
+
+/*
+  Tokens for short strings such as queries and titles are cached in a
+  LRU cache keyed by the normalized string.
+ */
+const std::size_t KYTEA_RESULT_CACHE_MAX_KEY_SIZE = 256;
+
+typedef std::pair<std::string, std::vector<std::string> > kytea_result;
+typedef std::list<kytea_result> kytea_results;
+
+grn_plugin_mutex *kytea_result_cache_mutex = NULL;
+kytea_results *kytea_result_cache_entries = NULL;
+std::map<std::string, kytea_results::iterator> *kytea_result_cache_index =
+  NULL;
+int kytea_result_cache_size = 1024;
 
 void kytea_init(grn_ctx *ctx);
 void kytea_fin(grn_ctx *ctx);
 
-void kytea_init(grn_ctx *ctx) {
-  if (kytea_mutex || kytea_config || kytea_tagger || kytea_util) {
+void kytea_tagger_open(grn_ctx *ctx, grn_kytea_tagger *kytea_tagger) {
+  kytea::Kytea * const tagger = static_cast<kytea::Kytea *>(
+      GRN_PLUGIN_MALLOC(ctx, sizeof(kytea::Kytea)));
+  if (!tagger) {
+    GRN_PLUGIN_ERROR(ctx, GRN_NO_MEMORY_AVAILABLE,
+                     "[tokenizer][kytea] "
+                     "memory allocation to kytea::Kytea failed");
+    return;
+  }
+
+  try {
+    new (tagger) kytea::Kytea;
+    try {
+      tagger->readModel(kytea_config->getModelFile().c_str());
+    } catch (...) {
+      tagger->~Kytea();
+      GRN_PLUGIN_FREE(ctx, tagger);
+      GRN_PLUGIN_ERROR(ctx, GRN_TOKENIZER_ERROR,
+                       "[tokenizer][kytea] "
+                       "kytea::Kytea::readModel() failed");
+      return;
+    }
+  } catch (...) {
+    GRN_PLUGIN_FREE(ctx, tagger);
     GRN_PLUGIN_ERROR(ctx, GRN_TOKENIZER_ERROR,
                      "[tokenizer][kytea] "
-                     "TokenKytea is already initialized");
+                     "kytea::Kytea initialization failed");
     return;
   }
 
-  kytea_mutex = grn_plugin_mutex_open(ctx);
-  if (!kytea_mutex) {
-    kytea_fin(ctx);
-    GRN_PLUGIN_ERROR(ctx, GRN_NO_MEMORY_AVAILABLE,
+  try {
+    kytea_tagger->util = tagger->getStringUtil();
+  } catch (...) {
+    tagger->~Kytea();
+    GRN_PLUGIN_FREE(ctx, tagger);
+    GRN_PLUGIN_ERROR(ctx, GRN_TOKENIZER_ERROR,
                      "[tokenizer][kytea] "
-                     "grn_plugin_mutex_open() failed");
+                     "kytea::Kytea::getStringUtil() failed");
     return;
   }
+  kytea_tagger->tagger = tagger;
+}
+
+void kytea_tagger_close(grn_ctx *ctx, grn_kytea_tagger *kytea_tagger) {
+  kytea_tagger->util = NULL;
+
+  if (kytea_tagger->tagger) {
+    kytea_tagger->tagger->~Kytea();
+    GRN_PLUGIN_FREE(ctx, kytea_tagger->tagger);
+    kytea_tagger->tagger = NULL;
+  }
+
+  if (kytea_tagger->mutex) {
+    grn_plugin_mutex_close(ctx, kytea_tagger->mutex);
+    kytea_tagger->mutex = NULL;
+  }
+}
+
+grn_kytea_tagger *kytea_tagger_acquire(grn_ctx *ctx) {
+  grn_kytea_tagger * const kytea_tagger =
+    &kytea_taggers[(reinterpret_cast<uintptr_t>(ctx) >> 4) % kytea_n_taggers];
+  grn_plugin_mutex_lock(ctx, kytea_tagger->mutex);
+  if (!kytea_tagger->tagger) {
+    kytea_tagger_open(ctx, kytea_tagger);
+    if (!kytea_tagger->tagger) {
+      grn_plugin_mutex_unlock(ctx, kytea_tagger->mutex);
+      return NULL;
+    }
+  }
+  return kytea_tagger;
+}
+
+void kytea_tagger_release(grn_ctx *ctx, grn_kytea_tagger *kytea_tagger) {
+  grn_plugin_mutex_unlock(ctx, kytea_tagger->mutex);
+}
+
+bool kytea_result_cache_get(grn_ctx *ctx,
+                            const std::string &key,
+                            std::vector<std::string> *tokens) {
+  if (!kytea_result_cache_entries ||
+      key.size() > KYTEA_RESULT_CACHE_MAX_KEY_SIZE) {
+    return false;
+  }
+
+  bool found = false;
+  grn_plugin_mutex_lock(ctx, kytea_result_cache_mutex);
+  try {
+    std::map<std::string, kytea_results::iterator>::iterator it =
+      kytea_result_cache_index->find(key);
+    if (it != kytea_result_cache_index->end()) {
+      kytea_result_cache_entries->splice(kytea_result_cache_entries->begin(),
+                                         *kytea_result_cache_entries,
+                                         it->second);
+      *tokens = it->second->second;
+      found = true;
+    }
+  } catch (...) {
+    found = false;
+  }
+  grn_plugin_mutex_unlock(ctx, kytea_result_cache_mutex);
+  return found;
+}
+
+void kytea_result_cache_set(grn_ctx *ctx,
+                            const std::string &key,
+                            const std::vector<std::string> &tokens) {
+  if (!kytea_result_cache_entries ||
+      key.size() > KYTEA_RESULT_CACHE_MAX_KEY_SIZE) {
+    return;
+  }
+
+  grn_plugin_mutex_lock(ctx, kytea_result_cache_mutex);
+  try {
+    if (kytea_result_cache_index->find(key) ==
+        kytea_result_cache_index->end()) {
+      if (kytea_result_cache_index->size() >=
+          static_cast<std::size_t>(kytea_result_cache_size)) {
+        kytea_result_cache_index->erase(
+          kytea_result_cache_entries->back().first);
+        kytea_result_cache_entries->pop_back();
+      }
+      kytea_result_cache_entries->push_front(kytea_result(key, tokens));
+      (*kytea_result_cache_index)[key] = kytea_result_cache_entries->begin();
+    }
+  } catch (...) {
+    /* The result just isn't cached. */
+  }
+  grn_plugin_mutex_unlock(ctx, kytea_result_cache_mutex);
+}
+
+void kytea_init(grn_ctx *ctx) {
+  if (kytea_config || kytea_taggers || kytea_result_cache_mutex) {
+    GRN_PLUGIN_ERROR(ctx, GRN_TOKENIZER_ERROR,
+                     "[tokenizer][kytea] "
+                     "TokenKytea is already initialized");
+    return;
+  }
+
+  {
+    char env[GRN_ENV_BUFFER_SIZE];
+
+    grn_getenv("GRN_KYTEA_POOL_SIZE",
+               env,
+               GRN_ENV_BUFFER_SIZE);
+    if (env[0]) {
+      const int pool_size = atoi(env);
+      if (pool_size > 0) {
+        kytea_n_taggers = pool_size;
+      }
+    }
+  }
+
+  {
+    char env[GRN_ENV_BUFFER_SIZE];
+
+    grn_getenv("GRN_KYTEA_RESULT_CACHE_SIZE",
+               env,
+               GRN_ENV_BUFFER_SIZE);
+    if (env[0]) {
+      kytea_result_cache_size = atoi(env);
+    }
+  }
 
   kytea::KyteaConfig * const config = static_cast<kytea::KyteaConfig *>(
       GRN_PLUGIN_MALLOC(ctx, sizeof(kytea::KyteaConfig)));
@@ -89,55 +266,77 @@ void kytea_init(grn_ctx *ctx) {
     return;
   }
 
-  kytea::Kytea * const tagger = static_cast<kytea::Kytea *>(
-      GRN_PLUGIN_MALLOC(ctx, sizeof(kytea::Kytea)));
-  if (!tagger) {
+  kytea_taggers = static_cast<grn_kytea_tagger *>(
+      GRN_PLUGIN_MALLOC(ctx, sizeof(grn_kytea_tagger) * kytea_n_taggers));
+  if (!kytea_taggers) {
     kytea_fin(ctx);
     GRN_PLUGIN_ERROR(ctx, GRN_NO_MEMORY_AVAILABLE,
                      "[tokenizer][kytea] "
-                     "memory allocation to kytea::Kytea failed");
+                     "memory allocation to KyTea pool failed");
     return;
   }
-
-  try {
-    new (tagger) kytea::Kytea;
-    kytea_tagger = tagger;
-    try {
-      kytea_tagger->readModel(kytea_config->getModelFile().c_str());
-    } catch (...) {
+  for (int i = 0; i < kytea_n_taggers; ++i) {
+    kytea_taggers[i].mutex = NULL;
+    kytea_taggers[i].tagger = NULL;
+    kytea_taggers[i].util = NULL;
+  }
+  for (int i = 0; i < kytea_n_taggers; ++i) {
+    kytea_taggers[i].mutex = grn_plugin_mutex_open(ctx);
+    if (!kytea_taggers[i].mutex) {
       kytea_fin(ctx);
-      GRN_PLUGIN_ERROR(ctx, GRN_TOKENIZER_ERROR,
+      GRN_PLUGIN_ERROR(ctx, GRN_NO_MEMORY_AVAILABLE,
                        "[tokenizer][kytea] "
-                       "kytea::Kytea::readModel() failed");
+                       "grn_plugin_mutex_open() failed");
       return;
     }
-  } catch (...) {
-    GRN_PLUGIN_FREE(ctx, tagger);
-    kytea_fin(ctx);
-    GRN_PLUGIN_ERROR(ctx, GRN_TOKENIZER_ERROR,
-                     "[tokenizer][kytea] "
-                     "kytea::Kytea initialization failed");
-    return;
   }
 
-  try {
-    kytea_util = kytea_tagger->getStringUtil();
-  } catch (...) {
+  /* The first tagger is created here to report a broken model early. */
+  kytea_tagger_open(ctx, &kytea_taggers[0]);
+  if (!kytea_taggers[0].tagger) {
     kytea_fin(ctx);
-    GRN_PLUGIN_ERROR(ctx, GRN_TOKENIZER_ERROR,
-                     "[tokenizer][kytea] "
-                     "kytea::Kytea::getStringUtil() failed");
     return;
   }
+
+  if (kytea_result_cache_size > 0) {
+    kytea_result_cache_mutex = grn_plugin_mutex_open(ctx);
+    if (!kytea_result_cache_mutex) {
+      kytea_fin(ctx);
+      GRN_PLUGIN_ERROR(ctx, GRN_NO_MEMORY_AVAILABLE,
+                       "[tokenizer][kytea] "
+                       "grn_plugin_mutex_open() failed");
+      return;
+    }
+    try {
+      kytea_result_cache_entries = new kytea_results;
+      kytea_result_cache_index =
+        new std::map<std::string, kytea_results::iterator>;
+    } catch (...) {
+      kytea_fin(ctx);
+      GRN_PLUGIN_ERROR(ctx, GRN_NO_MEMORY_AVAILABLE,
+                       "[tokenizer][kytea] "
+                       "memory allocation to result cache failed");
+      return;
+    }
+  }
 }
 
 void kytea_fin(grn_ctx *ctx) {
-  kytea_util = NULL;
+  delete kytea_result_cache_index;
+  kytea_result_cache_index = NULL;
+  delete kytea_result_cache_entries;
+  kytea_result_cache_entries = NULL;
+  if (kytea_result_cache_mutex) {
+    grn_plugin_mutex_close(ctx, kytea_result_cache_mutex);
+    kytea_result_cache_mutex = NULL;
+  }
 
-  if (kytea_tagger) {
-    kytea_tagger->~Kytea();
-    GRN_PLUGIN_FREE(ctx, kytea_tagger);
-    kytea_tagger = NULL;
+  if (kytea_taggers) {
+    for (int i = 0; i < kytea_n_taggers; ++i) {
+      kytea_tagger_close(ctx, &kytea_taggers[i]);
+    }
+    GRN_PLUGIN_FREE(ctx, kytea_taggers);
+    kytea_taggers = NULL;
   }
 
   if (kytea_config) {
@@ -145,11 +344,6 @@ void kytea_fin(grn_ctx *ctx) {
     GRN_PLUGIN_FREE(ctx, kytea_config);
     kytea_config = NULL;
   }
-
-  if (kytea_mutex) {
-    grn_plugin_mutex_close(ctx, kytea_mutex);
-    kytea_mutex = NULL;
-  }
 }
 
 struct grn_tokenizer_kytea {
@@ -229,21 +423,37 @@ grn_obj *grn_kytea_init(grn_ctx *ctx, int num_args, grn_obj **args,
     tokenizer->rest_query_string = normalized_string;
     tokenizer->rest_query_string_length = normalized_string_length;
   } else {
-    grn_plugin_mutex_lock(ctx, kytea_mutex);
+    std::string str;
+    try {
+      str.assign(normalized_string, normalized_string_length);
+    } catch (...) {
+      GRN_PLUGIN_ERROR(ctx, GRN_TOKENIZER_ERROR,
+                       "[tokenizer][kytea] "
+                       "tokenization failed");
+      return NULL;
+    }
+    if (kytea_result_cache_get(ctx, str, &(tokenizer->tokens))) {
+      user_data->ptr = tokenizer;
+      return NULL;
+    }
+
+    grn_kytea_tagger * const kytea_tagger = kytea_tagger_acquire(ctx);
+    if (!kytea_tagger) {
+      return NULL;
+    }
+    kytea::StringUtil * const kytea_util = kytea_tagger->util;
     try {
-      const std::string str(normalized_string, normalized_string_length);
       const kytea::KyteaString &surface_str = kytea_util->mapString(str);
       const kytea::KyteaString &normalized_str = kytea_util->normalize(surface_str);
       tokenizer->sentence = kytea::KyteaSentence(surface_str, normalized_str);
-      kytea_tagger->calculateWS(tokenizer->sentence);
+      kytea_tagger->tagger->calculateWS(tokenizer->sentence);
     } catch (...) {
-      grn_plugin_mutex_unlock(ctx, kytea_mutex);
+      kytea_tagger_release(ctx, kytea_tagger);
       GRN_PLUGIN_ERROR(ctx, GRN_TOKENIZER_ERROR,
                        "[tokenizer][kytea] "
                        "tokenization failed");
       return NULL;
     }
-    grn_plugin_mutex_unlock(ctx, kytea_mutex);
 
     try {
       for (std::size_t i = 0; i < tokenizer->sentence.words.size(); ++i) {
@@ -266,11 +476,15 @@ grn_obj *grn_kytea_init(grn_ctx *ctx, int num_args, grn_obj **args,
         }
       }
     } catch (...) {
+      kytea_tagger_release(ctx, kytea_tagger);
       GRN_PLUGIN_ERROR(ctx, GRN_TOKENIZER_ERROR,
                        "[tokenizer][kytea] "
                        "adjustment failed");
       return NULL;
     }
+    kytea_tagger_release(ctx, kytea_tagger);
+
+    kytea_result_cache_set(ctx, str, tokenizer->tokens);
   }
 
   user_data->ptr = tokenizer;
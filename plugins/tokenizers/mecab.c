@@ -30,13 +30,55 @@
 #include <string.h>
 #include <ctype.h>
 
-static mecab_t *sole_mecab = NULL;
-static grn_plugin_mutex *sole_mecab_mutex = NULL;
-static grn_encoding sole_mecab_encoding = GRN_ENC_NONE;
+typedef struct {
+  mecab_t *mecab;
+  grn_plugin_mutex *mutex;
+} grn_mecab;
+
+/*
+  MeCab instances are pooled so that tokenizers in different threads
+  don't serialize on a single mecab_t. Each instance is created on first
+  use and a context always uses the same instance.
+ */
+static grn_mecab *mecab_pool = NULL;
+static int mecab_pool_size = 8;
+static grn_bool mecab_encoding_detected = GRN_FALSE;
+static grn_encoding mecab_encoding = GRN_ENC_NONE;
 
 static grn_bool grn_mecab_chunked_tokenize_enabled = GRN_FALSE;
 static int grn_mecab_chunk_size_threshold = 8192;
 
+/*
+  Results of mecab_sparse_tostr2() for short strings such as queries and
+  titles are cached in a LRU cache keyed by the normalized string.
+ */
+#define GRN_MECAB_RESULT_CACHE_MAX_KEY_SIZE 256
+
+typedef struct {
+  char *key;
+  unsigned int key_size;
+  const char *value;
+  unsigned int value_size;
+  unsigned int hash_value;
+  int hash_next;
+  int prev;
+  int next;
+} grn_mecab_result_cache_entry;
+
+typedef struct {
+  grn_plugin_mutex *mutex;
+  int size;
+  int n_entries;
+  grn_mecab_result_cache_entry *entries;
+  int *buckets;
+  unsigned int bucket_mask;
+  int head;
+  int tail;
+} grn_mecab_result_cache;
+
+static grn_mecab_result_cache mecab_result_cache;
+static int mecab_result_cache_size = 1024;
+
 typedef struct {
   mecab_t *mecab;
   grn_obj buf;
@@ -90,6 +132,245 @@ get_mecab_encoding(mecab_t *mecab)
   return encoding;
 }
 
+static grn_mecab *
+mecab_pool_acquire(grn_ctx *ctx)
+{
+  grn_mecab *mecab;
+
+  mecab = &(mecab_pool[((uintptr_t)ctx >> 4) % mecab_pool_size]);
+  grn_plugin_mutex_lock(ctx, mecab->mutex);
+  if (!mecab->mecab) {
+    mecab->mecab = mecab_new2("-Owakati");
+    if (!mecab->mecab) {
+      grn_plugin_mutex_unlock(ctx, mecab->mutex);
+      GRN_PLUGIN_ERROR(ctx, GRN_TOKENIZER_ERROR,
+                       "[tokenizer][mecab] "
+                       "mecab_new2() failed on mecab_init(): %s",
+                       mecab_global_error_message());
+      return NULL;
+    }
+    if (!mecab_encoding_detected) {
+      mecab_encoding = get_mecab_encoding(mecab->mecab);
+      mecab_encoding_detected = GRN_TRUE;
+    }
+  }
+  return mecab;
+}
+
+static void
+mecab_pool_release(grn_ctx *ctx, grn_mecab *mecab)
+{
+  grn_plugin_mutex_unlock(ctx, mecab->mutex);
+}
+
+static unsigned int
+mecab_result_cache_hash(const char *key, unsigned int key_size)
+{
+  unsigned int hash_value = 2166136261U;
+  unsigned int i;
+  for (i = 0; i < key_size; i++) {
+    hash_value ^= (unsigned char)key[i];
+    hash_value *= 16777619U;
+  }
+  return hash_value;
+}
+
+static void
+mecab_result_cache_unlink(grn_mecab_result_cache *cache, int i)
+{
+  grn_mecab_result_cache_entry *entry = &(cache->entries[i]);
+  if (entry->prev == -1) {
+    cache->head = entry->next;
+  } else {
+    cache->entries[entry->prev].next = entry->next;
+  }
+  if (entry->next == -1) {
+    cache->tail = entry->prev;
+  } else {
+    cache->entries[entry->next].prev = entry->prev;
+  }
+}
+
+static void
+mecab_result_cache_link_head(grn_mecab_result_cache *cache, int i)
+{
+  grn_mecab_result_cache_entry *entry = &(cache->entries[i]);
+  entry->prev = -1;
+  entry->next = cache->head;
+  if (cache->head == -1) {
+    cache->tail = i;
+  } else {
+    cache->entries[cache->head].prev = i;
+  }
+  cache->head = i;
+}
+
+static grn_bool
+mecab_result_cache_get(grn_ctx *ctx,
+                       const char *key, unsigned int key_size,
+                       grn_obj *value)
+{
+  grn_mecab_result_cache *cache = &mecab_result_cache;
+  unsigned int hash_value;
+  int i;
+  grn_bool found = GRN_FALSE;
+
+  if (cache->size == 0 || key_size > GRN_MECAB_RESULT_CACHE_MAX_KEY_SIZE) {
+    return GRN_FALSE;
+  }
+
+  hash_value = mecab_result_cache_hash(key, key_size);
+  grn_plugin_mutex_lock(ctx, cache->mutex);
+  for (i = cache->buckets[hash_value & cache->bucket_mask];
+       i != -1;
+       i = cache->entries[i].hash_next) {
+    grn_mecab_result_cache_entry *entry = &(cache->entries[i]);
+    if (entry->hash_value == hash_value &&
+        entry->key_size == key_size &&
+        memcmp(entry->key, key, key_size) == 0) {
+      GRN_TEXT_PUT(ctx, value, entry->value, entry->value_size);
+      if (cache->head != i) {
+        mecab_result_cache_unlink(cache, i);
+        mecab_result_cache_link_head(cache, i);
+      }
+      found = GRN_TRUE;
+      break;
+    }
+  }
+  grn_plugin_mutex_unlock(ctx, cache->mutex);
+
+  return found;
+}
+
+static void
+mecab_result_cache_set(grn_ctx *ctx,
+                       const char *key, unsigned int key_size,
+                       const char *value, unsigned int value_size)
+{
+  grn_mecab_result_cache *cache = &mecab_result_cache;
+  grn_mecab_result_cache_entry *entry;
+  unsigned int hash_value;
+  char *data;
+  int i;
+
+  if (cache->size == 0 || key_size > GRN_MECAB_RESULT_CACHE_MAX_KEY_SIZE) {
+    return;
+  }
+
+  data = GRN_PLUGIN_MALLOC(ctx, key_size + value_size);
+  if (!data) {
+    return;
+  }
+  memcpy(data, key, key_size);
+  memcpy(data + key_size, value, value_size);
+  hash_value = mecab_result_cache_hash(key, key_size);
+
+  grn_plugin_mutex_lock(ctx, cache->mutex);
+  for (i = cache->buckets[hash_value & cache->bucket_mask];
+       i != -1;
+       i = cache->entries[i].hash_next) {
+    entry = &(cache->entries[i]);
+    if (entry->hash_value == hash_value &&
+        entry->key_size == key_size &&
+        memcmp(entry->key, key, key_size) == 0) {
+      /* Another thread has already cached the same string. */
+      grn_plugin_mutex_unlock(ctx, cache->mutex);
+      GRN_PLUGIN_FREE(ctx, data);
+      return;
+    }
+  }
+  if (cache->n_entries < cache->size) {
+    i = cache->n_entries++;
+  } else {
+    int *previous;
+    i = cache->tail;
+    entry = &(cache->entries[i]);
+    mecab_result_cache_unlink(cache, i);
+    for (previous = &(cache->buckets[entry->hash_value & cache->bucket_mask]);
+         *previous != i;
+         previous = &(cache->entries[*previous].hash_next)) {
+    }
+    *previous = entry->hash_next;
+    GRN_PLUGIN_FREE(ctx, entry->key);
+  }
+  entry = &(cache->entries[i]);
+  entry->key = data;
+  entry->key_size = key_size;
+  entry->value = data + key_size;
+  entry->value_size = value_size;
+  entry->hash_value = hash_value;
+  entry->hash_next = cache->buckets[hash_value & cache->bucket_mask];
+  cache->buckets[hash_value & cache->bucket_mask] = i;
+  mecab_result_cache_link_head(cache, i);
+  grn_plugin_mutex_unlock(ctx, cache->mutex);
+}
+
+static void
+mecab_result_cache_init(grn_ctx *ctx)
+{
+  grn_mecab_result_cache *cache = &mecab_result_cache;
+  unsigned int n_buckets;
+  unsigned int i;
+
+  cache->size = 0;
+  cache->n_entries = 0;
+  cache->entries = NULL;
+  cache->buckets = NULL;
+  cache->head = -1;
+  cache->tail = -1;
+  cache->mutex = NULL;
+  if (mecab_result_cache_size <= 0) {
+    return;
+  }
+
+  for (n_buckets = 1;
+       n_buckets < (unsigned int)mecab_result_cache_size;
+       n_buckets <<= 1) {
+  }
+  cache->mutex = grn_plugin_mutex_open(ctx);
+  cache->entries =
+    GRN_PLUGIN_MALLOC(ctx,
+                      sizeof(grn_mecab_result_cache_entry) *
+                      mecab_result_cache_size);
+  cache->buckets = GRN_PLUGIN_MALLOC(ctx, sizeof(int) * n_buckets);
+  if (!cache->mutex || !cache->entries || !cache->buckets) {
+    GRN_PLUGIN_ERROR(ctx, GRN_NO_MEMORY_AVAILABLE,
+                     "[tokenizer][mecab] "
+                     "failed to allocate the result cache");
+    return;
+  }
+  for (i = 0; i < n_buckets; i++) {
+    cache->buckets[i] = -1;
+  }
+  cache->bucket_mask = n_buckets - 1;
+  cache->size = mecab_result_cache_size;
+}
+
+static void
+mecab_result_cache_fin(grn_ctx *ctx)
+{
+  grn_mecab_result_cache *cache = &mecab_result_cache;
+  int i;
+
+  for (i = 0; i < cache->n_entries; i++) {
+    GRN_PLUGIN_FREE(ctx, cache->entries[i].key);
+  }
+  if (cache->entries) {
+    GRN_PLUGIN_FREE(ctx, cache->entries);
+    cache->entries = NULL;
+  }
+  if (cache->buckets) {
+    GRN_PLUGIN_FREE(ctx, cache->buckets);
+    cache->buckets = NULL;
+  }
+  if (cache->mutex) {
+    grn_plugin_mutex_close(ctx, cache->mutex);
+    cache->mutex = NULL;
+  }
+  cache->n_entries = 0;
+  cache->size = 0;
+}
+
 static inline grn_bool
 is_delimiter_character(grn_ctx *ctx, const char *character, int character_bytes)
 {
@@ -291,33 +572,23 @@ mecab_init(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
   if (!query) {
     return NULL;
   }
-  if (!sole_mecab) {
-    grn_plugin_mutex_lock(ctx, sole_mecab_mutex);
-    if (!sole_mecab) {
-      sole_mecab = mecab_new2("-Owakati");
-      if (!sole_mecab) {
-        GRN_PLUGIN_ERROR(ctx, GRN_TOKENIZER_ERROR,
-                         "[tokenizer][mecab] "
-                         "mecab_new2() failed on mecab_init(): %s",
-                         mecab_global_error_message());
-      } else {
-        sole_mecab_encoding = get_mecab_encoding(sole_mecab);
-      }
+  if (!mecab_encoding_detected) {
+    grn_mecab *mecab;
+    mecab = mecab_pool_acquire(ctx);
+    if (!mecab) {
+      grn_tokenizer_query_close(ctx, query);
+      return NULL;
     }
-    grn_plugin_mutex_unlock(ctx, sole_mecab_mutex);
-  }
-  if (!sole_mecab) {
-    grn_tokenizer_query_close(ctx, query);
-    return NULL;
+    mecab_pool_release(ctx, mecab);
   }
 
-  if (query->encoding != sole_mecab_encoding) {
+  if (query->encoding != mecab_encoding) {
     grn_tokenizer_query_close(ctx, query);
     GRN_PLUGIN_ERROR(ctx, GRN_TOKENIZER_ERROR,
                      "[tokenizer][mecab] "
                      "MeCab dictionary charset (%s) does not match "
                      "the table encoding: <%s>",
-                     grn_encoding_to_string(sole_mecab_encoding),
+                     grn_encoding_to_string(mecab_encoding),
                      grn_encoding_to_string(query->encoding));
     return NULL;
   }
@@ -329,7 +600,7 @@ mecab_init(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
                      "memory allocation to grn_mecab_tokenizer failed");
     return NULL;
   }
-  tokenizer->mecab = sole_mecab;
+  tokenizer->mecab = NULL;
   tokenizer->query = query;
 
   normalized_query = query->normalized_query;
@@ -346,34 +617,54 @@ mecab_init(grn_ctx *ctx, int nargs, grn_obj **args, grn_user_data *user_data)
     tokenizer->next = "";
     tokenizer->end = tokenizer->next;
   } else {
-    grn_bool succeeded;
-    grn_plugin_mutex_lock(ctx, sole_mecab_mutex);
-    if (grn_mecab_chunked_tokenize_enabled &&
-        ctx->encoding == GRN_ENC_UTF8) {
-      succeeded = chunked_tokenize_utf8(ctx,
-                                        tokenizer,
-                                        normalized_string,
-                                        normalized_string_length);
-    } else {
-      const char *s;
-      s = mecab_sparse_tostr2(tokenizer->mecab,
-                              normalized_string,
-                              normalized_string_length);
-      if (!s) {
+    grn_bool succeeded = GRN_TRUE;
+    if (!mecab_result_cache_get(ctx,
+                                normalized_string,
+                                normalized_string_length,
+                                &(tokenizer->buf))) {
+      grn_mecab *mecab;
+      mecab = mecab_pool_acquire(ctx);
+      if (!mecab) {
         succeeded = GRN_FALSE;
-        GRN_PLUGIN_ERROR(ctx, GRN_TOKENIZER_ERROR,
-                         "[tokenizer][mecab] "
-                         "mecab_sparse_tostr() failed len=%d err=%s",
-                         normalized_string_length,
-                         mecab_strerror(tokenizer->mecab));
       } else {
-        succeeded = GRN_TRUE;
-        GRN_TEXT_PUTS(ctx, &(tokenizer->buf), s);
+        tokenizer->mecab = mecab->mecab;
+        if (grn_mecab_chunked_tokenize_enabled &&
+            ctx->encoding == GRN_ENC_UTF8) {
+          succeeded = chunked_tokenize_utf8(ctx,
+                                            tokenizer,
+                                            normalized_string,
+                                            normalized_string_length);
+        } else {
+          const char *s;
+          s = mecab_sparse_tostr2(tokenizer->mecab,
+                                  normalized_string,
+                                  normalized_string_length);
+          if (!s) {
+            succeeded = GRN_FALSE;
+            GRN_PLUGIN_ERROR(ctx, GRN_TOKENIZER_ERROR,
+                             "[tokenizer][mecab] "
+                             "mecab_sparse_tostr() failed len=%d err=%s",
+                             normalized_string_length,
+                             mecab_strerror(tokenizer->mecab));
+          } else {
+            succeeded = GRN_TRUE;
+            GRN_TEXT_PUTS(ctx, &(tokenizer->buf), s);
+          }
+        }
+        mecab_pool_release(ctx, mecab);
+        tokenizer->mecab = NULL;
+      }
+      if (succeeded) {
+        mecab_result_cache_set(ctx,
+                               normalized_string,
+                               normalized_string_length,
+                               GRN_TEXT_VALUE(&(tokenizer->buf)),
+                               GRN_TEXT_LEN(&(tokenizer->buf)));
       }
     }
-    grn_plugin_mutex_unlock(ctx, sole_mecab_mutex);
     if (!succeeded) {
       grn_tokenizer_query_close(ctx, tokenizer->query);
+      GRN_OBJ_FIN(ctx, &(tokenizer->buf));
       GRN_PLUGIN_FREE(ctx, tokenizer);
       return NULL;
     }
@@ -540,11 +831,71 @@ GRN_PLUGIN_INIT(grn_ctx *ctx)
     }
   }
 
-  sole_mecab = NULL;
-  sole_mecab_mutex = grn_plugin_mutex_open(ctx);
-  if (!sole_mecab_mutex) {
+  {
+    char env[GRN_ENV_BUFFER_SIZE];
+
+    grn_getenv("GRN_MECAB_POOL_SIZE",
+               env,
+               GRN_ENV_BUFFER_SIZE);
+    if (env[0]) {
+      int pool_size;
+      const char *end;
+      const char *rest;
+
+      end = env + strlen(env);
+      pool_size = grn_atoi(env, end, &rest);
+      if (end > env && end == rest && pool_size > 0) {
+        mecab_pool_size = pool_size;
+      }
+    }
+  }
+
+  {
+    char env[GRN_ENV_BUFFER_SIZE];
+
+    grn_getenv("GRN_MECAB_RESULT_CACHE_SIZE",
+               env,
+               GRN_ENV_BUFFER_SIZE);
+    if (env[0]) {
+      int cache_size;
+      const char *end;
+      const char *rest;
+
+      end = env + strlen(env);
+      cache_size = grn_atoi(env, end, &rest);
+      if (end > env && end == rest && cache_size >= 0) {
+        mecab_result_cache_size = cache_size;
+      }
+    }
+  }
+
+  mecab_encoding_detected = GRN_FALSE;
+  mecab_encoding = GRN_ENC_NONE;
+  mecab_pool = GRN_PLUGIN_MALLOC(ctx, sizeof(grn_mecab) * mecab_pool_size);
+  if (!mecab_pool) {
     GRN_PLUGIN_ERROR(ctx, GRN_NO_MEMORY_AVAILABLE,
-                     "[tokenizer][mecab] grn_plugin_mutex_open() failed");
+                     "[tokenizer][mecab] "
+                     "memory allocation to MeCab pool failed");
+    return ctx->rc;
+  }
+  {
+    int i;
+    for (i = 0; i < mecab_pool_size; i++) {
+      mecab_pool[i].mecab = NULL;
+      mecab_pool[i].mutex = NULL;
+    }
+    for (i = 0; i < mecab_pool_size; i++) {
+      mecab_pool[i].mutex = grn_plugin_mutex_open(ctx);
+      if (!mecab_pool[i].mutex) {
+        GRN_PLUGIN_ERROR(ctx, GRN_NO_MEMORY_AVAILABLE,
+                         "[tokenizer][mecab] grn_plugin_mutex_open() failed");
+        return ctx->rc;
+      }
+    }
+  }
+
+  mecab_result_cache_init(ctx);
+  if (ctx->rc != GRN_SUCCESS) {
     return ctx->rc;
   }
 
@@ -580,14 +931,20 @@ GRN_PLUGIN_REGISTER(grn_ctx *ctx)
 grn_rc
 GRN_PLUGIN_FIN(grn_ctx *ctx)
 {
-  if (sole_mecab) {
-    mecab_destroy(sole_mecab);
-    sole_mecab = NULL;
-  }
-  if (sole_mecab_mutex) {
-    grn_plugin_mutex_close(ctx, sole_mecab_mutex);
-    sole_mecab_mutex = NULL;
+  if (mecab_pool) {
+    int i;
+    for (i = 0; i < mecab_pool_size; i++) {
+      if (mecab_pool[i].mecab) {
+        mecab_destroy(mecab_pool[i].mecab);
+      }
+      if (mecab_pool[i].mutex) {
+        grn_plugin_mutex_close(ctx, mecab_pool[i].mutex);
+      }
+    }
+    GRN_PLUGIN_FREE(ctx, mecab_pool);
+    mecab_pool = NULL;
   }
+  mecab_result_cache_fin(ctx);
 
   return GRN_SUCCESS;
 }